@@ -0,0 +1,62 @@
+// interrupt count benchmark: step and counter interrupts taken for typical
+// moves, against the one interrupt per step of a counting comparator ISR
+#include "sim.h"
+#include "stepper.h"
+
+#include <stdio.h>
+
+void app_main(void);
+
+typedef struct {
+   const char *name;
+   stepper_mode_E mode;
+   stepper_speed_E speed;
+   uint32_t period_fine; // T1 in 24.8 fixed point
+   uint32_t distance;    // steps for gotos
+   uint32_t seconds;     // run time for tracking
+} bench_case_S;
+
+int main(void) {
+   static const bench_case_S cases[] = {
+      {.name = "sidereal tracking", .mode = STEPPER_TRACKING, .speed = STEPPER_SLOW, .period_fine = 71803, .seconds = 600},
+      {.name = "fast slew",         .mode = STEPPER_TRACKING, .speed = STEPPER_FAST, .period_fine = 10 << 8, .seconds = 60},
+      {.name = "slow goto",         .mode = STEPPER_GOTO,     .speed = STEPPER_SLOW, .period_fine = 90 << 8, .distance = 10000},
+      {.name = "fast goto",         .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .period_fine = 10 << 8, .distance = 2000000},
+   };
+
+   // starts the firmware tasks, stepper_task initializes the steppers and runs every tick while an axis moves
+   app_main();
+   sim_run_for(1000);
+
+   printf("%-20s %10s %10s %10s %10s\n", "", "time", "steps", "before", "after");
+   printf("%-20s %10s %10s %10s %10s\n", "", "s", "", "isr", "isr");
+
+   for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+      const bench_case_S *c = &cases[i];
+      uint32_t count = stepper_get_count(STEPPER_RA);
+
+      stepper_set_mode(STEPPER_RA, c->mode, c->speed, STEPPER_CW);
+      stepper_set_period_fine(STEPPER_RA, c->period_fine);
+      stepper_set_target(STEPPER_RA, count + c->distance);
+      stepper_reset_isr_stats();
+
+      uint64_t start = sim_now();
+      stepper_start(STEPPER_RA);
+      if(c->mode == STEPPER_TRACKING) {
+         sim_run_for(c->seconds * 1000000ULL);
+         stepper_stop(STEPPER_RA);
+      }
+      while(stepper_busy(STEPPER_RA)) sim_run_for(1000);
+
+      uint32_t steps = stepper_get_count(STEPPER_RA) - count;
+      uint32_t isr_count, isr_load;
+      stepper_get_isr_stats(STEPPER_RA, &isr_count, &isr_load);
+
+      printf("%-20s %10.1f %10u %10u %10u\n",
+             c->name, (sim_now() - start) / 1e9, steps, steps, isr_count);
+
+      sim_run_for(100000);
+   }
+
+   return 0;
+}
@@ -0,0 +1,52 @@
+// command round trip benchmark: sends ':j1' over UART0 at random points in
+// time and measures simulated time until the whole response is queued for
+// transmit, which is the firmware's share of the latency
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COMMANDS 2000
+#define RESOLUTION_US 10
+
+void app_main(void);
+
+static int compare(const void *a, const void *b) {
+   uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+   return x < y ? -1 : x > y;
+}
+
+int main(void) {
+   static uint64_t latency[COMMANDS];
+   static const char cmd[] = ":j1\r";
+   uint64_t sum = 0;
+
+   app_main();
+   sim_run_for(100000);
+   srand(1);
+
+   for(int i = 0; i < COMMANDS; i++) {
+      sim_run_for(rand() % 20000);
+      sim_uart_rx(UART_NUM_0, cmd, strlen(cmd));
+
+      uint64_t start = sim_now();
+      char resp[16];
+      size_t len = 0;
+      while(len == 0 || resp[len - 1] != '\r') {
+         sim_run_for(RESOLUTION_US);
+         len += sim_uart_tx(UART_NUM_0, resp + len, sizeof(resp) - len);
+      }
+      latency[i] = sim_now() - start;
+      sum += latency[i];
+   }
+
+   qsort(latency, COMMANDS, sizeof(latency[0]), compare);
+   printf("%d commands, resolution %d us\n", COMMANDS, RESOLUTION_US);
+   printf("%10s %10s %10s %10s %10s\n", "mean", "p50", "p99", "p999", "max");
+   printf("%10s %10s %10s %10s %10s\n", "us", "us", "us", "us", "us");
+   printf("%10.0f %10.0f %10.0f %10.0f %10.0f\n", sum / 1e3 / COMMANDS,
+          latency[COMMANDS / 2] / 1e3, latency[COMMANDS * 99 / 100] / 1e3,
+          latency[COMMANDS * 999 / 1000] / 1e3, latency[COMMANDS - 1] / 1e3);
+   return 0;
+}
@@ -0,0 +1,68 @@
+// SynScan parser throughput: feeds a recorded client session through
+// ss_handle_byte over and over and reports commands and bytes per second
+// of host time, with a checksum of every reply so that a faster parser can
+// be checked to answer exactly the same
+//   bench_parser [commands] [minimum commands/s, exits 1 below it]
+#include "sim.h"
+#include "synscan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void app_main(void);
+
+// a planetarium app polling both axes while aligning, from a serial capture
+static const char *const SESSION[] = {
+   ":e1\r", ":e2\r", ":a1\r", ":a2\r", ":b1\r", ":b2\r", ":g1\r", ":g2\r", ":s1\r", ":s2\r",
+   ":F3\r", ":P12\r", ":P22\r", ":M1000100\r",
+   ":j1\r", ":j2\r", ":f1\r", ":f2\r",
+   ":j1\r", ":j2\r", ":f1\r", ":f2\r",
+   ":K1\r", ":G130\r", ":I1B00800\r", ":i1\r",
+   ":j1\r", ":j2\r", ":f1\r", ":f2\r",
+   ":K2\r", ":G201\r", ":S2000080\r", ":h2\r", ":H2001000\r",
+   ":j1\r", ":j2\r", ":f1\r", ":f2\r",
+   ":E1000080\r", ":D1\r", ":x1\r", ":j9\r", ":I1123\r",
+   ":j1\r", ":j2\r", ":f1\r", ":f2\r",
+};
+#define SESSION_LEN (sizeof(SESSION) / sizeof(SESSION[0]))
+
+int main(int argc, char **argv) {
+   uint64_t commands = argc > 1 ? strtoull(argv[1], NULL, 0) : 2000000;
+   double min_rate = argc > 2 ? atof(argv[2]) : 0;
+
+   app_main();
+   sim_run_for(100000);
+
+   // flattened so the loop only measures the parser
+   static char stream[4096];
+   size_t stream_len = 0;
+   for(size_t i = 0; i < SESSION_LEN; i++) {
+      size_t len = strlen(SESSION[i]);
+      memcpy(stream + stream_len, SESSION[i], len);
+      stream_len += len;
+   }
+
+   ss_parser_S parser = {0};
+   uint64_t replies = 0, bytes = 0;
+   uint32_t checksum = 0;
+
+   struct timespec start, end;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   while(replies < commands) {
+      for(size_t i = 0; i < stream_len; i++) {
+         size_t len = ss_handle_byte(&parser, stream[i]);
+         for(size_t j = 0; j < len; j++) checksum = checksum * 31 + parser.data[j];
+         replies += len != 0;
+      }
+      bytes += stream_len;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   double s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+   printf("%12s %12s %12s %12s %10s\n", "commands", "s", "commands/s", "MB/s", "checksum");
+   printf("%12llu %12.3f %12.0f %12.2f   %08x\n", (unsigned long long) replies, s, replies / s, bytes / s / 1e6, checksum);
+
+   return replies / s < min_rate;
+}
@@ -0,0 +1,121 @@
+// ramp generator benchmark: time to cruise and velocity error against the
+// ideal constant acceleration profile v = sqrt(2 a x)
+#include "sim.h"
+#include "stepper.h"
+
+#include <math.h>
+#include <stdio.h>
+
+// board wiring and timer resolution, see stepper.c
+static const gpio_num_t RA_STEP = GPIO_NUM_14;
+static const uint64_t TICK_NS = 1000000000ULL / (STEPPER_FREQ * 10);
+
+typedef struct {
+   uint32_t accel;
+   uint32_t period; // T1, run at STEPPER_FAST so this is the cruise period in ticks
+} bench_case_S;
+
+typedef struct {
+   uint32_t accel;
+   uint64_t cruise_ns;
+   uint64_t stop_at;
+
+   uint64_t last_edge;
+   uint32_t steps;
+   uint64_t cruise_at;   // time the first cruise interval began
+   uint32_t cruise_step;
+   uint32_t stop_step;   // steps taken when stop was requested
+
+   double err_sum;
+   double err_max;
+   uint32_t err_count;
+} bench_run_S;
+
+static void bench_edge(gpio_num_t gpio, void *ctx) {
+   bench_run_S *run = ctx;
+   uint64_t now = sim_now();
+
+   if(run->steps > 0) {
+      uint64_t interval = now - run->last_edge;
+
+      if(!run->cruise_at && interval == run->cruise_ns) {
+         run->cruise_at = run->last_edge;
+         run->cruise_step = run->steps;
+      }
+
+      // velocity over the interval against the ideal at its midpoint
+      if(!run->cruise_at) {
+         double v = 1e9 / interval;
+         double v_ideal = sqrt(2.0 * run->accel * (run->steps - 0.5));
+         double err = fabs(v - v_ideal) / v_ideal;
+         run->err_sum += err * err;
+         run->err_count++;
+         if(err > run->err_max) run->err_max = err;
+      }
+   }
+
+   run->last_edge = now;
+   run->steps++;
+}
+
+int main(void) {
+   static const bench_case_S cases[] = {
+      {.accel = 32000, .period = 200},
+      {.accel = 32000, .period = 50},
+      {.accel = 32000, .period = 20},
+      {.accel = 32000, .period = 10},
+      {.accel = 8000,  .period = 10},
+      {.accel = 64000, .period = 10},
+   };
+
+   stepper_init();
+
+   printf("%8s %8s %10s | %10s %10s %10s | %9s %9s | %10s %10s %10s\n",
+          "accel", "v_max", "staircase",
+          "cruise", "ideal", "steps",
+          "v_rms", "v_max",
+          "stop", "ideal", "steps");
+   printf("%8s %8s %10s | %10s %10s %10s | %9s %9s | %10s %10s %10s\n",
+          "step/s2", "step/s", "ms",
+          "ms", "ms", "",
+          "err %", "err %",
+          "ms", "ms", "");
+
+   for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+      const bench_case_S *c = &cases[i];
+      bench_run_S run = {
+         .accel = c->accel,
+         .cruise_ns = c->period * TICK_NS,
+      };
+
+      double v_max = 1e9 / run.cruise_ns;
+      double ideal_cruise = v_max / c->accel;
+      // the old stepper_task set period 512 / n once per 10 ms
+      double staircase = c->period >= 512 ? 0 : ((512 + c->period - 1) / c->period - 1) * 10.0;
+
+      sim_gpio_watch(RA_STEP, bench_edge, &run);
+      stepper_set_accel(STEPPER_RA, c->accel);
+      stepper_set_mode(STEPPER_RA, STEPPER_TRACKING, STEPPER_FAST, STEPPER_CW);
+      stepper_set_period(STEPPER_RA, c->period);
+
+      uint64_t start = sim_now();
+      stepper_start(STEPPER_RA);
+      sim_run_for(ideal_cruise * 1.2e6 + 100000);
+
+      run.stop_at = sim_now();
+      run.stop_step = run.steps;
+      stepper_stop(STEPPER_RA);
+      while(stepper_busy(STEPPER_RA)) sim_run_for(1000);
+      sim_gpio_unwatch(RA_STEP, bench_edge, &run);
+
+      printf("%8u %8.0f %10.1f | %10.2f %10.2f %10u | %9.3f %9.3f | %10.2f %10.2f %10u\n",
+             c->accel, v_max, staircase,
+             run.cruise_at ? (run.cruise_at - start) / 1e6 : NAN, ideal_cruise * 1e3, run.cruise_step,
+             run.err_count ? sqrt(run.err_sum / run.err_count) * 100 : 0, run.err_max * 100,
+             (run.last_edge - run.stop_at) / 1e6, ideal_cruise * 1e3, run.steps - run.stop_step);
+
+      sim_run_for(10000);
+   }
+
+   return 0;
+}
@@ -0,0 +1,32 @@
+#include "sim.h"
+#include <esp_adc/adc_oneshot.h>
+
+struct adc_oneshot_unit_ctx_t {
+   adc_unit_t unit_id;
+};
+
+static struct adc_oneshot_unit_ctx_t units[2];
+static int raw_values[ADC_CHANNEL_9 + 1];
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *init_config, adc_oneshot_unit_handle_t *ret_unit) {
+   if(!init_config || !ret_unit || init_config->unit_id > ADC_UNIT_2) return ESP_ERR_INVALID_ARG;
+   units[init_config->unit_id].unit_id = init_config->unit_id;
+   *ret_unit = &units[init_config->unit_id];
+   return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel, const adc_oneshot_chan_cfg_t *config) {
+   if(!handle || !config || channel > ADC_CHANNEL_9) return ESP_ERR_INVALID_ARG;
+   return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t chan, int *out_raw) {
+   if(!handle || !out_raw || chan > ADC_CHANNEL_9) return ESP_ERR_INVALID_ARG;
+   *out_raw = raw_values[chan];
+   return ESP_OK;
+}
+
+void sim_adc_set(adc_channel_t chan, int raw) {
+   if(chan > ADC_CHANNEL_9) return;
+   raw_values[chan] = raw;
+}
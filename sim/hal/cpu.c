@@ -0,0 +1,23 @@
+#include <esp_cpu.h>
+#include <sdkconfig.h>
+#include <sim.h>
+#include <time.h>
+
+static uint64_t host_ns(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// the sim clock plus the host time spent since it last moved, so the time between
+// events follows the sim and the cost of code run at one instant follows the host
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+   static uint64_t sim_last, host_start;
+   uint64_t now = sim_now();
+   uint64_t host = host_ns();
+   if(now != sim_last) {
+      sim_last = now;
+      host_start = host;
+   }
+   return (now + host - host_start) * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ / 1000;
+}
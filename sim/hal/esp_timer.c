@@ -0,0 +1,67 @@
+#include "sim.h"
+#include <esp_timer.h>
+
+// callbacks run inline from the simulated clock, standing in for the esp_timer task
+struct esp_timer {
+   sim_source_S source; // must be first
+   esp_timer_cb_t callback;
+   void *arg;
+   uint64_t period; // ns, 0 for one shot
+};
+
+static void esp_timer_fire(sim_source_S *source) {
+   struct esp_timer *timer = (struct esp_timer*) source;
+   timer->source.next = timer->period ? timer->source.next + timer->period : SIM_NEVER;
+   timer->callback(timer->arg);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+   if(!create_args || !create_args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+
+   struct esp_timer *timer = calloc(1, sizeof(*timer));
+   if(!timer) return ESP_ERR_NO_MEM;
+
+   timer->callback = create_args->callback;
+   timer->arg = create_args->arg;
+   timer->source.next = SIM_NEVER;
+   timer->source.fire = esp_timer_fire;
+   sim_source_add(&timer->source);
+
+   *out_handle = timer;
+   return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+   if(!timer) return ESP_ERR_INVALID_ARG;
+   if(timer->source.next != SIM_NEVER) return ESP_ERR_INVALID_STATE;
+   timer->period = 0;
+   timer->source.next = sim_now() + timeout_us * 1000;
+   return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+   if(!timer || period == 0) return ESP_ERR_INVALID_ARG;
+   if(timer->source.next != SIM_NEVER) return ESP_ERR_INVALID_STATE;
+   timer->period = period * 1000;
+   timer->source.next = sim_now() + timer->period;
+   return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+   if(!timer) return ESP_ERR_INVALID_ARG;
+   if(timer->source.next == SIM_NEVER) return ESP_ERR_INVALID_STATE;
+   timer->source.next = SIM_NEVER;
+   return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+   if(!timer) return ESP_ERR_INVALID_ARG;
+   if(timer->source.next != SIM_NEVER) return ESP_ERR_INVALID_STATE;
+   // stays linked in the source list, it just never fires again
+   timer->callback = NULL;
+   return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void) {
+   return sim_now() / 1000;
+}
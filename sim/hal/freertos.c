@@ -0,0 +1,384 @@
+// FreeRTOS tasks, notifications and queues on the simulated clock
+//
+// Every task is a host thread, but only one thread runs at a time: either the
+// simulation itself or the task it handed the CPU to. A task runs until it
+// blocks, in zero simulated time, and ready tasks run highest priority first
+// after every event the clock fires. Blocking calls made outside of a task
+// never block. Ticks follow configTICK_RATE_HZ, so a timeout of one tick ends
+// on the next tick boundary just as on target.
+#include "sim.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+
+#define SIM_TICK_NS (1000000000ULL / configTICK_RATE_HZ)
+#define SIM_SOCKET_POLL_NS 1000000ULL
+
+struct sim_task_S {
+   pthread_t thread;
+   pthread_cond_t cond;
+   TaskFunction_t fn;
+   void *arg;
+   const char *name;
+   UBaseType_t priority;
+
+   bool ready;
+   bool deleted;
+   const void *wait_obj; // what the task blocks on, NULL when not waiting
+   uint64_t wake_at;     // ns, SIM_NEVER without timeout
+   bool woken;           // woken on wait_obj rather than by timeout
+   uint32_t notify;
+
+   // sockets the task waits on in sim_select
+   int nfds;
+   fd_set rfds, wfds, efds;
+
+   struct sim_task_S *link;
+};
+
+struct QueueDefinition {
+   uint8_t *data;
+   UBaseType_t length;
+   UBaseType_t item_size;
+   UBaseType_t head;
+   UBaseType_t count;
+};
+
+struct sim_mutex_S {
+   struct sim_task_S *holder;
+   bool taken;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+static struct sim_task_S *current; // NULL while the simulation runs
+static struct sim_task_S *tasks;
+
+static sim_source_S timeouts = {.next = SIM_NEVER};
+static sim_source_S socket_poll = {.next = SIM_NEVER};
+static const int delay_obj;
+
+static void timeouts_update(void) {
+   timeouts.next = SIM_NEVER;
+   for(struct sim_task_S *task = tasks; task; task = task->link) {
+      if(task->wait_obj && task->wake_at < timeouts.next) timeouts.next = task->wake_at;
+   }
+}
+
+static void timeouts_fire(sim_source_S *source) {
+   for(struct sim_task_S *task = tasks; task; task = task->link) {
+      if(task->wait_obj && task->wake_at <= sim_now()) {
+         task->wait_obj = NULL;
+         task->woken = false;
+         task->ready = true;
+      }
+   }
+   timeouts_update();
+}
+
+// the socket side is outside simulated time, so look at it every ms
+static void socket_poll_fire(sim_source_S *source) {
+   bool waiting = false;
+   for(struct sim_task_S *task = tasks; task; task = task->link) {
+      if(task->wait_obj != &socket_poll) continue;
+
+      fd_set rfds = task->rfds, wfds = task->wfds, efds = task->efds;
+      struct timeval zero = {0};
+      if(select(task->nfds, &rfds, &wfds, &efds, &zero) != 0) {
+         task->wait_obj = NULL;
+         task->woken = true;
+         task->ready = true;
+      } else {
+         waiting = true;
+      }
+   }
+   socket_poll.next = waiting ? sim_now() + SIM_SOCKET_POLL_NS : SIM_NEVER;
+   timeouts_update();
+}
+
+static void sim_tasks_init(void) {
+   if(timeouts.fire) return;
+   timeouts.fire = timeouts_fire;
+   sim_source_add(&timeouts);
+   socket_poll.fire = socket_poll_fire;
+   sim_source_add(&socket_poll);
+}
+
+// hands the CPU back to the simulation until the scheduler picks this task again
+static void task_yield(struct sim_task_S *task) {
+   pthread_mutex_lock(&lock);
+   current = NULL;
+   pthread_cond_signal(&sim_cond);
+   while(current != task) pthread_cond_wait(&task->cond, &lock);
+   pthread_mutex_unlock(&lock);
+}
+
+static void *task_entry(void *arg) {
+   struct sim_task_S *task = arg;
+
+   pthread_mutex_lock(&lock);
+   while(current != task) pthread_cond_wait(&task->cond, &lock);
+   pthread_mutex_unlock(&lock);
+
+   task->fn(task->arg);
+
+   // returning from a task function is an error on target, treat it as deleting itself
+   vTaskDelete(NULL);
+   return NULL;
+}
+
+static uint64_t tick_deadline(TickType_t ticks) {
+   if(ticks == portMAX_DELAY) return SIM_NEVER;
+   uint64_t next_tick = (sim_now() / SIM_TICK_NS + 1) * SIM_TICK_NS;
+   return next_tick + (uint64_t) (ticks - 1) * SIM_TICK_NS;
+}
+
+// blocks the calling task on obj, false when the timeout ran out first
+static bool task_wait(const void *obj, uint64_t wake_at) {
+   struct sim_task_S *task = current;
+   if(!task) return false;
+
+   task->wait_obj = obj;
+   task->wake_at = wake_at;
+   task->woken = false;
+   timeouts_update();
+
+   task_yield(task);
+   return task->woken;
+}
+
+static void task_wake(const void *obj) {
+   for(struct sim_task_S *task = tasks; task; task = task->link) {
+      if(task->wait_obj == obj) {
+         task->wait_obj = NULL;
+         task->woken = true;
+         task->ready = true;
+      }
+   }
+   timeouts_update();
+}
+
+// runs ready tasks until all of them block, called by the clock after each event
+void sim_tasks_run(void) {
+   for(;;) {
+      struct sim_task_S *next = NULL;
+      for(struct sim_task_S *task = tasks; task; task = task->link) {
+         if(task->ready && !task->deleted && (!next || task->priority > next->priority))
+            next = task;
+      }
+      if(!next) return;
+
+      next->ready = false;
+      pthread_mutex_lock(&lock);
+      current = next;
+      pthread_cond_signal(&next->cond);
+      while(current) pthread_cond_wait(&sim_cond, &lock);
+      pthread_mutex_unlock(&lock);
+   }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id) {
+   sim_tasks_init();
+
+   struct sim_task_S *task = calloc(1, sizeof(*task));
+   if(!task) return pdFAIL;
+   task->fn = fn;
+   task->arg = arg;
+   task->name = name;
+   task->priority = priority;
+   task->wake_at = SIM_NEVER;
+   task->ready = true;
+   pthread_cond_init(&task->cond, NULL);
+
+   struct sim_task_S **tail = &tasks;
+   while(*tail) tail = &(*tail)->link;
+   *tail = task;
+
+   if(pthread_create(&task->thread, NULL, task_entry, task) != 0) return pdFAIL;
+   pthread_detach(task->thread);
+
+   if(created_task) *created_task = task;
+   return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created_task) {
+   return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, created_task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+   if(!task) task = current;
+   if(!task) return;
+
+   task->deleted = true;
+   task->wait_obj = NULL;
+   timeouts_update();
+
+   if(task == current) {
+      pthread_mutex_lock(&lock);
+      current = NULL;
+      pthread_cond_signal(&sim_cond);
+      pthread_mutex_unlock(&lock);
+      pthread_exit(NULL);
+   }
+}
+
+void vTaskDelay(TickType_t ticks) {
+   if(ticks == 0) return;
+   task_wait(&delay_obj, tick_deadline(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+   return sim_now() / SIM_TICK_NS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+   return current;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+   if(!task) return pdFAIL;
+   task->notify++;
+   task_wake(task);
+   return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken) {
+   xTaskNotifyGive(task);
+   if(higher_priority_task_woken) *higher_priority_task_woken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+   struct sim_task_S *task = current;
+   if(!task) return 0;
+
+   if(task->notify == 0 && ticks_to_wait > 0)
+      task_wait(task, tick_deadline(ticks_to_wait));
+
+   uint32_t value = task->notify;
+   if(value) task->notify = clear_on_exit ? 0 : value - 1;
+   return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+   struct QueueDefinition *queue = calloc(1, sizeof(*queue));
+   if(!queue) return NULL;
+   queue->data = calloc(length, item_size);
+   if(!queue->data) {
+      free(queue);
+      return NULL;
+   }
+   queue->length = length;
+   queue->item_size = item_size;
+   return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+   if(!queue) return;
+   free(queue->data);
+   free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+   uint64_t deadline = tick_deadline(ticks_to_wait);
+   while(queue->count == queue->length) {
+      // receivers wake on the queue address, senders one byte above it
+      if(ticks_to_wait == 0 || !task_wait((uint8_t*) queue + 1, deadline)) return pdFAIL;
+   }
+
+   UBaseType_t tail = (queue->head + queue->count++) % queue->length;
+   memcpy(queue->data + tail * queue->item_size, item, queue->item_size);
+   task_wake(queue);
+   return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken) {
+   BaseType_t sent = xQueueSend(queue, item, 0);
+   if(higher_priority_task_woken) *higher_priority_task_woken = pdTRUE;
+   return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+   uint64_t deadline = tick_deadline(ticks_to_wait);
+   while(queue->count == 0) {
+      if(ticks_to_wait == 0 || !task_wait(queue, deadline)) return pdFAIL;
+   }
+
+   memcpy(item, queue->data + queue->head * queue->item_size, queue->item_size);
+   queue->head = (queue->head + 1) % queue->length;
+   queue->count--;
+   task_wake((uint8_t*) queue + 1);
+   return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+   return queue->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+   queue->head = 0;
+   queue->count = 0;
+   task_wake((uint8_t*) queue + 1);
+   return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+   return calloc(1, sizeof(struct sim_mutex_S));
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t mutex) {
+   free(mutex);
+}
+
+// outside of a task the simulation itself takes the mutex, it can only find it taken by a blocked task
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks_to_wait) {
+   uint64_t deadline = tick_deadline(ticks_to_wait);
+   while(mutex->taken) {
+      if(ticks_to_wait == 0 || !task_wait(mutex, deadline)) return pdFAIL;
+   }
+   mutex->taken = true;
+   mutex->holder = current;
+   return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+   if(!mutex->taken || mutex->holder != current) return pdFAIL;
+   mutex->taken = false;
+   mutex->holder = NULL;
+   task_wake(mutex);
+   return pdPASS;
+}
+
+// lwIP select on the host sockets, waiting in simulated time
+int sim_select(int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds, struct timeval *timeout) {
+   struct sim_task_S *task = current;
+   uint64_t deadline = timeout ? sim_now() + timeout->tv_sec * 1000000000ULL + timeout->tv_usec * 1000ULL : SIM_NEVER;
+   fd_set none;
+   FD_ZERO(&none);
+
+   for(;;) {
+      fd_set r = rfds ? *rfds : none, w = wfds ? *wfds : none, e = efds ? *efds : none;
+      struct timeval zero = {0};
+      int ready = select(nfds, &r, &w, &e, &zero);
+      if(ready != 0 || !task || sim_now() >= deadline) {
+         if(rfds) *rfds = r;
+         if(wfds) *wfds = w;
+         if(efds) *efds = e;
+         return ready;
+      }
+
+      task->nfds = nfds;
+      task->rfds = rfds ? *rfds : none;
+      task->wfds = wfds ? *wfds : none;
+      task->efds = efds ? *efds : none;
+      if(socket_poll.next == SIM_NEVER) socket_poll.next = sim_now() + SIM_SOCKET_POLL_NS;
+      task_wait(&socket_poll, deadline);
+   }
+}
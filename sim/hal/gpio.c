@@ -0,0 +1,90 @@
+#include "sim.h"
+#include <driver/gpio.h>
+
+#define SIM_GPIO_WATCHERS 4
+
+typedef struct {
+   gpio_mode_t mode;
+   uint32_t level;
+   uint32_t edges;
+   struct {
+      sim_gpio_edge_cb_t cb;
+      void *ctx;
+   } watchers[SIM_GPIO_WATCHERS];
+} sim_gpio_S;
+
+static sim_gpio_S pins[GPIO_NUM_MAX];
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+   for(int pin = 0; pin < GPIO_NUM_MAX; pin++) {
+      if(config->pin_bit_mask >> pin & 1) {
+         esp_err_t err = gpio_set_direction(pin, config->mode);
+         if(err != ESP_OK) return err;
+      }
+   }
+   return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+   if(gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+   // GPIO34-39 are input only
+   if(gpio_num >= GPIO_NUM_34 && (mode & GPIO_MODE_OUTPUT)) return ESP_ERR_INVALID_ARG;
+
+   // inputs read high until the board says otherwise, nFAULT lines are pulled up
+   if(mode == GPIO_MODE_INPUT && pins[gpio_num].mode == GPIO_MODE_DISABLE)
+      pins[gpio_num].level = 1;
+
+   pins[gpio_num].mode = mode;
+   return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+   if(gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+   sim_gpio_S *pin = &pins[gpio_num];
+
+   level = !!level;
+   bool rising = level && !pin->level;
+   pin->level = level;
+
+   if(rising) {
+      pin->edges++;
+      for(int i = 0; i < SIM_GPIO_WATCHERS; i++) {
+         if(pin->watchers[i].cb) pin->watchers[i].cb(gpio_num, pin->watchers[i].ctx);
+      }
+   }
+   return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+   if(gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) return 0;
+   return pins[gpio_num].level;
+}
+
+void sim_gpio_set_input(gpio_num_t gpio_num, uint32_t level) {
+   if(gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) return;
+   pins[gpio_num].level = !!level;
+}
+
+void sim_gpio_watch(gpio_num_t gpio_num, sim_gpio_edge_cb_t cb, void *ctx) {
+   if(gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) return;
+   for(int i = 0; i < SIM_GPIO_WATCHERS; i++) {
+      if(!pins[gpio_num].watchers[i].cb) {
+         pins[gpio_num].watchers[i].cb = cb;
+         pins[gpio_num].watchers[i].ctx = ctx;
+         return;
+      }
+   }
+}
+
+void sim_gpio_unwatch(gpio_num_t gpio_num, sim_gpio_edge_cb_t cb, void *ctx) {
+   if(gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) return;
+   for(int i = 0; i < SIM_GPIO_WATCHERS; i++) {
+      if(pins[gpio_num].watchers[i].cb == cb && pins[gpio_num].watchers[i].ctx == ctx)
+         pins[gpio_num].watchers[i].cb = NULL;
+   }
+}
+
+uint32_t sim_gpio_edges(gpio_num_t gpio_num) {
+   if(gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) return 0;
+   return pins[gpio_num].edges;
+}
@@ -0,0 +1,51 @@
+#include "sim.h"
+#include <esp_log.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#define SIM_LOG_TAGS 16
+
+typedef struct {
+   const char *tag;
+   esp_log_level_t level;
+} sim_log_tag_S;
+
+// matches CONFIG_LOG_DEFAULT_LEVEL in sdkconfig.esp32
+static esp_log_level_t default_level = ESP_LOG_NONE;
+static sim_log_tag_S tags[SIM_LOG_TAGS];
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+   if(strcmp(tag, "*") == 0) {
+      default_level = level;
+      for(int i = 0; i < SIM_LOG_TAGS; i++) tags[i].tag = NULL;
+      return;
+   }
+
+   for(int i = 0; i < SIM_LOG_TAGS; i++) {
+      if(!tags[i].tag || strcmp(tags[i].tag, tag) == 0) {
+         tags[i].tag = tag;
+         tags[i].level = level;
+         return;
+      }
+   }
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+   for(int i = 0; i < SIM_LOG_TAGS && tags[i].tag; i++) {
+      if(strcmp(tags[i].tag, tag) == 0) return tags[i].level;
+   }
+   return default_level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+   if(level > esp_log_level_get(tag)) return;
+
+   static const char letters[] = "NEWIDV";
+   fprintf(stderr, "%c (%llu) %s: ", letters[level], (unsigned long long) (sim_now() / 1000000), tag);
+
+   va_list args;
+   va_start(args, format);
+   vfprintf(stderr, format, args);
+   va_end(args);
+   fputc('\n', stderr);
+}
@@ -0,0 +1,452 @@
+// MCPWM up-counting timers driven by the simulated clock
+//
+// Each timer period runs TEZ at tick 0, compare events at their compare
+// value and TEP at period - 1, with generator actions and ISR callbacks fired
+// at those points just as the peripheral does. The prescalers of the groups
+// run on their own, a timer starts counting on the next tick of its group. A
+// GPIO sync source loads the phase into the counter of every running timer set
+// to it on a rising edge of its pin and restarts their prescalers, the events
+// at the value loaded do not fire.
+#include "sim.h"
+#include <driver/mcpwm_prelude.h>
+#include <hal/mcpwm_ll.h>
+#include <esp_log.h>
+
+#define SIM_MCPWM_GROUPS 2
+#define SIM_MCPWM_TIMERS_PER_GROUP 3
+#define SIM_MCPWM_OPERS_PER_GROUP 3
+#define SIM_MCPWM_CMPRS_PER_OPER 2
+#define SIM_MCPWM_GENS_PER_OPER 2
+#define SIM_MCPWM_SYNCS_PER_GROUP 3
+#define SIM_MCPWM_MAX_COUNT 0x10000 // 16 bit counter
+
+struct mcpwm_timer_t {
+   sim_source_S source; // must be first
+   int group_id;
+   uint64_t tick_ns;
+   uint32_t period;
+   uint32_t shadow_period;
+   bool update_on_empty;
+
+   bool enabled;
+   bool running;
+   mcpwm_timer_start_stop_cmd_t stop; // pending stop, START_NO_STOP if none
+   uint64_t start;  // ns of tick 0 in the current period
+   uint32_t tick;   // count value at source.next
+   uint64_t offset; // ns the prescaler ticks are into each tick_ns
+
+   mcpwm_timer_event_callbacks_t cbs;
+   void *user_ctx;
+
+   struct mcpwm_sync_t *sync; // source that loads sync_phase, NULL for none
+   uint32_t sync_phase;
+   uint32_t syncs;            // sync events taken, tells a firing timer a callback moved it
+
+   struct mcpwm_oper_t *opers[SIM_MCPWM_OPERS_PER_GROUP];
+   int num_opers;
+};
+
+struct mcpwm_oper_t {
+   int group_id;
+   struct mcpwm_timer_t *timer;
+   struct mcpwm_cmpr_t *cmprs[SIM_MCPWM_CMPRS_PER_OPER];
+   struct mcpwm_gen_t *gens[SIM_MCPWM_GENS_PER_OPER];
+   int num_cmprs;
+   int num_gens;
+};
+
+struct mcpwm_cmpr_t {
+   struct mcpwm_oper_t *oper;
+   uint32_t value;
+   mcpwm_comparator_event_callbacks_t cbs;
+   void *user_ctx;
+};
+
+struct mcpwm_gen_t {
+   struct mcpwm_oper_t *oper;
+   int gpio;
+   int force; // level held by mcpwm_generator_set_force_level, -1 while the actions drive the pin
+   mcpwm_generator_action_t on_empty;
+   mcpwm_generator_action_t on_full;
+   struct {
+      struct mcpwm_cmpr_t *cmpr;
+      mcpwm_generator_action_t action;
+   } on_compare[SIM_MCPWM_CMPRS_PER_OPER];
+};
+
+struct mcpwm_sync_t {
+   int group_id;
+   int gpio;
+};
+
+static struct mcpwm_timer_t timers[SIM_MCPWM_GROUPS][SIM_MCPWM_TIMERS_PER_GROUP];
+static struct mcpwm_oper_t opers[SIM_MCPWM_GROUPS][SIM_MCPWM_OPERS_PER_GROUP];
+static struct mcpwm_sync_t syncs[SIM_MCPWM_GROUPS][SIM_MCPWM_SYNCS_PER_GROUP];
+static int num_timers[SIM_MCPWM_GROUPS];
+static int num_opers[SIM_MCPWM_GROUPS];
+static int num_syncs[SIM_MCPWM_GROUPS];
+
+// timers, operators and generators are numbered within their group in the order they were made
+struct mcpwm_dev_t {
+   int group_id;
+};
+static struct mcpwm_dev_t devs[SIM_MCPWM_GROUPS] = {{0}, {1}};
+
+static void mcpwm_timer_fire(sim_source_S *source);
+
+static void mcpwm_gen_act(struct mcpwm_gen_t *gen, mcpwm_generator_action_t action) {
+   if(gen->force >= 0) return;
+
+   switch(action) {
+      case MCPWM_GEN_ACTION_LOW:
+         gpio_set_level(gen->gpio, 0);
+         break;
+      case MCPWM_GEN_ACTION_HIGH:
+         gpio_set_level(gen->gpio, 1);
+         break;
+      case MCPWM_GEN_ACTION_TOGGLE:
+         gpio_set_level(gen->gpio, !gpio_get_level(gen->gpio));
+         break;
+      default:
+         break;
+   }
+}
+
+static void mcpwm_timer_halt(struct mcpwm_timer_t *timer) {
+   timer->running = false;
+   timer->stop = MCPWM_TIMER_START_NO_STOP;
+   timer->source.next = SIM_NEVER;
+
+   if(timer->cbs.on_stop) {
+      mcpwm_timer_event_data_t edata = {.count_value = timer->tick, .direction = MCPWM_TIMER_DIRECTION_UP};
+      timer->cbs.on_stop(timer, &edata, timer->user_ctx);
+   }
+}
+
+esp_err_t mcpwm_new_timer(const mcpwm_timer_config_t *config, mcpwm_timer_handle_t *ret_timer) {
+   if(!config || !ret_timer) return ESP_ERR_INVALID_ARG;
+   if(config->group_id < 0 || config->group_id >= SIM_MCPWM_GROUPS) return ESP_ERR_INVALID_ARG;
+   if(config->count_mode != MCPWM_TIMER_COUNT_MODE_UP) return ESP_ERR_NOT_SUPPORTED;
+   if(config->resolution_hz == 0) return ESP_ERR_INVALID_ARG;
+   if(config->period_ticks == 0 || config->period_ticks > SIM_MCPWM_MAX_COUNT) return ESP_ERR_INVALID_ARG;
+   if(num_timers[config->group_id] >= SIM_MCPWM_TIMERS_PER_GROUP) return ESP_ERR_NOT_FOUND;
+
+   struct mcpwm_timer_t *timer = &timers[config->group_id][num_timers[config->group_id]++];
+   timer->group_id = config->group_id;
+   timer->tick_ns = 1000000000ULL / config->resolution_hz;
+   timer->period = config->period_ticks;
+   timer->shadow_period = config->period_ticks;
+   timer->update_on_empty = config->flags.update_period_on_empty;
+   timer->offset = config->group_id * timer->tick_ns / 2; // ticks of group 1 half way between group 0's
+   timer->stop = MCPWM_TIMER_START_NO_STOP;
+   timer->source.next = SIM_NEVER;
+   timer->source.fire = mcpwm_timer_fire;
+   sim_source_add(&timer->source);
+
+   *ret_timer = timer;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_del_timer(mcpwm_timer_handle_t timer) {
+   if(!timer || timer->enabled) return ESP_ERR_INVALID_STATE;
+   timer->source.next = SIM_NEVER;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_timer_enable(mcpwm_timer_handle_t timer) {
+   if(!timer) return ESP_ERR_INVALID_ARG;
+   if(timer->enabled) return ESP_ERR_INVALID_STATE;
+   timer->enabled = true;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_timer_disable(mcpwm_timer_handle_t timer) {
+   if(!timer) return ESP_ERR_INVALID_ARG;
+   if(!timer->enabled) return ESP_ERR_INVALID_STATE;
+   timer->enabled = false;
+   timer->running = false;
+   timer->source.next = SIM_NEVER;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_timer_start_stop(mcpwm_timer_handle_t timer, mcpwm_timer_start_stop_cmd_t command) {
+   if(!timer) return ESP_ERR_INVALID_ARG;
+   if(!timer->enabled) return ESP_ERR_INVALID_STATE;
+
+   switch(command) {
+      case MCPWM_TIMER_STOP_EMPTY:
+      case MCPWM_TIMER_STOP_FULL:
+         if(timer->running) timer->stop = command;
+         break;
+
+      case MCPWM_TIMER_START_NO_STOP:
+      case MCPWM_TIMER_START_STOP_EMPTY:
+      case MCPWM_TIMER_START_STOP_FULL:
+         if(!timer->running) {
+            // counter was parked on zero or peak, next count is zero on the next prescaler tick
+            uint64_t now = sim_now();
+            timer->running = true;
+            timer->tick = 0;
+            timer->start = now + timer->tick_ns - (now + timer->tick_ns - timer->offset) % timer->tick_ns;
+            timer->source.next = timer->start;
+         }
+         timer->stop = command == MCPWM_TIMER_START_STOP_EMPTY ? MCPWM_TIMER_STOP_EMPTY
+                     : command == MCPWM_TIMER_START_STOP_FULL  ? MCPWM_TIMER_STOP_FULL
+                     : MCPWM_TIMER_START_NO_STOP;
+         break;
+   }
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_timer_set_period(mcpwm_timer_handle_t timer, uint32_t period_ticks) {
+   if(!timer) return ESP_ERR_INVALID_ARG;
+   if(period_ticks == 0 || period_ticks > SIM_MCPWM_MAX_COUNT) return ESP_ERR_INVALID_ARG;
+
+   timer->shadow_period = period_ticks;
+   if(!timer->update_on_empty) timer->period = period_ticks;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_timer_register_event_callbacks(mcpwm_timer_handle_t timer, const mcpwm_timer_event_callbacks_t *cbs, void *user_data) {
+   if(!timer || !cbs) return ESP_ERR_INVALID_ARG;
+   timer->cbs = *cbs;
+   timer->user_ctx = user_data;
+   return ESP_OK;
+}
+
+// the counter continues from tick, which it holds right now, to the next compare match or the peak
+static void mcpwm_timer_count_from(struct mcpwm_timer_t *timer, uint32_t tick) {
+   uint32_t next = timer->period - 1;
+   for(int o = 0; o < timer->num_opers; o++) {
+      for(int c = 0; c < timer->opers[o]->num_cmprs; c++) {
+         uint32_t value = timer->opers[o]->cmprs[c]->value;
+         if(value > tick && value < next) next = value;
+      }
+   }
+   timer->tick = next;
+   timer->source.next = timer->start + (uint64_t) next * timer->tick_ns;
+}
+
+static void mcpwm_sync_fire(gpio_num_t gpio, void *ctx) {
+   struct mcpwm_sync_t *sync = ctx;
+   for(int t = 0; t < num_timers[sync->group_id]; t++) {
+      struct mcpwm_timer_t *timer = &timers[sync->group_id][t];
+      if(timer->sync != sync || !timer->running) continue;
+
+      timer->syncs++;
+      timer->offset = sim_now() % timer->tick_ns;
+      if(timer->sync_phase >= timer->period - 1) {
+         // loaded with the peak, the next count wraps to zero
+         timer->tick = 0;
+         timer->start = sim_now() + timer->tick_ns;
+         timer->source.next = timer->start;
+      } else {
+         timer->start = sim_now() - (uint64_t) timer->sync_phase * timer->tick_ns;
+         mcpwm_timer_count_from(timer, timer->sync_phase);
+      }
+   }
+}
+
+// the pin is read through the GPIO matrix, io_loop_back lets the firmware drive it
+esp_err_t mcpwm_new_gpio_sync_src(const mcpwm_gpio_sync_src_config_t *config, mcpwm_sync_handle_t *ret_sync) {
+   if(!config || !ret_sync) return ESP_ERR_INVALID_ARG;
+   if(config->group_id < 0 || config->group_id >= SIM_MCPWM_GROUPS) return ESP_ERR_INVALID_ARG;
+   if(config->gpio_num < 0 || config->gpio_num >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+   if(config->flags.active_neg) return ESP_ERR_NOT_SUPPORTED;
+   if(num_syncs[config->group_id] >= SIM_MCPWM_SYNCS_PER_GROUP) return ESP_ERR_NOT_FOUND;
+
+   struct mcpwm_sync_t *sync = &syncs[config->group_id][num_syncs[config->group_id]++];
+   sync->group_id = config->group_id;
+   sync->gpio = config->gpio_num;
+   sim_gpio_watch(sync->gpio, mcpwm_sync_fire, sync);
+
+   *ret_sync = sync;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_del_sync_src(mcpwm_sync_handle_t sync) {
+   if(!sync) return ESP_ERR_INVALID_ARG;
+   sim_gpio_unwatch(sync->gpio, mcpwm_sync_fire, sync);
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_timer_set_phase_on_sync(mcpwm_timer_handle_t timer, const mcpwm_timer_sync_phase_config_t *config) {
+   if(!timer || !config) return ESP_ERR_INVALID_ARG;
+   if(config->direction != MCPWM_TIMER_DIRECTION_UP || config->count_value >= SIM_MCPWM_MAX_COUNT) return ESP_ERR_INVALID_ARG;
+   if(config->sync_src && config->sync_src->group_id != timer->group_id) return ESP_ERR_INVALID_ARG;
+   timer->sync = config->sync_src;
+   timer->sync_phase = config->count_value;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_new_operator(const mcpwm_operator_config_t *config, mcpwm_oper_handle_t *ret_oper) {
+   if(!config || !ret_oper) return ESP_ERR_INVALID_ARG;
+   if(config->group_id < 0 || config->group_id >= SIM_MCPWM_GROUPS) return ESP_ERR_INVALID_ARG;
+   if(num_opers[config->group_id] >= SIM_MCPWM_OPERS_PER_GROUP) return ESP_ERR_NOT_FOUND;
+
+   struct mcpwm_oper_t *oper = &opers[config->group_id][num_opers[config->group_id]++];
+   oper->group_id = config->group_id;
+   *ret_oper = oper;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_operator_connect_timer(mcpwm_oper_handle_t oper, mcpwm_timer_handle_t timer) {
+   if(!oper || !timer || oper->group_id != timer->group_id) return ESP_ERR_INVALID_ARG;
+   if(oper->timer) return ESP_ERR_INVALID_STATE;
+   oper->timer = timer;
+   timer->opers[timer->num_opers++] = oper;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_new_comparator(mcpwm_oper_handle_t oper, const mcpwm_comparator_config_t *config, mcpwm_cmpr_handle_t *ret_cmpr) {
+   if(!oper || !config || !ret_cmpr) return ESP_ERR_INVALID_ARG;
+   if(oper->num_cmprs >= SIM_MCPWM_CMPRS_PER_OPER) return ESP_ERR_NOT_FOUND;
+
+   struct mcpwm_cmpr_t *cmpr = calloc(1, sizeof(*cmpr));
+   if(!cmpr) return ESP_ERR_NO_MEM;
+   cmpr->oper = oper;
+   oper->cmprs[oper->num_cmprs++] = cmpr;
+   *ret_cmpr = cmpr;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_comparator_set_compare_value(mcpwm_cmpr_handle_t cmpr, uint32_t cmp_ticks) {
+   if(!cmpr) return ESP_ERR_INVALID_ARG;
+   cmpr->value = cmp_ticks;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_comparator_register_event_callbacks(mcpwm_cmpr_handle_t cmpr, const mcpwm_comparator_event_callbacks_t *cbs, void *user_data) {
+   if(!cmpr || !cbs) return ESP_ERR_INVALID_ARG;
+   cmpr->cbs = *cbs;
+   cmpr->user_ctx = user_data;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_new_generator(mcpwm_oper_handle_t oper, const mcpwm_generator_config_t *config, mcpwm_gen_handle_t *ret_gen) {
+   if(!oper || !config || !ret_gen) return ESP_ERR_INVALID_ARG;
+   if(oper->num_gens >= SIM_MCPWM_GENS_PER_OPER) return ESP_ERR_NOT_FOUND;
+
+   struct mcpwm_gen_t *gen = calloc(1, sizeof(*gen));
+   if(!gen) return ESP_ERR_NO_MEM;
+   gen->oper = oper;
+   gen->gpio = config->gen_gpio_num;
+   gen->force = -1;
+   oper->gens[oper->num_gens++] = gen;
+   *ret_gen = gen;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_generator_set_action_on_timer_event(mcpwm_gen_handle_t gen, mcpwm_gen_timer_event_action_t ev_act) {
+   if(!gen || ev_act.direction != MCPWM_TIMER_DIRECTION_UP) return ESP_ERR_INVALID_ARG;
+   if(ev_act.event == MCPWM_TIMER_EVENT_EMPTY) gen->on_empty = ev_act.action;
+   else if(ev_act.event == MCPWM_TIMER_EVENT_FULL) gen->on_full = ev_act.action;
+   else return ESP_ERR_INVALID_ARG;
+   return ESP_OK;
+}
+
+esp_err_t mcpwm_generator_set_action_on_compare_event(mcpwm_gen_handle_t gen, mcpwm_gen_compare_event_action_t ev_act) {
+   if(!gen || !ev_act.comparator || ev_act.direction != MCPWM_TIMER_DIRECTION_UP) return ESP_ERR_INVALID_ARG;
+   for(int i = 0; i < SIM_MCPWM_CMPRS_PER_OPER; i++) {
+      if(!gen->on_compare[i].cmpr || gen->on_compare[i].cmpr == ev_act.comparator) {
+         gen->on_compare[i].cmpr = ev_act.comparator;
+         gen->on_compare[i].action = ev_act.action;
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_NOT_FOUND;
+}
+
+// only the continuous force, level -1 hands the pin back to the actions, which leave it as it is until the next one
+esp_err_t mcpwm_generator_set_force_level(mcpwm_gen_handle_t gen, int level, bool hold_on) {
+   if(!gen || level < -1 || level > 1) return ESP_ERR_INVALID_ARG;
+   if(!hold_on) return ESP_ERR_NOT_SUPPORTED;
+   gen->force = level;
+   if(level >= 0) gpio_set_level(gen->gpio, level);
+   return ESP_OK;
+}
+
+static void mcpwm_timer_fire(sim_source_S *source) {
+   struct mcpwm_timer_t *timer = (struct mcpwm_timer_t*) source;
+   uint32_t tick = timer->tick;
+   uint32_t syncs = timer->syncs;
+
+   if(tick == 0) { // TEZ
+      if(timer->stop == MCPWM_TIMER_STOP_EMPTY) {
+         mcpwm_timer_halt(timer);
+         return;
+      }
+
+      timer->period = timer->shadow_period;
+
+      for(int o = 0; o < timer->num_opers; o++) {
+         for(int g = 0; g < timer->opers[o]->num_gens; g++)
+            mcpwm_gen_act(timer->opers[o]->gens[g], timer->opers[o]->gens[g]->on_empty);
+      }
+
+      if(timer->cbs.on_empty) {
+         mcpwm_timer_event_data_t edata = {.count_value = 0, .direction = MCPWM_TIMER_DIRECTION_UP};
+         timer->cbs.on_empty(timer, &edata, timer->user_ctx);
+      }
+   }
+
+   for(int o = 0; o < timer->num_opers; o++) {
+      struct mcpwm_oper_t *oper = timer->opers[o];
+      for(int c = 0; c < oper->num_cmprs; c++) {
+         struct mcpwm_cmpr_t *cmpr = oper->cmprs[c];
+         if(cmpr->value != tick) continue;
+
+         for(int g = 0; g < oper->num_gens; g++) {
+            for(int i = 0; i < SIM_MCPWM_CMPRS_PER_OPER; i++) {
+               if(oper->gens[g]->on_compare[i].cmpr == cmpr)
+                  mcpwm_gen_act(oper->gens[g], oper->gens[g]->on_compare[i].action);
+            }
+         }
+
+         if(cmpr->cbs.on_reach) {
+            mcpwm_compare_event_data_t edata = {.compare_ticks = tick, .direction = MCPWM_TIMER_DIRECTION_UP};
+            cmpr->cbs.on_reach(cmpr, &edata, cmpr->user_ctx);
+         }
+      }
+   }
+
+   if(!timer->running) return; // disabled from a callback
+   if(timer->syncs != syncs) return; // synced from a callback, already counting from the phase
+
+   uint32_t peak = timer->period - 1;
+   if(tick >= peak) { // TEP
+      for(int o = 0; o < timer->num_opers; o++) {
+         for(int g = 0; g < timer->opers[o]->num_gens; g++)
+            mcpwm_gen_act(timer->opers[o]->gens[g], timer->opers[o]->gens[g]->on_full);
+      }
+
+      if(timer->cbs.on_full) {
+         mcpwm_timer_event_data_t edata = {.count_value = tick, .direction = MCPWM_TIMER_DIRECTION_UP};
+         timer->cbs.on_full(timer, &edata, timer->user_ctx);
+      }
+
+      if(timer->stop == MCPWM_TIMER_STOP_FULL) {
+         mcpwm_timer_halt(timer);
+         return;
+      }
+
+      timer->start += (uint64_t) (tick + 1) * timer->tick_ns;
+      timer->tick = 0;
+      timer->source.next = timer->start;
+      return;
+   }
+
+   mcpwm_timer_count_from(timer, tick);
+}
+
+mcpwm_dev_t *sim_mcpwm_ll_get_hw(int group_id) {
+   return &devs[group_id];
+}
+
+void mcpwm_ll_timer_set_start_stop_command(mcpwm_dev_t *mcpwm, int timer_id, mcpwm_timer_start_stop_cmd_t cmd) {
+   mcpwm_timer_start_stop(&timers[mcpwm->group_id][timer_id], cmd);
+}
+
+void mcpwm_ll_gen_disable_continue_force_action(mcpwm_dev_t *mcpwm, int operator_id, int generator_id) {
+   opers[mcpwm->group_id][operator_id].gens[generator_id]->force = -1;
+}
@@ -0,0 +1,96 @@
+// in-memory NVS, contents are lost when the simulation exits
+#include <nvs_flash.h>
+#include <string.h>
+
+#define SIM_NVS_NAMESPACES 8
+#define SIM_NVS_ENTRIES 32
+#define SIM_NVS_KEY_LEN 16
+#define SIM_NVS_BLOB_LEN 512
+
+typedef struct {
+   nvs_handle_t handle;
+   char key[SIM_NVS_KEY_LEN];
+   uint8_t blob[SIM_NVS_BLOB_LEN];
+   size_t len;
+} sim_nvs_entry_S;
+
+static char namespaces[SIM_NVS_NAMESPACES][SIM_NVS_KEY_LEN];
+static sim_nvs_entry_S entries[SIM_NVS_ENTRIES];
+static bool initialized = false;
+
+static sim_nvs_entry_S *nvs_find(nvs_handle_t handle, const char *key) {
+   for(int i = 0; i < SIM_NVS_ENTRIES; i++) {
+      if(entries[i].handle == handle && strncmp(entries[i].key, key, SIM_NVS_KEY_LEN) == 0)
+         return &entries[i];
+   }
+   return NULL;
+}
+
+esp_err_t nvs_flash_init(void) {
+   initialized = true;
+   return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+   memset(entries, 0, sizeof(entries));
+   return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+   if(!initialized) return ESP_ERR_INVALID_STATE;
+   if(!namespace_name || !out_handle || strlen(namespace_name) >= SIM_NVS_KEY_LEN) return ESP_ERR_INVALID_ARG;
+
+   for(int i = 0; i < SIM_NVS_NAMESPACES; i++) {
+      if(!namespaces[i][0]) strcpy(namespaces[i], namespace_name);
+      if(strcmp(namespaces[i], namespace_name) == 0) {
+         *out_handle = i + 1;
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+   sim_nvs_entry_S *entry = nvs_find(handle, key);
+   if(!entry) return ESP_ERR_NVS_NOT_FOUND;
+
+   if(!out_value) {
+      *length = entry->len;
+      return ESP_OK;
+   }
+   if(*length < entry->len) {
+      *length = entry->len;
+      return ESP_ERR_INVALID_SIZE;
+   }
+   memcpy(out_value, entry->blob, entry->len);
+   *length = entry->len;
+   return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+   if(!key || strlen(key) >= SIM_NVS_KEY_LEN || length > SIM_NVS_BLOB_LEN) return ESP_ERR_INVALID_ARG;
+
+   sim_nvs_entry_S *entry = nvs_find(handle, key);
+   if(!entry) entry = nvs_find(0, "");
+   if(!entry) return ESP_ERR_NVS_NO_FREE_PAGES;
+
+   entry->handle = handle;
+   strcpy(entry->key, key);
+   memcpy(entry->blob, value, length);
+   entry->len = length;
+   return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+   for(int i = 0; i < SIM_NVS_ENTRIES; i++) {
+      if(entries[i].handle == handle) memset(&entries[i], 0, sizeof(entries[i]));
+   }
+   return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+   return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
@@ -0,0 +1,211 @@
+// PCNT units counting rising edges of simulated GPIOs
+//
+// Only rising edges are modelled, so the negative edge action is ignored.
+// Like the ESP32 peripheral the counter is back at 0 as soon as it reaches
+// a limit, and the watch point callbacks run a little later, standing in for
+// the interrupt latency. With accum_count the count read back includes the
+// wrap right away.
+#include "sim.h"
+#include <driver/pulse_cnt.h>
+
+#define SIM_PCNT_UNITS 8
+#define SIM_PCNT_CHANS_PER_UNIT 2
+#define SIM_PCNT_WATCH_POINTS 5 // limits, zero and two thresholds
+#define SIM_PCNT_EVENTS 8
+#define SIM_PCNT_ISR_LATENCY 2000 // ns from the edge to the watch point callback
+
+struct pcnt_unit_t {
+   sim_source_S source; // must be first
+   int low_limit;
+   int high_limit;
+   int count;
+   int accum; // limits wrapped at, with accum_count
+   bool accum_count;
+   bool enabled;
+   bool running;
+
+   int watch_points[SIM_PCNT_WATCH_POINTS];
+   int num_watch_points;
+   pcnt_event_callbacks_t cbs;
+   void *user_ctx;
+
+   // watch point events waiting for the ISR, oldest first
+   pcnt_watch_event_data_t events[SIM_PCNT_EVENTS];
+   uint64_t event_at[SIM_PCNT_EVENTS];
+   int event_head, num_events;
+
+   struct pcnt_chan_t *chans[SIM_PCNT_CHANS_PER_UNIT];
+   int num_chans;
+};
+
+struct pcnt_chan_t {
+   struct pcnt_unit_t *unit;
+   int edge_gpio;
+   int level_gpio;
+   pcnt_channel_edge_action_t pos_act;
+   pcnt_channel_edge_action_t neg_act;
+   pcnt_channel_level_action_t high_act;
+   pcnt_channel_level_action_t low_act;
+};
+
+static struct pcnt_unit_t units[SIM_PCNT_UNITS];
+static int num_units;
+
+static void pcnt_fire(sim_source_S *source) {
+   struct pcnt_unit_t *unit = (struct pcnt_unit_t*) source;
+   while(unit->num_events && unit->event_at[unit->event_head] <= sim_now()) {
+      pcnt_watch_event_data_t edata = unit->events[unit->event_head];
+      unit->event_head = (unit->event_head + 1) % SIM_PCNT_EVENTS;
+      unit->num_events--;
+      if(unit->cbs.on_reach) unit->cbs.on_reach(unit, &edata, unit->user_ctx);
+   }
+   unit->source.next = unit->num_events ? unit->event_at[unit->event_head] : SIM_NEVER;
+}
+
+static void pcnt_edge(gpio_num_t gpio_num, void *ctx) {
+   struct pcnt_chan_t *chan = ctx;
+   struct pcnt_unit_t *unit = chan->unit;
+   if(!unit->running) return;
+
+   int delta = 0;
+   if(chan->pos_act == PCNT_CHANNEL_EDGE_ACTION_INCREASE) delta = 1;
+   if(chan->pos_act == PCNT_CHANNEL_EDGE_ACTION_DECREASE) delta = -1;
+
+   if(chan->level_gpio >= 0) {
+      pcnt_channel_level_action_t act = gpio_get_level(chan->level_gpio) ? chan->high_act : chan->low_act;
+      if(act == PCNT_CHANNEL_LEVEL_ACTION_INVERSE) delta = -delta;
+      if(act == PCNT_CHANNEL_LEVEL_ACTION_HOLD) delta = 0;
+   }
+   if(!delta) return;
+
+   int value = unit->count += delta;
+   if(value >= unit->high_limit || value <= unit->low_limit) {
+      unit->count = 0;
+      if(unit->accum_count) unit->accum += value;
+   }
+
+   for(int i = 0; i < unit->num_watch_points; i++) {
+      if(unit->watch_points[i] == value && unit->num_events < SIM_PCNT_EVENTS) {
+         int tail = (unit->event_head + unit->num_events++) % SIM_PCNT_EVENTS;
+         unit->events[tail] = (pcnt_watch_event_data_t) {
+            .watch_point_value = value,
+            .zero_cross_mode   = delta > 0 ? PCNT_UNIT_ZERO_CROSS_NEG_POS : PCNT_UNIT_ZERO_CROSS_POS_NEG,
+         };
+         unit->event_at[tail] = sim_now() + SIM_PCNT_ISR_LATENCY;
+         if(unit->source.next == SIM_NEVER) unit->source.next = unit->event_at[tail];
+      }
+   }
+}
+
+esp_err_t pcnt_new_unit(const pcnt_unit_config_t *config, pcnt_unit_handle_t *ret_unit) {
+   if(!config || !ret_unit) return ESP_ERR_INVALID_ARG;
+   if(config->low_limit >= 0 || config->high_limit <= 0) return ESP_ERR_INVALID_ARG;
+   if(config->low_limit < -0x8000 || config->high_limit > 0x7FFF) return ESP_ERR_INVALID_ARG;
+   if(num_units >= SIM_PCNT_UNITS) return ESP_ERR_NOT_FOUND;
+
+   struct pcnt_unit_t *unit = &units[num_units++];
+   unit->low_limit = config->low_limit;
+   unit->high_limit = config->high_limit;
+   unit->accum_count = config->flags.accum_count;
+   unit->source.next = SIM_NEVER;
+   unit->source.fire = pcnt_fire;
+   sim_source_add(&unit->source);
+   *ret_unit = unit;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_enable(pcnt_unit_handle_t unit) {
+   if(!unit) return ESP_ERR_INVALID_ARG;
+   if(unit->enabled) return ESP_ERR_INVALID_STATE;
+   unit->enabled = true;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_start(pcnt_unit_handle_t unit) {
+   if(!unit) return ESP_ERR_INVALID_ARG;
+   if(!unit->enabled) return ESP_ERR_INVALID_STATE;
+   unit->running = true;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_stop(pcnt_unit_handle_t unit) {
+   if(!unit) return ESP_ERR_INVALID_ARG;
+   if(!unit->enabled) return ESP_ERR_INVALID_STATE;
+   unit->running = false;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_clear_count(pcnt_unit_handle_t unit) {
+   if(!unit) return ESP_ERR_INVALID_ARG;
+   unit->count = 0;
+   unit->accum = 0;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_get_count(pcnt_unit_handle_t unit, int *value) {
+   if(!unit || !value) return ESP_ERR_INVALID_ARG;
+   *value = unit->count + unit->accum;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_register_event_callbacks(pcnt_unit_handle_t unit, const pcnt_event_callbacks_t *cbs, void *user_data) {
+   if(!unit || !cbs) return ESP_ERR_INVALID_ARG;
+   if(unit->enabled) return ESP_ERR_INVALID_STATE; // only before pcnt_unit_enable, as in ESP-IDF
+   unit->cbs = *cbs;
+   unit->user_ctx = user_data;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_add_watch_point(pcnt_unit_handle_t unit, int watch_point) {
+   if(!unit) return ESP_ERR_INVALID_ARG;
+   if(watch_point < unit->low_limit || watch_point > unit->high_limit) return ESP_ERR_INVALID_ARG;
+   for(int i = 0; i < unit->num_watch_points; i++) {
+      if(unit->watch_points[i] == watch_point) return ESP_ERR_INVALID_STATE;
+   }
+   if(unit->num_watch_points >= SIM_PCNT_WATCH_POINTS) return ESP_ERR_NOT_FOUND;
+   unit->watch_points[unit->num_watch_points++] = watch_point;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_unit_remove_watch_point(pcnt_unit_handle_t unit, int watch_point) {
+   if(!unit) return ESP_ERR_INVALID_ARG;
+   for(int i = 0; i < unit->num_watch_points; i++) {
+      if(unit->watch_points[i] == watch_point) {
+         unit->watch_points[i] = unit->watch_points[--unit->num_watch_points];
+         return ESP_OK;
+      }
+   }
+   return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t pcnt_new_channel(pcnt_unit_handle_t unit, const pcnt_chan_config_t *config, pcnt_channel_handle_t *ret_chan) {
+   if(!unit || !config || !ret_chan) return ESP_ERR_INVALID_ARG;
+   if(unit->num_chans >= SIM_PCNT_CHANS_PER_UNIT) return ESP_ERR_NOT_FOUND;
+
+   struct pcnt_chan_t *chan = calloc(1, sizeof(*chan));
+   if(!chan) return ESP_ERR_NO_MEM;
+   chan->unit = unit;
+   chan->edge_gpio = config->edge_gpio_num;
+   chan->level_gpio = config->level_gpio_num;
+   unit->chans[unit->num_chans++] = chan;
+
+   if(chan->edge_gpio >= 0)
+      sim_gpio_watch(chan->edge_gpio, pcnt_edge, chan);
+
+   *ret_chan = chan;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_channel_set_edge_action(pcnt_channel_handle_t chan, pcnt_channel_edge_action_t pos_act, pcnt_channel_edge_action_t neg_act) {
+   if(!chan) return ESP_ERR_INVALID_ARG;
+   chan->pos_act = pos_act;
+   chan->neg_act = neg_act;
+   return ESP_OK;
+}
+
+esp_err_t pcnt_channel_set_level_action(pcnt_channel_handle_t chan, pcnt_channel_level_action_t high_act, pcnt_channel_level_action_t low_act) {
+   if(!chan) return ESP_ERR_INVALID_ARG;
+   chan->high_act = high_act;
+   chan->low_act = low_act;
+   return ESP_OK;
+}
@@ -0,0 +1,224 @@
+// RMT transmit channels driven by the simulated clock
+//
+// The channel memory is a ring of mem_block_symbols words. Like the driver's
+// ping-pong refill, the encoder is asked for more whenever half of it has been
+// sent, and each half of a symbol drives the GPIO for its duration. The
+// transmission ends on a zero duration or when the memory runs dry after the
+// encoder reported completion, which fires on_trans_done. Loops and DMA are
+// not modelled.
+#include "sim.h"
+#include <driver/rmt_tx.h>
+#include <stdlib.h>
+
+#define SIM_RMT_CHANNELS 8
+#define SIM_RMT_MAX_SYMBOLS 512
+
+struct rmt_channel_t {
+   sim_source_S source; // must be first
+   int gpio;
+   uint64_t tick_ns;
+   size_t mem_symbols;
+   bool enabled;
+
+   rmt_symbol_word_t mem[SIM_RMT_MAX_SYMBOLS];
+   size_t mem_head;  // symbol being sent
+   size_t mem_count;
+   bool second_half; // the next edge starts level1 of mem[mem_head]
+
+   bool busy;
+   bool encoding_done;
+   size_t sent;
+   rmt_encoder_handle_t encoder;
+   const void *payload;
+   size_t payload_bytes;
+
+   rmt_tx_event_callbacks_t cbs;
+   void *user_ctx;
+};
+
+typedef struct {
+   rmt_encoder_t base; // must be first
+   size_t index;       // next symbol to copy
+} sim_copy_encoder_S;
+
+static struct rmt_channel_t channels[SIM_RMT_CHANNELS];
+static int num_channels;
+
+static void rmt_channel_fire(sim_source_S *source);
+
+static bool rmt_mem_push(struct rmt_channel_t *channel, rmt_symbol_word_t symbol) {
+   if(channel->mem_count == channel->mem_symbols) return false;
+   channel->mem[(channel->mem_head + channel->mem_count++) % channel->mem_symbols] = symbol;
+   return true;
+}
+
+// what the driver's threshold interrupt does, the encoder may fill the memory up
+static void rmt_channel_refill(struct rmt_channel_t *channel) {
+   if(channel->encoding_done || channel->mem_count > channel->mem_symbols / 2) return;
+
+   rmt_encode_state_t state = RMT_ENCODING_RESET;
+   channel->encoder->encode(channel->encoder, channel, channel->payload, channel->payload_bytes, &state);
+   if(state & RMT_ENCODING_COMPLETE) {
+      channel->encoding_done = true;
+      rmt_mem_push(channel, (rmt_symbol_word_t) {0}); // end marker if there is room
+   }
+}
+
+static void rmt_channel_halt(struct rmt_channel_t *channel) {
+   channel->busy = false;
+   channel->mem_count = 0;
+   channel->source.next = SIM_NEVER;
+   gpio_set_level(channel->gpio, 0);
+}
+
+static void rmt_channel_fire(sim_source_S *source) {
+   struct rmt_channel_t *channel = (struct rmt_channel_t*) source;
+
+   uint32_t duration = 0, level = 0;
+   if(channel->mem_count) {
+      rmt_symbol_word_t *symbol = &channel->mem[channel->mem_head];
+      duration = channel->second_half ? symbol->duration1 : symbol->duration0;
+      level = channel->second_half ? symbol->level1 : symbol->level0;
+   }
+
+   if(!duration) {
+      rmt_channel_halt(channel);
+      if(channel->cbs.on_trans_done) {
+         rmt_tx_done_event_data_t edata = {.num_symbols = channel->sent};
+         channel->cbs.on_trans_done(channel, &edata, channel->user_ctx);
+      }
+      return;
+   }
+
+   gpio_set_level(channel->gpio, level);
+   source->next = sim_now() + duration * channel->tick_ns;
+
+   if(channel->second_half) {
+      channel->mem_head = (channel->mem_head + 1) % channel->mem_symbols;
+      channel->mem_count--;
+      channel->sent++;
+      rmt_channel_refill(channel);
+   }
+   channel->second_half = !channel->second_half;
+}
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan) {
+   if(!config || !ret_chan || config->resolution_hz == 0) return ESP_ERR_INVALID_ARG;
+   if(config->mem_block_symbols < 2 || config->mem_block_symbols > SIM_RMT_MAX_SYMBOLS) return ESP_ERR_INVALID_ARG;
+   if(num_channels >= SIM_RMT_CHANNELS) return ESP_ERR_NOT_FOUND;
+
+   struct rmt_channel_t *channel = &channels[num_channels++];
+   channel->gpio = config->gpio_num;
+   channel->tick_ns = 1000000000ULL / config->resolution_hz;
+   channel->mem_symbols = config->mem_block_symbols;
+   channel->source.next = SIM_NEVER;
+   channel->source.fire = rmt_channel_fire;
+   sim_source_add(&channel->source);
+
+   *ret_chan = channel;
+   return ESP_OK;
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel) {
+   if(!channel || channel->enabled) return ESP_ERR_INVALID_STATE;
+   channel->source.next = SIM_NEVER;
+   return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+   if(!channel) return ESP_ERR_INVALID_ARG;
+   if(channel->enabled) return ESP_ERR_INVALID_STATE;
+   channel->enabled = true;
+   return ESP_OK;
+}
+
+// aborts a transmission in flight without calling on_trans_done
+esp_err_t rmt_disable(rmt_channel_handle_t channel) {
+   if(!channel) return ESP_ERR_INVALID_ARG;
+   if(!channel->enabled) return ESP_ERR_INVALID_STATE;
+   channel->enabled = false;
+   rmt_channel_halt(channel);
+   return ESP_OK;
+}
+
+// no transaction queue, a channel takes a new transmission once the previous one is done
+esp_err_t rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes,
+                       const rmt_transmit_config_t *config) {
+   if(!channel || !encoder || !payload || !payload_bytes || !config) return ESP_ERR_INVALID_ARG;
+   if(config->loop_count) return ESP_ERR_NOT_SUPPORTED;
+   if(!channel->enabled || channel->busy) return ESP_ERR_INVALID_STATE;
+
+   channel->encoder = encoder;
+   channel->payload = payload;
+   channel->payload_bytes = payload_bytes;
+   channel->busy = true;
+   channel->encoding_done = false;
+   channel->mem_head = 0;
+   channel->mem_count = 0;
+   channel->second_half = false;
+   channel->sent = 0;
+
+   rmt_channel_refill(channel);
+   channel->source.next = sim_now();
+   return ESP_OK;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t channel, const rmt_tx_event_callbacks_t *cbs, void *user_data) {
+   if(!channel || !cbs) return ESP_ERR_INVALID_ARG;
+   channel->cbs = *cbs;
+   channel->user_ctx = user_data;
+   return ESP_OK;
+}
+
+static size_t rmt_copy_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *data, size_t size, rmt_encode_state_t *ret_state) {
+   sim_copy_encoder_S *copy = (sim_copy_encoder_S*) encoder;
+   const rmt_symbol_word_t *symbols = data;
+   size_t count = size / sizeof(rmt_symbol_word_t);
+   size_t encoded = 0;
+
+   *ret_state = RMT_ENCODING_RESET;
+   while(copy->index < count) {
+      if(!rmt_mem_push(channel, symbols[copy->index])) {
+         *ret_state = RMT_ENCODING_MEM_FULL;
+         return encoded;
+      }
+      copy->index++;
+      encoded++;
+   }
+
+   *ret_state = RMT_ENCODING_COMPLETE;
+   if(channel->mem_count == channel->mem_symbols) *ret_state |= RMT_ENCODING_MEM_FULL;
+   return encoded;
+}
+
+static esp_err_t rmt_copy_reset(rmt_encoder_t *encoder) {
+   ((sim_copy_encoder_S*) encoder)->index = 0;
+   return ESP_OK;
+}
+
+static esp_err_t rmt_copy_del(rmt_encoder_t *encoder) {
+   free(encoder);
+   return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder) {
+   if(!config || !ret_encoder) return ESP_ERR_INVALID_ARG;
+   sim_copy_encoder_S *copy = calloc(1, sizeof(*copy));
+   if(!copy) return ESP_ERR_NO_MEM;
+
+   copy->base.encode = rmt_copy_encode;
+   copy->base.reset = rmt_copy_reset;
+   copy->base.del = rmt_copy_del;
+   *ret_encoder = &copy->base;
+   return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder) {
+   if(!encoder) return ESP_ERR_INVALID_ARG;
+   return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder) {
+   if(!encoder) return ESP_ERR_INVALID_ARG;
+   return encoder->reset(encoder);
+}
@@ -0,0 +1,38 @@
+#include "sim.h"
+
+static uint64_t now = 0;
+static sim_source_S *sources = NULL;
+
+void sim_source_add(sim_source_S *source) {
+   sim_source_S **tail = &sources;
+   while(*tail) tail = &(*tail)->link;
+   source->link = NULL;
+   *tail = source;
+}
+
+uint64_t sim_now(void) {
+   return now;
+}
+
+// fire every source due before end in time order, ties go in registration order,
+// tasks made ready by an event run before the next one
+void sim_run_until(uint64_t end) {
+   sim_tasks_run();
+   for(;;) {
+      sim_source_S *due = NULL;
+      for(sim_source_S *source = sources; source; source = source->link) {
+         if(source->next <= end && (!due || source->next < due->next))
+            due = source;
+      }
+      if(!due) break;
+
+      if(due->next > now) now = due->next;
+      due->fire(due);
+      sim_tasks_run();
+   }
+   if(end > now) now = end;
+}
+
+void sim_run_for(uint64_t us) {
+   sim_run_until(now + us * 1000);
+}
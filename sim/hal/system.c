@@ -0,0 +1,39 @@
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_system.h>
+
+const char *esp_err_to_name(esp_err_t code) {
+   switch(code) {
+      case ESP_OK:                        return "ESP_OK";
+      case ESP_FAIL:                      return "ESP_FAIL";
+      case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+      case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+      case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+      case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+      case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+      case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+      case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+      case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+      case ESP_ERR_NVS_NO_FREE_PAGES:     return "ESP_ERR_NVS_NO_FREE_PAGES";
+      case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+      default:                            return "UNKNOWN ERROR";
+   }
+}
+
+void esp_restart(void) {
+   fprintf(stderr, "esp_restart\n");
+   exit(0);
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+   return ESP_OK;
+}
+
+// no events are ever posted by the stand-in radio
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance) {
+   if(!event_handler) return ESP_ERR_INVALID_ARG;
+   if(instance) *instance = NULL;
+   return ESP_OK;
+}
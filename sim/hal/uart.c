@@ -0,0 +1,186 @@
+#include "sim.h"
+#include <driver/uart.h>
+
+#define SIM_UART_PATTERNS 64
+
+typedef struct {
+   uint8_t *data;
+   size_t size;
+   size_t head;
+   size_t len;
+} sim_ring_S;
+
+typedef struct {
+   bool installed;
+   int baud_rate;
+   sim_ring_S rx;
+   sim_ring_S tx;
+   QueueHandle_t events;
+
+   // pattern detection, positions count bytes since install
+   bool pattern;
+   char pattern_chr;
+   size_t rx_total, read_total;
+   size_t pattern_pos[SIM_UART_PATTERNS];
+   int pattern_head, pattern_len, pattern_size;
+} sim_uart_S;
+
+static sim_uart_S uarts[UART_NUM_MAX];
+
+static size_t ring_push(sim_ring_S *ring, const uint8_t *src, size_t len) {
+   size_t i;
+   for(i = 0; i < len && ring->len < ring->size; i++) {
+      ring->data[(ring->head + ring->len++) % ring->size] = src[i];
+   }
+   return i;
+}
+
+static size_t ring_pop(sim_ring_S *ring, uint8_t *dst, size_t len) {
+   size_t i;
+   for(i = 0; i < len && ring->len > 0; i++) {
+      dst[i] = ring->data[ring->head];
+      ring->head = (ring->head + 1) % ring->size;
+      ring->len--;
+   }
+   return i;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config) {
+   if(uart_num >= UART_NUM_MAX || !uart_config) return ESP_ERR_INVALID_ARG;
+   uarts[uart_num].baud_rate = uart_config->baud_rate;
+   return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags) {
+   if(uart_num >= UART_NUM_MAX || rx_buffer_size <= 0) return ESP_ERR_INVALID_ARG;
+   sim_uart_S *uart = &uarts[uart_num];
+   if(uart->installed) return ESP_FAIL;
+
+   // a zero tx buffer makes writes blocking on target, here they always land in the ring
+   if(tx_buffer_size <= 0) tx_buffer_size = rx_buffer_size;
+
+   uart->rx = (sim_ring_S) {.data = calloc(rx_buffer_size, 1), .size = rx_buffer_size};
+   uart->tx = (sim_ring_S) {.data = calloc(tx_buffer_size, 1), .size = tx_buffer_size};
+   if(!uart->rx.data || !uart->tx.data) return ESP_ERR_NO_MEM;
+
+   if(uart_queue) {
+      uart->events = xQueueCreate(queue_size > 0 ? queue_size : 1, sizeof(uart_event_t));
+      if(!uart->events) return ESP_ERR_NO_MEM;
+      *uart_queue = uart->events;
+   }
+   uart->installed = true;
+   return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size) {
+   if(uart_num >= UART_NUM_MAX || !size) return ESP_ERR_INVALID_ARG;
+   if(!uarts[uart_num].installed) return ESP_FAIL;
+   *size = uarts[uart_num].rx.len;
+   return ESP_OK;
+}
+
+// nothing else can fill the buffer while the caller waits, so never block
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait) {
+   if(uart_num >= UART_NUM_MAX || !uarts[uart_num].installed) return -1;
+   size_t read = ring_pop(&uarts[uart_num].rx, buf, length);
+   uarts[uart_num].read_total += read;
+   return read;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size) {
+   if(uart_num >= UART_NUM_MAX || !uarts[uart_num].installed) return -1;
+   return ring_push(&uarts[uart_num].tx, src, size);
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num) {
+   if(uart_num >= UART_NUM_MAX || !uarts[uart_num].installed) return ESP_FAIL;
+   sim_uart_S *uart = &uarts[uart_num];
+   uart->read_total += uart->rx.len;
+   uart->rx.len = 0;
+   return ESP_OK;
+}
+
+// writes land in the tx ring at once and are taken by sim_uart_tx, there is nothing to wait for
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait) {
+   if(uart_num >= UART_NUM_MAX || !uarts[uart_num].installed) return ESP_FAIL;
+   return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate) {
+   if(uart_num >= UART_NUM_MAX) return ESP_ERR_INVALID_ARG;
+   uarts[uart_num].baud_rate = baudrate;
+   return ESP_OK;
+}
+
+esp_err_t uart_get_baudrate(uart_port_t uart_num, uint32_t *baudrate) {
+   if(uart_num >= UART_NUM_MAX || !baudrate) return ESP_ERR_INVALID_ARG;
+   *baudrate = uarts[uart_num].baud_rate;
+   return ESP_OK;
+}
+
+// only single character patterns, the timing arguments have no meaning without a line
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t uart_num, char pattern_chr, uint8_t chr_num,
+                                            int chr_tout, int post_idle, int pre_idle) {
+   if(uart_num >= UART_NUM_MAX || chr_num != 1) return ESP_ERR_INVALID_ARG;
+   uarts[uart_num].pattern = true;
+   uarts[uart_num].pattern_chr = pattern_chr;
+   return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t uart_num, int queue_length) {
+   if(uart_num >= UART_NUM_MAX || queue_length <= 0) return ESP_ERR_INVALID_ARG;
+   sim_uart_S *uart = &uarts[uart_num];
+   uart->pattern_head = 0;
+   uart->pattern_len = 0;
+   uart->pattern_size = queue_length < SIM_UART_PATTERNS ? queue_length : SIM_UART_PATTERNS;
+   return ESP_OK;
+}
+
+// offset of the oldest pattern from the head of the rx ring, -1 when there is none
+int uart_pattern_pop_pos(uart_port_t uart_num) {
+   if(uart_num >= UART_NUM_MAX) return -1;
+   sim_uart_S *uart = &uarts[uart_num];
+   while(uart->pattern_len > 0) {
+      size_t pos = uart->pattern_pos[uart->pattern_head];
+      uart->pattern_head = (uart->pattern_head + 1) % SIM_UART_PATTERNS;
+      uart->pattern_len--;
+      if(pos >= uart->read_total) return pos - uart->read_total;
+   }
+   return -1;
+}
+
+static void uart_event(sim_uart_S *uart, uart_event_type_t type, size_t size) {
+   if(!uart->events) return;
+   uart_event_t event = {.type = type, .size = size, .timeout_flag = type == UART_DATA};
+   xQueueSendFromISR(uart->events, &event, NULL);
+}
+
+// a whole chunk arrives at once, with a pattern event per pattern character and
+// a data event for the bytes after the last one as if they ended in the rx timeout
+size_t sim_uart_rx(uart_port_t uart_num, const void *src, size_t size) {
+   if(uart_num >= UART_NUM_MAX || !uarts[uart_num].installed) return 0;
+   sim_uart_S *uart = &uarts[uart_num];
+   const uint8_t *bytes = src;
+   size_t pushed = ring_push(&uart->rx, src, size);
+   size_t tail = 0;
+
+   for(size_t i = 0; i < pushed; i++) {
+      if(!uart->pattern || bytes[i] != uart->pattern_chr) continue;
+      if(uart->pattern_len < uart->pattern_size) {
+         uart->pattern_pos[(uart->pattern_head + uart->pattern_len++) % SIM_UART_PATTERNS] = uart->rx_total + i;
+      }
+      uart_event(uart, UART_PATTERN_DET, i + 1 - tail);
+      tail = i + 1;
+   }
+   uart->rx_total += pushed;
+
+   if(pushed < size) uart_event(uart, UART_BUFFER_FULL, pushed - tail);
+   else if(tail < pushed) uart_event(uart, UART_DATA, pushed - tail);
+   return pushed;
+}
+
+size_t sim_uart_tx(uart_port_t uart_num, void *dst, size_t size) {
+   if(uart_num >= UART_NUM_MAX || !uarts[uart_num].installed) return 0;
+   return ring_pop(&uarts[uart_num].tx, dst, size);
+}
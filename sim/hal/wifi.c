@@ -0,0 +1,101 @@
+// radio and netif stand-ins, the simulation uses the host network directly
+#include <esp_wifi.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+struct esp_netif_obj {
+   esp_netif_ip_info_t ip_info;
+   bool dhcpc;
+};
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+
+static struct esp_netif_obj sta_netif, ap_netif;
+static wifi_mode_t wifi_mode = WIFI_MODE_NULL;
+static bool wifi_initialized = false;
+
+esp_err_t esp_netif_init(void) {
+   return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) {
+   sta_netif.dhcpc = true;
+   return &sta_netif;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void) {
+   ap_netif.ip_info.ip.addr = htonl(0xC0A80401);      // 192.168.4.1
+   ap_netif.ip_info.gw.addr = htonl(0xC0A80401);
+   ap_netif.ip_info.netmask.addr = htonl(0xFFFFFF00);
+   return &ap_netif;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif) {
+   if(!esp_netif) return ESP_ERR_INVALID_ARG;
+   esp_netif->dhcpc = true;
+   return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif) {
+   if(!esp_netif) return ESP_ERR_INVALID_ARG;
+   esp_netif->dhcpc = false;
+   return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif, const esp_netif_ip_info_t *ip_info) {
+   if(!esp_netif || !ip_info) return ESP_ERR_INVALID_ARG;
+   if(esp_netif->dhcpc) return ESP_ERR_INVALID_STATE;
+   esp_netif->ip_info = *ip_info;
+   return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info) {
+   if(!esp_netif || !ip_info) return ESP_ERR_INVALID_ARG;
+   *ip_info = esp_netif->ip_info;
+   return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+   if(!config) return ESP_ERR_INVALID_ARG;
+   wifi_initialized = true;
+   return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+   return wifi_initialized ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_wifi_connect(void) {
+   return wifi_mode == WIFI_MODE_STA || wifi_mode == WIFI_MODE_APSTA ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+   return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+   if(mode >= WIFI_MODE_MAX) return ESP_ERR_INVALID_ARG;
+   wifi_mode = mode;
+   return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode) {
+   if(!mode) return ESP_ERR_INVALID_ARG;
+   *mode = wifi_mode;
+   return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+   return conf ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_wifi_sta_get_rssi(int *rssi) {
+   *rssi = -50;
+   return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second) {
+   *primary = 1;
+   if(second) *second = WIFI_SECOND_CHAN_NONE;
+   return ESP_OK;
+}
@@ -0,0 +1,33 @@
+#ifndef DRIVER_RMT_TYPES_H
+#define DRIVER_RMT_TYPES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef struct rmt_channel_t *rmt_channel_handle_t;
+typedef struct rmt_encoder_t rmt_encoder_t;
+typedef rmt_encoder_t *rmt_encoder_handle_t;
+
+typedef int rmt_clock_source_t;
+#define RMT_CLK_SRC_DEFAULT 0
+
+// one RMT memory word, two levels with their durations in ticks, a zero duration ends the transmission
+typedef union {
+   struct {
+      uint16_t duration0 : 15;
+      uint16_t level0    : 1;
+      uint16_t duration1 : 15;
+      uint16_t level1    : 1;
+   };
+   uint32_t val;
+} rmt_symbol_word_t;
+
+typedef struct {
+   size_t num_symbols;
+} rmt_tx_done_event_data_t;
+
+typedef bool (*rmt_tx_done_callback_t)(rmt_channel_handle_t tx_chan, const rmt_tx_done_event_data_t *edata, void *user_ctx);
+
+#endif
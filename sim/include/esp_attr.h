@@ -0,0 +1,8 @@
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef ESP_CPU_H
+#define ESP_CPU_H
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+// sim time scaled to CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, with host time for the code run at one sim instant
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+#include <string.h>
+#include <errno.h>
+
+typedef enum {
+   ESP_LOG_NONE,
+   ESP_LOG_ERROR,
+   ESP_LOG_WARN,
+   ESP_LOG_INFO,
+   ESP_LOG_DEBUG,
+   ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+esp_log_level_t esp_log_level_get(const char *tag);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+   __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOG_LEVEL(level, tag, format, ...) esp_log_write(level, tag, format, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR,   tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN,    tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO,    tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG,   tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ESP_NETIF_H
+#define ESP_NETIF_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+   uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+   esp_ip4_addr_t ip;
+   esp_ip4_addr_t netmask;
+   esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+#define esp_ip4_addr1(ipaddr) (((const uint8_t*)(&(ipaddr)->addr))[0])
+#define esp_ip4_addr2(ipaddr) (((const uint8_t*)(&(ipaddr)->addr))[1])
+#define esp_ip4_addr3(ipaddr) (((const uint8_t*)(&(ipaddr)->addr))[2])
+#define esp_ip4_addr4(ipaddr) (((const uint8_t*)(&(ipaddr)->addr))[3])
+
+#define IP2STR(ipaddr) esp_ip4_addr1(ipaddr), esp_ip4_addr2(ipaddr), esp_ip4_addr3(ipaddr), esp_ip4_addr4(ipaddr)
+#define IPSTR "%d.%d.%d.%d"
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif);
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif, const esp_netif_ip_info_t *ip_info);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+#include "esp_err.h"
+
+void esp_restart(void) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef ESP_WIFI_H
+#define ESP_WIFI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_system.h"
+
+typedef enum {
+   WIFI_MODE_NULL = 0,
+   WIFI_MODE_STA,
+   WIFI_MODE_AP,
+   WIFI_MODE_APSTA,
+   WIFI_MODE_NAN,
+   WIFI_MODE_MAX,
+} wifi_mode_t;
+
+typedef enum {
+   WIFI_IF_STA,
+   WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum {
+   WIFI_AUTH_OPEN = 0,
+   WIFI_AUTH_WEP,
+   WIFI_AUTH_WPA_PSK,
+   WIFI_AUTH_WPA2_PSK,
+   WIFI_AUTH_WPA_WPA2_PSK,
+   WIFI_AUTH_MAX,
+} wifi_auth_mode_t;
+
+typedef enum {
+   WIFI_SECOND_CHAN_NONE = 0,
+   WIFI_SECOND_CHAN_ABOVE,
+   WIFI_SECOND_CHAN_BELOW,
+} wifi_second_chan_t;
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t password[64];
+   uint8_t ssid_len;
+   uint8_t channel;
+   wifi_auth_mode_t authmode;
+   uint8_t ssid_hidden;
+   uint8_t max_connection;
+   uint16_t beacon_interval;
+} wifi_ap_config_t;
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t password[64];
+   bool bssid_set;
+   uint8_t bssid[6];
+   uint8_t channel;
+   uint16_t listen_interval;
+   uint8_t failure_retry_cnt;
+} wifi_sta_config_t;
+
+typedef union {
+   wifi_ap_config_t ap;
+   wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef struct {
+   int static_rx_buf_num;
+   int dynamic_rx_buf_num;
+   int nvs_enable;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { \
+   .static_rx_buf_num = 10, \
+   .dynamic_rx_buf_num = 32, \
+   .nvs_enable = 1, \
+}
+
+extern esp_event_base_t const WIFI_EVENT;
+
+typedef enum {
+   WIFI_EVENT_WIFI_READY = 0,
+   WIFI_EVENT_SCAN_DONE,
+   WIFI_EVENT_STA_START,
+   WIFI_EVENT_STA_STOP,
+   WIFI_EVENT_STA_CONNECTED,
+   WIFI_EVENT_STA_DISCONNECTED,
+} wifi_event_t;
+
+typedef struct {
+   uint8_t ssid[32];
+   uint8_t ssid_len;
+   uint8_t bssid[6];
+   uint8_t channel;
+   wifi_auth_mode_t authmode;
+   uint16_t aid;
+} wifi_event_sta_connected_t;
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_sta_get_rssi(int *rssi);
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second);
+
+#endif
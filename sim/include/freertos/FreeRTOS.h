@@ -0,0 +1,30 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ 100
+#define portMAX_DELAY      ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)  ((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000))
+
+// the sim runs one task or ISR at a time, critical sections have nothing to exclude
+typedef struct { int owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux)      ((void) (mux))
+#define portEXIT_CRITICAL(mux)       ((void) (mux))
+#define portENTER_CRITICAL_ISR(mux)  ((void) (mux))
+#define portEXIT_CRITICAL_ISR(mux)   ((void) (mux))
+#define portENTER_CRITICAL_SAFE(mux) ((void) (mux))
+#define portEXIT_CRITICAL_SAFE(mux)  ((void) (mux))
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  pdFALSE
+#define pdPASS  pdTRUE
+
+#endif
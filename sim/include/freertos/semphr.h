@@ -0,0 +1,14 @@
+#ifndef SEMPHR_H
+#define SEMPHR_H
+
+#include "FreeRTOS.h"
+
+// mutexes without priority inheritance, tasks never preempt each other in the simulation
+typedef struct sim_mutex_S *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+void vSemaphoreDelete(SemaphoreHandle_t mutex);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "FreeRTOS.h"
+
+// tasks are host threads of which only one runs at a time, in zero simulated time,
+// see hal/freertos.c
+typedef struct sim_task_S *TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define tskNO_AFFINITY ((BaseType_t) 0x7FFFFFFF)
+#define portYIELD_FROM_ISR(woken) ((void) (woken))
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created_task);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+
+#endif
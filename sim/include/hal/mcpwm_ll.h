@@ -0,0 +1,16 @@
+#ifndef HAL_MCPWM_LL_H
+#define HAL_MCPWM_LL_H
+
+// the register level calls the firmware makes from its cache safe ISRs, where the driver
+// functions that are not placed in IRAM can not go, on the simulated groups
+#include <driver/mcpwm_prelude.h>
+
+typedef struct mcpwm_dev_t mcpwm_dev_t;
+
+mcpwm_dev_t *sim_mcpwm_ll_get_hw(int group_id);
+#define MCPWM_LL_GET_HW(ID) sim_mcpwm_ll_get_hw(ID)
+
+void mcpwm_ll_timer_set_start_stop_command(mcpwm_dev_t *mcpwm, int timer_id, mcpwm_timer_start_stop_cmd_t cmd);
+void mcpwm_ll_gen_disable_continue_force_action(mcpwm_dev_t *mcpwm, int operator_id, int generator_id);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef LWIP_IP4_ADDR_H
+#define LWIP_IP4_ADDR_H
+
+#include <arpa/inet.h>
+
+#define ipaddr_addr(cp) inet_addr(cp)
+
+#endif
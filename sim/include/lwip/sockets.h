@@ -0,0 +1,21 @@
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+// lwIP exposes the BSD socket API, so the host stack stands in for it directly
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/select.h>
+
+// blocking in select has to wait in simulated time, see hal/freertos.c
+int sim_select(int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds, struct timeval *timeout);
+#define select sim_select
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// the few options of sdkconfig.esp32 the firmware reads
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LOG_DEFAULT_LEVEL 0
+
+#endif
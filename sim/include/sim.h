@@ -0,0 +1,43 @@
+#ifndef SIM_H
+#define SIM_H
+
+// control interface of the host simulation, not part of ESP-IDF
+#include <stdint.h>
+#include <stddef.h>
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <esp_adc/adc_oneshot.h>
+
+#define SIM_NEVER UINT64_MAX
+
+// something that fires at a point in simulated time, like a hardware timer
+typedef struct sim_source_S {
+   uint64_t next; // ns, SIM_NEVER when idle
+   void (*fire)(struct sim_source_S*);
+   struct sim_source_S *link;
+} sim_source_S;
+
+void sim_source_add(sim_source_S*);
+
+// simulated clock in ns since boot
+uint64_t sim_now(void);
+void sim_run_until(uint64_t ns);
+void sim_run_for(uint64_t us);
+
+// runs FreeRTOS tasks made ready outside of sim_run_*, which does so itself
+void sim_tasks_run(void);
+
+// board side of the peripherals
+typedef void (*sim_gpio_edge_cb_t)(gpio_num_t, void *ctx); // rising edge
+
+void sim_gpio_set_input(gpio_num_t, uint32_t level);
+void sim_gpio_watch(gpio_num_t, sim_gpio_edge_cb_t, void *ctx);
+void sim_gpio_unwatch(gpio_num_t, sim_gpio_edge_cb_t, void *ctx);
+uint32_t sim_gpio_edges(gpio_num_t);
+
+size_t sim_uart_rx(uart_port_t, const void*, size_t);
+size_t sim_uart_tx(uart_port_t, void*, size_t);
+
+void sim_adc_set(adc_channel_t, int raw);
+
+#endif
@@ -0,0 +1,98 @@
+// host simulation of the mount: runs app_main against the stand-in HAL on a
+// simulated clock, optionally much faster than real time
+#include "sim.h"
+#include <esp_log.h>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_SLICE_US 1000
+
+// board wiring, see stepper_states in stepper.c
+static const gpio_num_t RA_STEP = GPIO_NUM_14;
+static const gpio_num_t DE_STEP = GPIO_NUM_15;
+
+void app_main(void);
+
+static void usage(const char *name) {
+   fprintf(stderr,
+           "usage: %s [-s speed] [-t seconds] [-u] [-v level]\n"
+           "  -s speed    simulated seconds per wall clock second, 0 runs flat out (default 1)\n"
+           "  -t seconds  stop after this much simulated time (default forever)\n"
+           "  -u          connect UART0 to stdin/stdout\n"
+           "  -v level    log level 0-5 (default 0)\n",
+           name);
+}
+
+static uint64_t wall_now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+   double speed = 1;
+   double duration = 0;
+   bool uart = false;
+   int log_level = ESP_LOG_NONE;
+
+   int opt;
+   while((opt = getopt(argc, argv, "s:t:uv:h")) != -1) {
+      switch(opt) {
+         case 's': speed = atof(optarg); break;
+         case 't': duration = atof(optarg); break;
+         case 'u': uart = true; break;
+         case 'v': log_level = atoi(optarg); break;
+         default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+      }
+   }
+
+   if(uart) fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+   app_main();
+   esp_log_level_set("*", log_level);
+
+   uint64_t end = duration > 0 ? (uint64_t) (duration * 1e9) : SIM_NEVER;
+   uint64_t wall_start = wall_now();
+
+   while(sim_now() < end) {
+      uint64_t slice = sim_now() + SIM_SLICE_US * 1000;
+      sim_run_until(slice < end ? slice : end);
+
+      if(uart) {
+         uint8_t buff[256];
+         ssize_t len = read(STDIN_FILENO, buff, sizeof(buff));
+         if(len > 0) sim_uart_rx(UART_NUM_0, buff, len);
+
+         size_t tx_len;
+         while((tx_len = sim_uart_tx(UART_NUM_0, buff, sizeof(buff))) > 0) {
+            fwrite(buff, 1, tx_len, stdout);
+         }
+         fflush(stdout);
+      }
+
+      if(speed > 0) {
+         uint64_t wall_target = wall_start + (uint64_t) (sim_now() / speed);
+         uint64_t wall = wall_now();
+         if(wall_target > wall) {
+            struct timespec ts = {
+               .tv_sec  = (wall_target - wall) / 1000000000,
+               .tv_nsec = (wall_target - wall) % 1000000000,
+            };
+            nanosleep(&ts, NULL);
+         }
+      }
+   }
+
+   double wall = (wall_now() - wall_start) / 1e9;
+   fprintf(stderr, "simulated %.3f s in %.3f s (%.0fx), step pulses RA %u DE %u\n",
+           sim_now() / 1e9, wall, wall > 0 ? sim_now() / 1e9 / wall : 0,
+           sim_gpio_edges(RA_STEP), sim_gpio_edges(DE_STEP));
+   return 0;
+}
@@ -0,0 +1,138 @@
+// runs gotos of both axes started as one coordinated move and checks their first
+// steps go out on the same timer edge, they keep to the straight line between
+// start and target in count space and arrive together, with a pair started one
+// axis at a time first for comparison, while the prescalers of the groups
+// have not been lined up by a sync yet
+#include "sim.h"
+#include "stepper.h"
+#include "synscan.h"
+#include "trace.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLE_US 1000
+
+// the step pins in stepper.c
+static const gpio_num_t STEP_PINS[STEPPER_COUNT] = {GPIO_NUM_14, GPIO_NUM_15};
+
+typedef enum {
+   START_COORDINATED, // stepper_start_coordinated
+   START_J3,          // ':J3' through the SynScan parser
+   START_APART,       // stepper_start on each axis, not checked
+} coord_start_E;
+
+typedef struct {
+   const char *name;
+   coord_start_E start;
+   uint32_t distance[STEPPER_COUNT];
+   stepper_dir_E dir[STEPPER_COUNT];
+   uint32_t period[STEPPER_COUNT]; // T1, fast gotos
+   uint32_t accel[STEPPER_COUNT];
+} coord_case_S;
+
+static uint64_t first_step[STEPPER_COUNT], first_interval[STEPPER_COUNT], last_step[STEPPER_COUNT];
+
+static void coord_step(gpio_num_t gpio, void *ctx) {
+   stepper_E stepper = (stepper_E) (intptr_t) ctx;
+   if(!first_step[stepper]) first_step[stepper] = sim_now();
+   else if(!first_interval[stepper]) first_interval[stepper] = sim_now() - first_step[stepper];
+   last_step[stepper] = sim_now();
+}
+
+static void coord_j3(void) {
+   ss_parser_S parser = {.transport = SS_TRANSPORT_UART};
+   for(const char *c = ":J3\r"; *c; c++)
+      ss_handle_byte(&parser, *c);
+}
+
+static int coord_run(const coord_case_S *c) {
+   uint32_t start[STEPPER_COUNT];
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      start[stepper] = stepper_get_count(stepper);
+      stepper_set_mode(stepper, STEPPER_GOTO, STEPPER_FAST, c->dir[stepper]);
+      stepper_set_period(stepper, c->period[stepper]);
+      stepper_set_accel(stepper, c->accel[stepper] ? c->accel[stepper] : STEPPER_DEFAULT_ACCEL);
+      stepper_set_target(stepper, start[stepper] + (c->dir[stepper] == STEPPER_CW ? c->distance[stepper] : -c->distance[stepper]));
+      first_step[stepper] = 0;
+      first_interval[stepper] = 0;
+   }
+
+   if(c->start == START_COORDINATED) {
+      stepper_start_coordinated();
+   } else if(c->start == START_J3) {
+      coord_j3();
+   } else {
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+         stepper_start(stepper);
+   }
+
+   // how far the shorter axis strays from its share of the longer one's progress, in its own steps
+   stepper_E lead = c->distance[STEPPER_RA] >= c->distance[STEPPER_DE] ? STEPPER_RA : STEPPER_DE;
+   stepper_E follow = lead == STEPPER_RA ? STEPPER_DE : STEPPER_RA;
+   double share = (double) c->distance[follow] / c->distance[lead];
+   double deviation = 0;
+   while(stepper_busy(STEPPER_RA) || stepper_busy(STEPPER_DE)) {
+      sim_run_for(SAMPLE_US);
+      double moved[STEPPER_COUNT];
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+         uint32_t delta = stepper_get_count(stepper) - start[stepper];
+         moved[stepper] = c->dir[stepper] == STEPPER_CW ? delta : -delta;
+      }
+      double off = fabs(moved[follow] - moved[lead] * share);
+      if(off > deviation) deviation = off;
+   }
+
+   bool on_target = true;
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      on_target &= stepper_get_count(stepper) == stepper_get_target(stepper);
+
+   int64_t skew = (int64_t) first_step[STEPPER_RA] - (int64_t) first_step[STEPPER_DE];
+   int64_t lag = (int64_t) last_step[STEPPER_RA] - (int64_t) last_step[STEPPER_DE];
+   double seconds = ((last_step[lead] > last_step[follow] ? last_step[lead] : last_step[follow]) - first_step[lead]) / 1e9;
+
+   printf("%-20s %9u %9u %8.2f %10lld %8.2f %8.2f %9.1f %6s\n", c->name, c->distance[STEPPER_RA], c->distance[STEPPER_DE],
+          seconds, (long long) skew, lag / 1e6, first_interval[follow] / 1e6, deviation, on_target ? "ok" : "missed");
+
+   if(c->start == START_APART)
+      return !on_target;
+
+   // each axis steps at the start of its periods, so it runs ahead of its ramp by about the
+   // first period, which is longer the smaller the share, the follower may arrive up to two
+   // of its first periods before the leader
+   bool fail = !on_target || skew != 0 || (uint64_t) llabs(lag) > 2 * first_interval[follow] + 1000000 ||
+               deviation > 2 + c->distance[follow] / 200.0;
+   if(fail)
+      printf("FAIL: %s\n", c->name);
+   return fail;
+}
+
+int main(void) {
+   static const coord_case_S cases[] = {
+      {.name = "apart",          .start = START_APART, .distance = {400000, 90000},  .dir = {STEPPER_CW, STEPPER_CCW},  .period = {10, 10}},
+      {.name = "RA leads",       .distance = {400000, 90000},   .dir = {STEPPER_CW, STEPPER_CCW},  .period = {10, 10}},
+      {.name = "DE leads",       .distance = {2500, 300000},    .dir = {STEPPER_CCW, STEPPER_CW},  .period = {10, 10}},
+      {.name = "equal",          .distance = {123456, 123456},  .dir = {STEPPER_CW, STEPPER_CW},   .period = {10, 10}},
+      {.name = "tiny follower",  .distance = {1000000, 400},     .dir = {STEPPER_CCW, STEPPER_CCW}, .period = {10, 10}},
+      {.name = "slower DE paces",.distance = {200000, 100000},  .dir = {STEPPER_CW, STEPPER_CW},   .period = {10, 40}},
+      {.name = "weaker RA ramps",.distance = {150000, 250000},  .dir = {STEPPER_CCW, STEPPER_CW},  .period = {10, 10}, .accel = {8000, 32000}},
+      {.name = "J3",             .start = START_J3,    .distance = {60000, 45000},   .dir = {STEPPER_CW, STEPPER_CCW},  .period = {10, 10}},
+   };
+   int fail = 0;
+
+   trace_init();
+   stepper_init();
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      sim_gpio_watch(STEP_PINS[stepper], coord_step, (void*) (intptr_t) stepper);
+   xTaskCreate(stepper_task, "stepper", 4096, NULL, 12, NULL);
+   sim_run_for(1000);
+
+   printf("%-20s %9s %9s %8s %10s %8s %8s %9s %6s\n", "", "RA steps", "DE steps", "s", "skew ns", "lag ms", "c0 ms", "deviation", "target");
+   for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      fail |= coord_run(&cases[i]);
+
+   return fail;
+}
@@ -0,0 +1,69 @@
+// tracks at the sidereal rate for 8 simulated hours and checks the
+// accumulated position error of the fractional (24.8) T1 against whole T1
+#include "sim.h"
+#include "stepper.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define SIDEREAL_DAY 86164.0905 // s
+#define HOURS 8
+#define SAMPLE_US 60000000ULL
+
+typedef struct {
+   double max_err;   // steps, against the sidereal rate
+   double final_err; // steps, against the sidereal rate
+   double rate_err;  // steps, against the commanded rate
+} dda_result_S;
+
+static dda_result_S dda_track(uint32_t period_fine) {
+   dda_result_S result = {0};
+   double sidereal_rate = stepper_cpr(STEPPER_RA) / SIDEREAL_DAY; // steps/s
+   double commanded_rate = STEPPER_FREQ / (period_fine / 256.0);
+
+   stepper_set_count(STEPPER_RA, 0);
+   stepper_set_mode(STEPPER_RA, STEPPER_TRACKING, STEPPER_SLOW, STEPPER_CW);
+   stepper_set_period_fine(STEPPER_RA, period_fine);
+
+   uint64_t start = sim_now();
+   stepper_start(STEPPER_RA);
+
+   for(uint64_t t = SAMPLE_US; t <= HOURS * 3600 * 1000000ULL; t += SAMPLE_US) {
+      sim_run_until(start + t * 1000);
+      double err = stepper_get_count(STEPPER_RA) - t / 1e6 * sidereal_rate;
+      if(fabs(err) > fabs(result.max_err)) result.max_err = err;
+      result.final_err = err;
+      result.rate_err = stepper_get_count(STEPPER_RA) - t / 1e6 * commanded_rate;
+   }
+
+   stepper_stop_instant(STEPPER_RA);
+   while(stepper_busy(STEPPER_RA)) sim_run_for(1000);
+   return result;
+}
+
+int main(void) {
+   stepper_init();
+
+   double arcsec = 360.0 * 3600 / stepper_cpr(STEPPER_RA);
+   double t1 = STEPPER_FREQ * SIDEREAL_DAY / stepper_cpr(STEPPER_RA);
+   uint32_t whole = lround(t1) << 8;
+   uint32_t fine = lround(t1 * 256);
+
+   dda_result_S whole_result = dda_track(whole);
+   dda_result_S fine_result = dda_track(fine);
+
+   printf("sidereal T1 %.4f, %d h, 1 step = %.3f arcsec\n", t1, HOURS, arcsec);
+   printf("%-12s %12s %12s %12s %12s\n", "T1", "final steps", "final arcsec", "max steps", "vs command");
+   printf("%-12.4f %12.1f %12.1f %12.1f %12.1f\n", whole / 256.0,
+          whole_result.final_err, whole_result.final_err * arcsec, whole_result.max_err, whole_result.rate_err);
+   printf("%-12.4f %12.1f %12.1f %12.1f %12.1f\n", fine / 256.0,
+          fine_result.final_err, fine_result.final_err * arcsec, fine_result.max_err, fine_result.rate_err);
+
+   // the 24.8 T1 itself is only exact to half of 1/256, the step timing has to add nothing on top
+   double quantization = HOURS * 3600.0 * stepper_cpr(STEPPER_RA) / SIDEREAL_DAY * (0.5 / 256) / t1;
+   if(fabs(fine_result.rate_err) > 2 || fabs(fine_result.max_err) > quantization + 2) {
+      printf("FAIL: fractional T1 drifts\n");
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,105 @@
+// renders deferred log entries back into the lines ESP_LOGx would have
+// printed, filters them at compile and run time, drops them when the ring is
+// full, and keeps every entry of several writer threads in order
+#define DLOG_LOCAL_LEVEL ESP_LOG_DEBUG
+#include "dlog.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WRITERS 3
+#define WRITES 20000
+
+static atomic_int running;
+
+static bool check(const char *name, bool ok, const char *got) {
+   printf("%-20s %s %s\n", name, ok ? "ok  " : "FAIL", got);
+   return ok;
+}
+
+static bool render(char *line, size_t size) {
+   esp_log_level_t level;
+   const char *tag;
+   line[0] = '\0';
+   return dlog_render(line, size, &level, &tag);
+}
+
+static void *writer(void *args) {
+   uintptr_t id = (uintptr_t) args;
+   for(uint32_t i = 0; i < WRITES; i++) {
+      DLOG(DLOG_SERVER, ESP_LOG_INFO, "w%u %u", id, i);
+      sched_yield();
+   }
+   atomic_fetch_sub(&running, 1);
+   return NULL;
+}
+
+int main(void) {
+   char line[160];
+   bool ok = true;
+
+   dlog_level_set("*", ESP_LOG_DEBUG);
+   esp_log_level_set("*", ESP_LOG_NONE);
+
+   DLOG(DLOG_SERVER, ESP_LOG_WARN, "%d %lu %x %04X %s %c|%%", -3, 7UL, 255, 0xAB, (uintptr_t) "str", 'z');
+   render(line, sizeof(line));
+   ok &= check("format", strcmp(line, "[0] -3 7 ff 00AB str z|%") == 0, line);
+
+   DLOG(DLOG_SERVER, ESP_LOG_WARN, "|%5d|%-3u|%d", 42, 1);
+   render(line, sizeof(line));
+   ok &= check("width", strcmp(line, "[0] |   42|1  |0") == 0, line);
+
+   DLOG_DATA(DLOG_SERVER, ESP_LOG_DEBUG, "rx: %.*s (%lu)", ":e1|too long to keep in full, the rest is cut off at forty-eight", 60, 60UL);
+   render(line, sizeof(line));
+   ok &= check("data", strcmp(line, "[0] rx: :e1|too long to keep in full, the rest is cut of (60)") == 0, line);
+
+   // run time, per module
+   dlog_level_set("uart", ESP_LOG_WARN);
+   DLOG(DLOG_UART, ESP_LOG_INFO, "filtered");
+   DLOG(DLOG_SERVER, ESP_LOG_INFO, "passed");
+   render(line, sizeof(line));
+   ok &= check("run time", strcmp(line, "[0] passed") == 0 && !render(line, sizeof(line)), line);
+   ok &= check("unknown tag", !dlog_level_set("nope", ESP_LOG_INFO), "");
+
+   // compile time, this file leaves out verbose
+   DLOG(DLOG_SERVER, ESP_LOG_VERBOSE, "compiled out");
+   ok &= check("compile time", !render(line, sizeof(line)), line);
+
+   // a full ring drops the newest
+   uint32_t dropped = dlog_dropped();
+   for(int i = 0; i < 40; i++) DLOG(DLOG_SERVER, ESP_LOG_INFO, "%d", i);
+   int count = 0;
+   while(render(line, sizeof(line))) count++;
+   snprintf(line, sizeof(line), "%d kept, %u dropped", count, dlog_dropped() - dropped);
+   ok &= check("full", count == 32 && dlog_dropped() - dropped == 8, line);
+
+   // writers on several threads, read while they write
+   pthread_t threads[WRITERS];
+   uint32_t next[WRITERS] = {0};
+   uint32_t kept = 0, order = 0;
+   dropped = dlog_dropped();
+   atomic_store(&running, WRITERS);
+   for(uintptr_t i = 0; i < WRITERS; i++) pthread_create(&threads[i], NULL, writer, (void*) i);
+   for(;;) {
+      bool more = atomic_load(&running) > 0;
+      while(render(line, sizeof(line))) {
+         unsigned id, seq;
+         if(sscanf(line, "[0] w%u %u", &id, &seq) != 2 || id >= WRITERS || seq < next[id]) {
+            order++;
+            continue;
+         }
+         next[id] = seq + 1;
+         kept++;
+      }
+      if(!more) break;
+      sched_yield();
+   }
+   for(int i = 0; i < WRITERS; i++) pthread_join(threads[i], NULL);
+   snprintf(line, sizeof(line), "%u kept, %u dropped, %u out of order", kept, dlog_dropped() - dropped, order);
+   ok &= check("writers", !order && kept + (dlog_dropped() - dropped) == WRITERS * WRITES, line);
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+// pulse guides a tracking and a stopped axis and checks the steps gained
+// or lost against the guide rate, and that the pulse is timed to the ms
+#include "sim.h"
+#include "stepper.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define SIDEREAL_DAY 86164.0905 // s
+#define WINDOW_US 4000000ULL
+
+static const double GUIDE_RATES[] = {1, 0.75, 0.5, 0.25, 0.125};
+
+typedef struct {
+   const char *name;
+   stepper_E stepper;
+   bool tracking;
+   stepper_guide_E guide;
+   stepper_dir_E dir;
+   uint32_t ms;
+} guide_case_S;
+
+static int guide_run(const guide_case_S *c) {
+   double sidereal = stepper_cpr(c->stepper) / SIDEREAL_DAY; // steps/s
+   uint32_t period_fine = lround(STEPPER_FREQ / sidereal * 256);
+   double tracking = c->tracking ? STEPPER_FREQ / (period_fine / 256.0) : 0;
+
+   stepper_set_mode(c->stepper, STEPPER_TRACKING, STEPPER_SLOW, STEPPER_CW);
+   stepper_set_period_fine(c->stepper, period_fine);
+   stepper_set_guide(c->stepper, c->guide);
+   if(c->tracking) {
+      stepper_start(c->stepper);
+      sim_run_for(1000000);
+   }
+
+   uint64_t start = sim_now();
+   uint32_t count = stepper_get_count(c->stepper);
+   stepper_pulse_guide(c->stepper, c->dir, c->ms);
+
+   // running throughout and timed to the ms
+   bool busy = true;
+   sim_run_for(c->ms * 1000ULL - 1000);
+   bool early = !stepper_guiding(c->stepper);
+   while(sim_now() - start < c->ms * 1000000ULL - 1000000) {
+      busy &= stepper_busy(c->stepper);
+      sim_run_for(1000);
+   }
+   sim_run_for(2000);
+   bool late = stepper_guiding(c->stepper);
+
+   sim_run_until(start + WINDOW_US * 1000);
+   int32_t steps = stepper_get_count(c->stepper) - count;
+   double offset = GUIDE_RATES[c->guide] * sidereal * c->ms / 1000 * (c->dir == STEPPER_CW ? 1 : -1);
+   double expected = tracking * WINDOW_US / 1e6 + offset;
+   bool restored = c->tracking ? stepper_busy(c->stepper) : !stepper_busy(c->stepper) && stepper_get_dir(c->stepper) == STEPPER_CW;
+
+   stepper_stop(c->stepper);
+   while(stepper_busy(c->stepper)) sim_run_for(1000);
+
+   printf("%-28s %10.1f %10d %10.1f\n", c->name, offset, steps, expected);
+   if(early || late || !restored || (c->tracking && !busy) || fabs(steps - expected) > 2) {
+      printf("FAIL: %s, early %d late %d restored %d busy %d\n", c->name, early, late, restored, busy);
+      return 1;
+   }
+   return 0;
+}
+
+int main(void) {
+   static const guide_case_S cases[] = {
+      {"ra east 1x 1000 ms",     STEPPER_RA, true,  STEPPER_GUIDE_1X,     STEPPER_CW,  1000},
+      {"ra west 1x 1500 ms",     STEPPER_RA, true,  STEPPER_GUIDE_1X,     STEPPER_CCW, 1500},
+      {"ra west 0.5x 2000 ms",   STEPPER_RA, true,  STEPPER_GUIDE_0_5X,   STEPPER_CCW, 2000},
+      {"ra east 0.125x 3000 ms", STEPPER_RA, true,  STEPPER_GUIDE_0_125X, STEPPER_CW,  3000},
+      {"de north 0.5x 2000 ms",  STEPPER_DE, false, STEPPER_GUIDE_0_5X,   STEPPER_CW,  2000},
+      {"de south 0.75x 1250 ms", STEPPER_DE, false, STEPPER_GUIDE_0_75X,  STEPPER_CCW, 1250},
+   };
+   int fail = 0;
+
+   stepper_init();
+
+   printf("%-28s %10s %10s %10s\n", "", "offset", "steps", "expected");
+   for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      fail |= guide_run(&cases[i]);
+
+   return fail;
+}
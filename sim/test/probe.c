@@ -0,0 +1,70 @@
+// runs the stepper built with STEPPER_PROBE through tracking and a ramped
+// goto and checks the probe sees every step on time, the sim fires each
+// compare event exactly on its tick so any deviation is the probe's own
+#include "sim.h"
+#include "stepper.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+
+typedef struct {
+   const char *name;
+   stepper_mode_E mode;
+   stepper_speed_E speed;
+   uint32_t period_fine; // T1 in 24.8 fixed point
+   uint32_t distance;    // steps for gotos
+   uint32_t seconds;     // run time for tracking
+} probe_case_S;
+
+static int probe_run(const probe_case_S *c) {
+   uint32_t count = stepper_get_count(STEPPER_RA);
+   stepper_set_mode(STEPPER_RA, c->mode, c->speed, STEPPER_CW);
+   stepper_set_period_fine(STEPPER_RA, c->period_fine);
+   stepper_set_target(STEPPER_RA, count + c->distance);
+   stepper_reset_isr_stats();
+
+   stepper_start(STEPPER_RA);
+   if(c->mode == STEPPER_TRACKING) {
+      sim_run_for(c->seconds * 1000000ULL);
+      stepper_stop_instant(STEPPER_RA);
+   }
+   while(stepper_busy(STEPPER_RA)) sim_run_for(1000);
+
+   uint32_t steps = stepper_get_count(STEPPER_RA) - count;
+   stepper_probe_S probe;
+   bool enabled = stepper_get_probe(STEPPER_RA, &probe);
+
+   // within a µs, allowing for the host being preempted now and then
+   uint32_t close = 0;
+   for(int i = 0; i < 4; i++) close += probe.hist[i];
+
+   printf("%-18s %8u %8u %8u %6u %6u %6u %8d %8d %8u\n", c->name, steps, probe.callbacks, probe.intervals,
+          probe.min_ns, probe.mean_ns, probe.max_ns, probe.early_ns, probe.late_ns, close);
+   if(!enabled || probe.intervals + 2 < steps || probe.min_ns > probe.mean_ns || probe.mean_ns > probe.max_ns ||
+      close < probe.intervals - probe.intervals / 100) {
+      printf("FAIL: %s\n", c->name);
+      return 1;
+   }
+   return 0;
+}
+
+int main(void) {
+   static const probe_case_S cases[] = {
+      {.name = "sidereal tracking", .mode = STEPPER_TRACKING, .speed = STEPPER_SLOW, .period_fine = 71803, .seconds = 60},
+      {.name = "fast slew",         .mode = STEPPER_TRACKING, .speed = STEPPER_FAST, .period_fine = 10 << 8, .seconds = 2},
+      {.name = "fast goto",         .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .period_fine = 10 << 8, .distance = 200000},
+   };
+   int fail = 0;
+
+   stepper_init();
+   xTaskCreate(stepper_task, "stepper", 4096, NULL, 12, NULL);
+   sim_run_for(1000);
+
+   printf("%-18s %8s %8s %8s %6s %6s %6s %8s %8s %8s\n", "", "steps", "isr", "intervals",
+          "min", "mean", "max", "early", "late", "<1us");
+   for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      fail |= probe_run(&cases[i]);
+
+   return fail;
+}
@@ -0,0 +1,81 @@
+// pushes numbered items through an spsc ring between two free running host
+// threads and checks none is lost, doubled or reordered, then has two tasks
+// hand calls to the motion task and checks every one ran there exactly once
+#include "sim.h"
+#include "spsc.h"
+#include "stepper.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ITEMS 200000
+#define CALLS 1000
+
+static spsc_S ring;
+static uint32_t popped, out_of_order;
+
+static void *ring_producer(void *args) {
+   (void) args;
+   for(uintptr_t i = 1; i <= ITEMS; i++) {
+      while(!spsc_push(&ring, (void*) i)) sched_yield();
+   }
+   return NULL;
+}
+
+static void *ring_consumer(void *args) {
+   (void) args;
+   uintptr_t expected = 1;
+   while(expected <= ITEMS) {
+      void *item = spsc_pop(&ring);
+      if(!item) {
+         sched_yield();
+         continue;
+      }
+      if((uintptr_t) item != expected) out_of_order++;
+      expected = (uintptr_t) item + 1;
+      popped++;
+   }
+   return NULL;
+}
+
+static TaskHandle_t motion;
+static uint32_t calls[2], wrong_task, done;
+
+static void count_call(void *arg) {
+   if(xTaskGetCurrentTaskHandle() != motion) wrong_task++;
+   (*(uint32_t*) arg)++;
+}
+
+static void caller_task(void *arg) {
+   for(int i = 0; i < CALLS; i++) {
+      stepper_call(count_call, arg);
+      if(i % 100 == 0) vTaskDelay(1);
+   }
+   done++;
+   vTaskDelete(NULL);
+}
+
+int main(void) {
+   pthread_t producer, consumer;
+   pthread_create(&consumer, NULL, ring_consumer, NULL);
+   pthread_create(&producer, NULL, ring_producer, NULL);
+   pthread_join(producer, NULL);
+   pthread_join(consumer, NULL);
+   printf("ring: %u of %u items, %u out of order\n", popped, ITEMS, out_of_order);
+
+   xTaskCreate(stepper_task, "stepper", 4096, NULL, 12, &motion);
+   xTaskCreate(caller_task, "uart", 4096, &calls[0], 11, NULL);
+   xTaskCreate(caller_task, "server", 4096, &calls[1], 10, NULL);
+   for(int i = 0; i < 100 && done < 2; i++) sim_run_for(10000);
+   printf("calls: %u and %u of %u, %u off the motion task\n", calls[0], calls[1], CALLS, wrong_task);
+
+   if(popped != ITEMS || out_of_order || calls[0] != CALLS || calls[1] != CALLS || wrong_task) {
+      printf("FAIL\n");
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,100 @@
+// changes T1 on a running tracking axis and checks the axis keeps running,
+// no step is shorter than the faster rate allows and large changes ramp
+#include "sim.h"
+#include "stepper.h"
+
+#include <stdio.h>
+
+static const gpio_num_t RA_STEP = GPIO_NUM_14;
+static const uint64_t TICK_NS = 1000000000ULL / (STEPPER_FREQ * 10);
+
+typedef struct {
+   uint64_t last_edge;
+   uint64_t min_interval;
+   uint64_t max_interval;
+   uint64_t last_interval;
+} rate_run_S;
+
+static void rate_edge(gpio_num_t gpio, void *ctx) {
+   rate_run_S *run = ctx;
+   uint64_t now = sim_now();
+
+   if(run->last_edge) {
+      uint64_t interval = now - run->last_edge;
+      if(interval < run->min_interval) run->min_interval = interval;
+      if(interval > run->max_interval) run->max_interval = interval;
+      run->last_interval = interval;
+   }
+   run->last_edge = now;
+}
+
+// switches from T1 from to T1 to, both in 24.8, and reports the time taken to settle
+static int rate_change(const char *name, stepper_speed_E speed, uint32_t from, uint32_t to, double expected_s) {
+   rate_run_S run = {0};
+   uint64_t from_ns = from * 10 * TICK_NS / (speed == STEPPER_FAST ? STEPPER_FAST_RATIO : 1) >> 8;
+   uint64_t to_ns = to * 10 * TICK_NS / (speed == STEPPER_FAST ? STEPPER_FAST_RATIO : 1) >> 8;
+   uint64_t min_ns = from_ns < to_ns ? from_ns : to_ns;
+   uint64_t max_ns = from_ns > to_ns ? from_ns : to_ns;
+
+   stepper_set_mode(STEPPER_RA, STEPPER_TRACKING, speed, STEPPER_CW);
+   stepper_set_period_fine(STEPPER_RA, from);
+   stepper_start(STEPPER_RA);
+   sim_run_for(2000000);
+
+   sim_gpio_watch(RA_STEP, rate_edge, &run);
+   run.min_interval = UINT64_MAX;
+
+   uint64_t start = sim_now();
+   stepper_set_period_fine(STEPPER_RA, to);
+
+   // settled once steps come at the new rate, give or take the tick rounding, which shows
+   // only once the step in flight and the first new one have gone out
+   uint64_t settled = 0;
+   bool running = true;
+   while(sim_now() - start < (expected_s * 2 + 0.5) * 1e9) {
+      sim_run_for(1000);
+      running &= stepper_busy(STEPPER_RA);
+      bool at_rate = run.last_interval + TICK_NS >= to_ns && run.last_interval <= to_ns + TICK_NS;
+      if(!at_rate) settled = 0;
+      else if(!settled) settled = sim_now();
+   }
+   sim_gpio_unwatch(RA_STEP, rate_edge, &run);
+
+   stepper_stop(STEPPER_RA);
+   while(stepper_busy(STEPPER_RA)) sim_run_for(1000);
+
+   double settle_s = settled ? (settled - start) / 1e9 : -1;
+   printf("%-24s %10.1f %10.1f %10.3f %10.3f\n", name, 1e9 / from_ns, 1e9 / to_ns, settle_s, expected_s);
+
+   // a shortened pulse would show up as an interval below the faster of the two rates
+   if(!running || !settled || run.min_interval + TICK_NS < min_ns || run.max_interval > max_ns + TICK_NS ||
+      settle_s > expected_s * 1.2 + 2 * max_ns / 1e9) {
+      printf("FAIL: %s, running %d min %.1f us max %.1f us\n",
+             name, running, run.min_interval / 1e3, run.max_interval / 1e3);
+      return 1;
+   }
+   return 0;
+}
+
+int main(void) {
+   int fail = 0;
+
+   stepper_init();
+
+   printf("%-24s %10s %10s %10s %10s\n", "", "from", "to", "settle", "ramp");
+   printf("%-24s %10s %10s %10s %10s\n", "", "step/s", "step/s", "s", "s");
+
+   // rates below the first ramp step switch over at once
+   fail |= rate_change("sidereal to solar", STEPPER_SLOW, 71803, 72000, 0);
+   fail |= rate_change("solar to sidereal", STEPPER_SLOW, 72000, 71803, 0);
+   fail |= rate_change("guide 2x", STEPPER_SLOW, 71803, 71803 / 2, 0);
+
+   // large changes follow the acceleration, (v1 - v0) / a
+   double a = STEPPER_DEFAULT_ACCEL;
+   fail |= rate_change("slew 100 to 16000", STEPPER_FAST, 1600 << 8, 10 << 8, (16000 - 100) / a);
+   fail |= rate_change("slew 1600 to 16000", STEPPER_FAST, 100 << 8, 10 << 8, (16000 - 1600) / a);
+   fail |= rate_change("slew 16000 to 1600", STEPPER_FAST, 10 << 8, 100 << 8, (16000 - 1600) / a);
+   fail |= rate_change("slew 8000 to 8421", STEPPER_FAST, 20 << 8, 19 << 8, (8421 - 8000) / a);
+
+   return fail;
+}
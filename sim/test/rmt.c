@@ -0,0 +1,134 @@
+// runs RA streamed through the RMT side by side with DE on MCPWM and checks
+// both make the same steps at the same time, gotos land on the target and the
+// stream kept up without gaps or steps the pulse counter did not see
+#include "sim.h"
+#include "stepper.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// a stop reaches an RMT axis after the two segments and the channel memory already queued,
+// 100 ms at tracking rates and two full segments plus the memory at slew rates
+#define STOP_LAG 8
+#define SLEW_STOP_LAG (2 * 512 + 64)
+
+typedef enum {
+   END_GOTO,    // runs until the target
+   END_STOP,    // stepper_stop after seconds
+   END_INSTANT, // stepper_stop_instant after seconds
+   END_GUIDE,   // a pulse guide cancelling tracking, then stepper_stop
+} rmt_end_E;
+
+typedef struct {
+   const char *name;
+   stepper_mode_E mode;
+   stepper_speed_E speed;
+   stepper_dir_E dir;
+   uint32_t period_fine; // T1 in 24.8 fixed point
+   uint32_t distance;    // steps for gotos
+   uint32_t brake;
+   rmt_end_E end;
+   uint32_t seconds;
+   uint32_t tolerance;   // steps the axes may differ by
+} rmt_case_S;
+
+static int rmt_run(const rmt_case_S *c) {
+   uint32_t start[STEPPER_COUNT];
+   uint64_t done[STEPPER_COUNT] = {0};
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      start[stepper] = stepper_get_count(stepper);
+      stepper_set_mode(stepper, c->mode, c->speed, c->dir);
+      stepper_set_period_fine(stepper, c->period_fine);
+      stepper_set_brake(stepper, c->brake);
+      stepper_set_guide(stepper, STEPPER_GUIDE_1X);
+      stepper_set_target(stepper, start[stepper] + (c->dir == STEPPER_CW ? c->distance : -c->distance));
+   }
+   stepper_reset_isr_stats();
+
+   uint64_t begin = sim_now();
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      stepper_start(stepper);
+
+   if(c->end != END_GOTO) {
+      sim_run_for(c->seconds * 1000000ULL);
+      if(c->end == END_GUIDE) {
+         for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+            stepper_pulse_guide(stepper, !c->dir, 2000);
+         sim_run_for(4000000);
+      }
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+         if(c->end == END_INSTANT)
+            stepper_stop_instant(stepper);
+         else
+            stepper_stop(stepper);
+      }
+   }
+
+   while(!done[STEPPER_RA] || !done[STEPPER_DE]) {
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+         if(!done[stepper] && !stepper_busy(stepper))
+            done[stepper] = sim_now() - begin;
+      }
+      sim_run_for(100);
+   }
+   sim_run_for(20000); // let stepper_task account the stream
+
+   uint32_t steps[STEPPER_COUNT];
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      uint32_t moved = stepper_get_count(stepper) - start[stepper];
+      steps[stepper] = c->dir == STEPPER_CW ? moved : -moved;
+   }
+
+   stepper_rmt_stats_S rmt, none;
+   uint32_t isr_ra, isr_de, load;
+   bool streamed = stepper_get_rmt_stats(STEPPER_RA, &rmt);
+   bool mcpwm = !stepper_get_rmt_stats(STEPPER_DE, &none);
+   stepper_get_isr_stats(STEPPER_RA, &isr_ra, &load);
+   stepper_get_isr_stats(STEPPER_DE, &isr_de, &load);
+   int64_t lag = (int64_t) done[STEPPER_RA] - (int64_t) done[STEPPER_DE];
+
+   printf("%-18s %8u %8u %8.1f %8u %8u %8u %8u %8u\n", c->name, steps[STEPPER_RA], steps[STEPPER_DE], lag / 1e6,
+          rmt.segments, rmt.underruns, rmt.slips, isr_ra, isr_de);
+
+   bool fail = !streamed || !mcpwm || rmt.underruns || rmt.slips ||
+               abs((int32_t) (steps[STEPPER_RA] - steps[STEPPER_DE])) > (int32_t) c->tolerance;
+   if(c->end == END_GOTO) {
+      // on the target and done within a step of each other
+      uint64_t step_ns = (uint64_t) c->period_fine * 1000000000ULL / 256 / STEPPER_FREQ;
+      if(c->speed == STEPPER_FAST) step_ns /= STEPPER_FAST_RATIO;
+      fail |= steps[STEPPER_RA] != c->distance || steps[STEPPER_DE] != c->distance;
+      fail |= (uint64_t) llabs(lag) > step_ns + 100000;
+      fail |= rmt.segments > 1 + steps[STEPPER_RA] / 16;
+   }
+   if(fail)
+      printf("FAIL: %s\n", c->name);
+   return fail;
+}
+
+int main(void) {
+   static const rmt_case_S cases[] = {
+      {.name = "fast goto",      .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CW,  .period_fine = 10 << 8,  .distance = 60000},
+      {.name = "braking goto",   .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CCW, .period_fine = 10 << 8,  .distance = 40000, .brake = 5000},
+      {.name = "slow goto",      .mode = STEPPER_GOTO,     .speed = STEPPER_SLOW, .dir = STEPPER_CCW, .period_fine = 10 << 8,  .distance = 3000},
+      {.name = "short goto",     .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CW,  .period_fine = 10 << 8,  .distance = 7},
+      {.name = "tracking",       .mode = STEPPER_TRACKING, .speed = STEPPER_SLOW, .dir = STEPPER_CW,  .period_fine = 71803,    .end = END_STOP,    .seconds = 60, .tolerance = STOP_LAG},
+      {.name = "guided tracking",.mode = STEPPER_TRACKING, .speed = STEPPER_SLOW, .dir = STEPPER_CW,  .period_fine = 71803,    .end = END_GUIDE,   .seconds = 2,  .tolerance = STOP_LAG},
+      {.name = "slew stop",      .mode = STEPPER_TRACKING, .speed = STEPPER_FAST, .dir = STEPPER_CCW, .period_fine = 10 << 8,  .end = END_STOP,    .seconds = 2,  .tolerance = SLEW_STOP_LAG},
+      {.name = "slew cut",       .mode = STEPPER_TRACKING, .speed = STEPPER_FAST, .dir = STEPPER_CW,  .period_fine = 10 << 8,  .end = END_INSTANT, .seconds = 1,  .tolerance = 4},
+      {.name = "goto after cut", .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CCW, .period_fine = 10 << 8,  .distance = 30000},
+   };
+   int fail = 0;
+
+   stepper_init();
+   xTaskCreate(stepper_task, "stepper", 4096, NULL, 12, NULL);
+   sim_run_for(1000);
+
+   printf("%-18s %8s %8s %8s %8s %8s %8s %8s %8s\n", "", "RA steps", "DE steps", "lag ms",
+          "segments", "underrun", "slips", "RA isr", "DE isr");
+   for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      fail |= rmt_run(&cases[i]);
+
+   return fail;
+}
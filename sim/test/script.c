@@ -0,0 +1,297 @@
+// loads motion scripts through the SynScan extension commands and checks a
+// mosaic of joint gotos and exposures runs back to back on target with the
+// aux output open for each exposure, rate moves roll into each other without
+// stopping, a joint move waits for the other axis, a full script refuses more
+// moves and a stop drops the rest
+#include "sim.h"
+#include "stepper.h"
+#include "synscan.h"
+#include "trace.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAMES 3
+#define EXPOSURE_MS 500
+#define BURST_GAP_NS 100000000ULL // steps further apart than this start a new move
+
+// the pins in stepper.c
+static const gpio_num_t STEP_PINS[STEPPER_COUNT] = {GPIO_NUM_14, GPIO_NUM_15};
+static const gpio_num_t AUX = GPIO_NUM_16;
+
+static const uint8_t HEX[16] = "0123456789ABCDEF";
+
+static uint64_t last_step, bursts[FRAMES + 1]; // last_step 0 before the first
+static uint32_t burst_count;
+static uint64_t exposures[FRAMES];
+static uint64_t exposure_lag[FRAMES]; // from the last step of the goto, the axis stops a step period later
+static uint32_t exposure_count[FRAMES][STEPPER_COUNT];
+static uint32_t exposure_total;
+
+static void script_step(gpio_num_t gpio, void *ctx) {
+   if((!last_step || sim_now() - last_step > BURST_GAP_NS) && burst_count < FRAMES + 1)
+      bursts[burst_count++] = sim_now();
+   last_step = sim_now();
+}
+
+static void script_aux(gpio_num_t gpio, void *ctx) {
+   if(exposure_total >= FRAMES)
+      return;
+   exposures[exposure_total] = sim_now();
+   exposure_lag[exposure_total] = sim_now() - last_step;
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      exposure_count[exposure_total][stepper] = stepper_get_count(stepper);
+   exposure_total++;
+}
+
+// least significant byte first, as the protocol sends all numbers
+static char *script_hex(char *out, uint32_t value, int digits) {
+   for(int i = 0; i + 1 < digits; i += 2, value >>= 8) {
+      *out++ = HEX[value >> 4 & 0xF];
+      *out++ = HEX[value & 0xF];
+   }
+   *out = '\0';
+   return out;
+}
+
+static uint32_t script_unhex(const char *in, int digits) {
+   uint32_t value = 0;
+   for(int i = digits - 2; i >= 0; i -= 2) {
+      char byte[3] = {in[i], in[i + 1], '\0'};
+      value = value << 8 | strtoul(byte, NULL, 16);
+   }
+   return value;
+}
+
+// the reply to the last command of the line
+static const char *script_send(const char *line) {
+   static ss_parser_S parser = {.transport = SS_TRANSPORT_UART};
+   static char reply[sizeof(parser.data) + 1];
+   reply[0] = '\0';
+   for(const char *c = line; *c; c++) {
+      size_t len = ss_handle_byte(&parser, *c);
+      if(len) {
+         memcpy(reply, parser.data, len);
+         reply[len] = '\0';
+      }
+   }
+   return reply;
+}
+
+static const char *script_queue(char channel, uint32_t flags, uint32_t value, uint32_t period_fine) {
+   char line[32] = {':', 'Q', channel};
+   char *end = script_hex(script_hex(line + 3, flags, 2), value, 6);
+   if(period_fine)
+      end = script_hex(end, period_fine, 8);
+   strcpy(end, "\r");
+   return script_send(line);
+}
+
+// moves queued and done and the flags of an axis from ':y'
+static void script_status(char channel, uint32_t *queued, uint32_t *done, uint32_t *flags) {
+   char line[] = {':', 'y', channel, '\r', '\0'};
+   const char *reply = script_send(line);
+   *queued = script_unhex(reply + 1, 2);
+   *done = script_unhex(reply + 3, 6);
+   *flags = script_unhex(reply + 9, 2);
+}
+
+// joint gotos to the frames of a mosaic, each followed by an exposure with the aux output on, off at the end
+static int script_mosaic(void) {
+   static const int32_t OFFSETS[FRAMES][STEPPER_COUNT] = {{40000, -30000}, {80000, 0}, {120000, 30000}};
+   uint32_t start[STEPPER_COUNT], target[FRAMES][STEPPER_COUNT];
+   int fail = 0;
+
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      start[stepper] = stepper_get_count(stepper);
+   for(int frame = 0; frame < FRAMES; frame++) {
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+         target[frame][stepper] = start[stepper] + OFFSETS[frame][stepper];
+         const char *reply = script_queue('1' + stepper, 0x58, target[frame][stepper] + 0x800000, 10 << 8);
+         fail |= strcmp(reply, "=\r") != 0;
+      }
+      fail |= strcmp(script_queue('3', 0x62, EXPOSURE_MS, 0), "=\r") != 0;
+   }
+   fail |= strcmp(script_queue('3', 0x52, 0, 0), "=\r") != 0;
+
+   uint64_t begin = sim_now();
+   fail |= strcmp(script_send(":Y31\r"), "=\r") != 0;
+
+   uint32_t queued, done, flags;
+   do {
+      sim_run_for(10000);
+      script_status('1', &queued, &done, &flags);
+   } while(queued && sim_now() - begin < 120000000000ULL);
+   double seconds = (sim_now() - begin) / 1e9;
+
+   uint32_t de_queued, de_done, de_flags;
+   script_status('2', &de_queued, &de_done, &de_flags);
+   fail |= queued || de_queued || done != 2 * FRAMES + 1 || de_done != 2 * FRAMES + 1 || !(flags & 1) || (flags & 4);
+
+   printf("mosaic, %d frames in %.2f s, %u and %u moves done\n", FRAMES, seconds, done, de_done);
+   printf("%-8s %10s %10s %12s %12s %8s\n", "frame", "RA", "DE", "stop ms", "resume ms", "target");
+   for(int frame = 0; frame < FRAMES; frame++) {
+      bool on_target = frame < (int) exposure_total &&
+                       exposure_count[frame][STEPPER_RA] == target[frame][STEPPER_RA] &&
+                       exposure_count[frame][STEPPER_DE] == target[frame][STEPPER_DE];
+      // the next goto starts as the exposure ends, its first step a ramp period or so later
+      double resume = frame + 1 < FRAMES ? (bursts[frame + 1] - exposures[frame]) / 1e6 - EXPOSURE_MS : 0;
+      printf("%-8d %10d %10d %12.3f %12.3f %8s\n", frame, OFFSETS[frame][STEPPER_RA], OFFSETS[frame][STEPPER_DE],
+             exposure_lag[frame] / 1e6, resume, on_target ? "ok" : "missed");
+      fail |= !on_target || exposure_lag[frame] > 10000000 || resume < 0 || resume > 20;
+   }
+   fail |= exposure_total != FRAMES || burst_count != FRAMES;
+
+   // the script waits for more, a stop ends it
+   fail |= strcmp(script_send(":K3\r"), "=\r") != 0;
+   script_status('1', &queued, &done, &flags);
+   fail |= flags & 1;
+
+   if(fail)
+      printf("FAIL: mosaic\n");
+   return fail;
+}
+
+// two rate moves the same way roll into each other, the axis only stops after the second
+static int script_rates(void) {
+   static const uint32_t PERIODS[] = {40 << 8, 100 << 8};
+   static const uint32_t MS[] = {1500, 1000};
+   int fail = 0;
+
+   uint32_t count = stepper_get_count(STEPPER_RA);
+   double expected = 0;
+   for(int i = 0; i < 2; i++) {
+      stepper_move_S move = {.type = STEPPER_MOVE_RATE, .dir = STEPPER_CW, .period_fine = PERIODS[i], .ms = MS[i]};
+      fail |= !stepper_script_add(STEPPER_RA, &move);
+      expected += STEPPER_FREQ * 256.0 / PERIODS[i] * MS[i] / 1000;
+   }
+   stepper_move_S dwell = {.type = STEPPER_MOVE_DWELL};
+   fail |= !stepper_script_add(STEPPER_RA, &dwell);
+   fail |= !stepper_script_run(STEPPER_RA);
+
+   uint32_t stops = 0;
+   bool busy = false;
+   stepper_script_status_S status;
+   uint64_t begin = sim_now();
+   do {
+      sim_tasks_run();
+      if(busy && !stepper_busy(STEPPER_RA))
+         stops++;
+      busy = stepper_busy(STEPPER_RA);
+      stepper_get_script(STEPPER_RA, &status);
+      sim_run_for(100);
+   } while(status.queued && sim_now() - begin < 10000000000ULL);
+
+   int32_t steps = stepper_get_count(STEPPER_RA) - count;
+   printf("rates, %d steps for %.1f expected, %u stops, T1 %u\n", steps, expected, stops,
+          stepper_get_period_fine(STEPPER_RA));
+   fail |= status.done != 3 || stops != 1 || abs(steps - (int32_t) expected) > 4 ||
+           stepper_get_period_fine(STEPPER_RA) != PERIODS[1];
+
+   stepper_script_clear(STEPPER_RA);
+   if(fail)
+      printf("FAIL: rates\n");
+   return fail;
+}
+
+// a joint goto waits while the other axis runs a move of its own before its joint goto
+static int script_mixed(void) {
+   uint32_t start[STEPPER_COUNT], target[STEPPER_COUNT];
+   int fail = 0;
+
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      start[stepper] = stepper_get_count(stepper);
+      target[stepper] = start[stepper] + 20000;
+   }
+   stepper_move_S rate = {.type = STEPPER_MOVE_RATE, .dir = STEPPER_CW, .period_fine = 40 << 8, .ms = 1000};
+   fail |= !stepper_script_add(STEPPER_DE, &rate);
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      stepper_move_S move = {.type = STEPPER_MOVE_GOTO, .speed = STEPPER_FAST, .period_fine = 10 << 8,
+                             .target = target[stepper], .joint = true};
+      fail |= !stepper_script_add(stepper, &move);
+   }
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      fail |= !stepper_script_run(stepper);
+
+   // RA waits out the rate move of DE
+   sim_run_for(900000);
+   stepper_script_status_S ra, de;
+   stepper_get_script(STEPPER_RA, &ra);
+   bool waited = stepper_get_count(STEPPER_RA) == start[STEPPER_RA] && ra.waiting && stepper_busy(STEPPER_DE);
+
+   uint64_t begin = sim_now();
+   do {
+      sim_run_for(10000);
+      stepper_get_script(STEPPER_RA, &ra);
+      stepper_get_script(STEPPER_DE, &de);
+   } while((ra.queued || de.queued) && sim_now() - begin < 30000000000ULL);
+
+   bool on_target = stepper_get_count(STEPPER_RA) == target[STEPPER_RA] && stepper_get_count(STEPPER_DE) == target[STEPPER_DE];
+   printf("mixed, RA %s, %u and %u queued, %s\n", waited ? "waited" : "did not wait", ra.queued, de.queued,
+          on_target ? "on target" : "missed");
+   fail |= !waited || ra.queued || de.queued || ra.done != 1 || de.done != 2 || !on_target;
+
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      stepper_script_clear(stepper);
+   if(fail)
+      printf("FAIL: mixed\n");
+   return fail;
+}
+
+// a full script refuses the next move, a stop drops the goto running and what follows
+static int script_limits(void) {
+   int fail = 0;
+   uint32_t queued, done, flags;
+
+   for(int i = 0; i < STEPPER_SCRIPT_MOVES; i++)
+      fail |= strcmp(script_queue('2', 0x02, 1000, 0), "=\r") != 0;
+   fail |= strcmp(script_queue('2', 0x02, 1000, 0), "!2\r") != 0;
+   fail |= strcmp(script_queue('2', 0x03, 1000, 0), "!3\r") != 0;
+   script_status('2', &queued, &done, &flags);
+   fail |= queued != STEPPER_SCRIPT_MOVES;
+   fail |= strcmp(script_send(":Y20\r"), "=\r") != 0;
+   script_status('2', &queued, &done, &flags);
+   fail |= queued != 0;
+
+   uint32_t count = stepper_get_count(STEPPER_DE);
+   script_queue('2', 0x08, count + 2000000 + 0x800000, 10 << 8);
+   script_queue('2', 0x22, 1000, 0);
+   fail |= strcmp(script_send(":Y21\r"), "=\r") != 0;
+   sim_run_for(300000);
+   bool moving = stepper_busy(STEPPER_DE);
+   fail |= strcmp(script_send(":L2\r"), "=\r") != 0;
+   while(stepper_busy(STEPPER_DE))
+      sim_run_for(1000);
+   sim_run_for(10000);
+   script_status('2', &queued, &done, &flags);
+   printf("limits, %u queued and flags %02X after the stop\n", queued, flags);
+   fail |= !moving || queued || (flags & 5);
+
+   fail |= strcmp(script_send(":O11\r"), "=\r") != 0 || !stepper_get_aux();
+   fail |= strcmp(script_send(":O10\r"), "=\r") != 0 || stepper_get_aux();
+
+   if(fail)
+      printf("FAIL: limits\n");
+   return fail;
+}
+
+int main(void) {
+   int fail = 0;
+
+   trace_init();
+   stepper_init();
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      sim_gpio_watch(STEP_PINS[stepper], script_step, NULL);
+   sim_gpio_watch(AUX, script_aux, NULL);
+   xTaskCreate(stepper_task, "stepper", 4096, NULL, 12, NULL);
+   sim_run_for(1000);
+
+   fail |= script_mosaic();
+   fail |= script_rates();
+   fail |= script_mixed();
+   fail |= script_limits();
+   return fail;
+}
@@ -0,0 +1,176 @@
+// talks to the UDP server over the host loopback: commands sharing a
+// datagram are answered in one datagram, queued datagrams are all answered
+// on one wakeup, oversized ones are dropped and counted and several clients
+// get a parser each, also over TCP, the +STATS counters add up and the
+// trace has the commands, without the arguments of AT commands
+#include "sim.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WAKEUP_US 2000 // the sim looks at the socket every ms
+
+void app_main(void);
+
+#define CLIENTS 5 // one more than the server has sessions
+
+static int socks[CLIENTS];
+static int sock;
+static struct sockaddr_in server = {.sin_family = AF_INET};
+
+static void send_str(const char *data, size_t len) {
+   sendto(sock, data, len, 0, (struct sockaddr*) &server, sizeof(server));
+}
+
+// datagrams that arrived within one wakeup, concatenated with '|' in between
+static int receive_all(char *buf, size_t size) {
+   usleep(1000);
+   sim_run_for(WAKEUP_US);
+   size_t len = 0;
+   int count = 0;
+   for(;;) {
+      ssize_t n = recv(sock, buf + len, size - len - 2, MSG_DONTWAIT);
+      if(n < 0) break;
+      len += n;
+      buf[len++] = '|';
+      count++;
+   }
+   buf[len] = '\0';
+
+   // readable in the output
+   for(char *c = buf; *c; c++) {
+      if(*c == '\r') *c = '~';
+      if(*c == '\n') *c = ' ';
+   }
+   return count;
+}
+
+static bool check(const char *name, bool ok, const char *got) {
+   printf("%-20s %s %s\n", name, ok ? "ok  " : "FAIL", got);
+   return ok;
+}
+
+int main(void) {
+   char buf[2048];
+   bool ok = true;
+
+   app_main();
+   sim_run_for(100000);
+
+   for(int i = 0; i < CLIENTS; i++) socks[i] = socket(AF_INET, SOCK_DGRAM, 0);
+   sock = socks[0];
+   server.sin_port = htons(11880);
+   server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   // a status poll in one datagram
+   send_str(":e1\r:e2\r:a1\r:f1\r", 16);
+   int count = receive_all(buf, sizeof(buf));
+   ok &= check("coalesced", count == 1 && strncmp(buf, "=030000~=030000~", 16) == 0 && strchr(buf, '|') == buf + strlen(buf) - 1, buf);
+
+   // both axes in one reply
+   send_str(":Z3\r", 4);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("status", count == 1 && strlen(buf) == 47 && buf[0] == '=', buf);
+
+   // separate datagrams queued before the server wakes up
+   send_str(":e1\r", 4);
+   send_str(":j1\r", 4);
+   send_str(":j2\r", 4);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("drained", count == 3 && strncmp(buf, "=030000~|", 9) == 0, buf);
+
+   // a datagram over the receive buffer, then ask for the counter
+   char big[600];
+   memset(big, ':', sizeof(big));
+   send_str(big, sizeof(big));
+   send_str("+UDP?\r", 6);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("dropped", count == 1 && strcmp(buf, "+UDP:1,1,0~ OK~ |") == 0, buf);
+
+   // a command split over datagrams with another client's command in between
+   send_str(":e", 2);
+   sock = socks[1];
+   send_str(":j1\r", 4);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("interleaved other", count == 1 && buf[0] == '=' && strcmp(buf, "=030000~|") != 0, buf);
+   sock = socks[0];
+   send_str("1\r", 2);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("interleaved first", count == 1 && strcmp(buf, "=030000~|") == 0, buf);
+
+   send_str("+UDP?0\r", 7);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("session", count == 1 && strncmp(buf, "+UDP0:127.0.0.1:", 16) == 0 && strstr(buf, ",0,10,10,1~"), buf);
+
+   // every slot active, the least recently used one goes
+   for(int i = 2; i < CLIENTS; i++) {
+      sock = socks[i];
+      send_str(":e1\r", 4);
+      receive_all(buf, sizeof(buf));
+   }
+   sock = socks[0];
+   send_str("+UDP?\r", 6);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("evicted", count == 1 && strcmp(buf, "+UDP:1,4,1~ OK~ |") == 0, buf);
+
+   // commands split across TCP segments, one connection too many
+   int conns[4];
+   for(int i = 0; i < 4; i++) {
+      conns[i] = socket(AF_INET, SOCK_STREAM, 0);
+      connect(conns[i], (struct sockaddr*) &server, sizeof(server));
+   }
+   usleep(1000);
+   sim_run_for(WAKEUP_US);
+   sock = conns[0];
+   send(sock, ":e1\r:j", 7, 0);
+   usleep(1000);
+   sim_run_for(WAKEUP_US);
+   send(sock, "1\r+TCP?\r", 9, 0);
+   count = receive_all(buf, sizeof(buf));
+   ok &= check("tcp", count >= 1 && strncmp(buf, "=030000~=", 9) == 0 && strstr(buf, "+TCP:3,3,1~ OK~ "), buf);
+
+   usleep(1000);
+   ok &= check("tcp rejected", recv(conns[3], buf, sizeof(buf), MSG_DONTWAIT) == 0, "");
+
+   // a command that lost its end, an unknown one, then the counters of each transport
+   send(sock, ":e1:j1\r:x1\r+STATS?\r+STATS?2E\r+STATS?2Cj\r", 40, 0);
+   receive_all(buf, sizeof(buf));
+   ok &= check("stats", strstr(buf, "=000080~!0~+STATS:0,0,0,0;") && strstr(buf, ";5,1,0,1~ OK~ ") &&
+                        strstr(buf, "+STATS2E:1,0,0,0,0,0~ OK~ ") && strstr(buf, "+STATS2Cj:2~ OK~ "), buf);
+
+   send(sock, "+STATS=0\r+STATS?\r", 17, 0);
+   receive_all(buf, sizeof(buf));
+   ok &= check("stats reset", strstr(buf, "+STATS:0,0,0,0;0,0,0,0;1,0,0,0~ OK~ ") != NULL, buf);
+
+   // the trace holds the command and reply as they went over the wire, a +TRACE? only goes
+   // into it after its reply, so :e1 is the last record it reports
+   send(sock, ":e1\r+TRACE?\r", 12, 0);
+   receive_all(buf, sizeof(buf));
+   unsigned oldest = 0, next = 0;
+   char *range = strstr(buf, "+TRACE:");
+   ok &= check("trace range", range && sscanf(range, "+TRACE:%u,%u", &oldest, &next) == 2 && next >= 1 && oldest < next, buf);
+
+   char query[32];
+   int query_len = snprintf(query, sizeof(query), "+TRACE?%u\r", next - 1);
+   send(sock, query, query_len, 0);
+   receive_all(buf, sizeof(buf));
+   ok &= check("trace record", strstr(buf, ",2,127.0.0.1:") && strstr(buf, ",:e1%0D,=030000%0D~ OK~ "), buf);
+
+   // the WiFi password never goes into the trace
+   const char *join = "+CWJAP=\"scope\",\"secret\"\r+TRACE?\r";
+   send(sock, join, strlen(join), 0);
+   receive_all(buf, sizeof(buf));
+   range = strstr(buf, "+TRACE:");
+   ok &= check("trace at range", range && sscanf(range, "+TRACE:%u,%u", &oldest, &next) == 2 && next >= 1, buf);
+   query_len = snprintf(query, sizeof(query), "+TRACE?%u\r", next - 1);
+   send(sock, query, query_len, 0);
+   receive_all(buf, sizeof(buf));
+   ok &= check("trace at", strstr(buf, ",+CWJAP=,OK%0D%0A~ OK~ ") && !strstr(buf, "secret"), buf);
+
+   for(int i = 0; i < 4; i++) close(conns[i]);
+   for(int i = 0; i < CLIENTS; i++) close(socks[i]);
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// polls stepper_get_snapshot from a free running host thread while the sim
+// slews one axis across several pulse counter wraps and rewrites the other,
+// and counts snapshots whose fields could not have been true at the same time,
+// the sim also stops every microsecond to read the count between a pulse
+// counter wrap and its watch point callback
+#include "sim.h"
+#include "stepper.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define SPAN (4 * 8 * 0x7FFF) // steps, wraps the pulse counter several times even at the coarsest microstep scale
+#define WRITES_PER_RUN 256
+
+static atomic_bool done;
+static uint32_t reads, torn_count, torn_mode, torn_period;
+
+static void *snapshot_reader(void *args) {
+   (void) args;
+   uint32_t last = 0;
+   while(!atomic_load(&done)) {
+      stepper_snapshot_S ra, de;
+      stepper_get_snapshot(STEPPER_RA, &ra);
+      stepper_get_snapshot(STEPPER_DE, &de);
+      reads++;
+
+      // a cw slew never goes back
+      if(ra.count < last) torn_count++;
+      last = ra.count;
+
+      // the writer always sets these to all 0 or all 1
+      if((int) de.mode != (int) de.speed || (int) de.speed != (int) de.dir) torn_mode++;
+
+      // and the fraction to the low byte of T1
+      if((de.period_fine & 0xFF) != (de.period & 0xFF)) torn_period++;
+   }
+   return NULL;
+}
+
+int main(void) {
+   stepper_init();
+   stepper_set_count(STEPPER_RA, 0);
+   stepper_set_mode(STEPPER_RA, STEPPER_TRACKING, STEPPER_FAST, STEPPER_CW);
+   stepper_set_period(STEPPER_RA, 1);
+   stepper_start(STEPPER_RA);
+   stepper_set_mode(STEPPER_DE, STEPPER_GOTO, STEPPER_SLOW, STEPPER_CW);
+   stepper_set_period_fine(STEPPER_DE, 0);
+
+   pthread_t reader;
+   pthread_create(&reader, NULL, snapshot_reader, NULL);
+
+   uint32_t writes = 0, last = 0, torn_wrap = 0;
+   while(last < SPAN) {
+      for(int i = 0; i < WRITES_PER_RUN; i++, writes++) {
+         bool odd = writes & 1;
+         stepper_set_mode(STEPPER_DE, odd ? STEPPER_TRACKING : STEPPER_GOTO, odd ? STEPPER_FAST : STEPPER_SLOW, odd ? STEPPER_CCW : STEPPER_CW);
+         stepper_set_period_fine(STEPPER_DE, writes << 8 | (writes & 0xFF));
+      }
+      for(int i = 0; i < 100; i++) {
+         sim_run_for(1);
+         uint32_t count = stepper_get_count(STEPPER_RA);
+         if(count < last) torn_wrap++;
+         last = count;
+      }
+   }
+
+   atomic_store(&done, true);
+   pthread_join(reader, NULL);
+   stepper_stop_instant(STEPPER_RA);
+
+   printf("%u writes, %u reads, torn count %u mode %u period %u wrap %u\n", writes, reads, torn_count, torn_mode, torn_period, torn_wrap);
+   if(!reads || torn_count || torn_mode || torn_period || torn_wrap) {
+      printf("FAIL\n");
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,66 @@
+// feeds the UART in chunks: commands sharing a chunk, a command split over
+// two chunks, a baud rate change, a receive ring overflow and a WiFi mode
+// change that the wifi task applies after its quiet period
+#include "sim.h"
+
+#include <esp_wifi.h>
+
+#include <stdio.h>
+#include <string.h>
+
+void app_main(void);
+
+// everything the firmware wrote in reply to one chunk, \r and \n made readable
+static const char *exchange(const char *data, size_t len) {
+   static char buf[256];
+   sim_uart_rx(UART_NUM_0, data, len);
+   sim_run_for(1000);
+
+   size_t n = sim_uart_tx(UART_NUM_0, buf, sizeof(buf) - 1);
+   buf[n] = '\0';
+   for(char *c = buf; *c; c++) {
+      if(*c == '\r') *c = '~';
+      if(*c == '\n') *c = ' ';
+   }
+   return buf;
+}
+
+static bool check(const char *name, const char *got, const char *expected) {
+   bool ok = strcmp(got, expected) == 0;
+   printf("%-12s %s %s\n", name, ok ? "ok  " : "FAIL", got);
+   return ok;
+}
+
+int main(void) {
+   bool ok = true;
+   uint32_t baud = 0;
+
+   app_main();
+   sim_run_for(100000);
+
+   ok &= check("batched", exchange(":e1\r:e2\r:a1\r", 12), "=030000~=030000~=00004B~");
+   ok &= check("split", exchange(":e", 2), "");
+   ok &= check("split end", exchange("1\r", 2), "=030000~");
+
+   ok &= check("baud low", exchange("+BAUD=50\r", 9), "FAIL~");
+   ok &= check("baud", exchange("+BAUD=921600\r", 13), "OK~ ");
+   uart_get_baudrate(UART_NUM_0, &baud);
+   ok &= check("baud set", baud == 921600 ? "921600" : "other", "921600");
+
+   // more than the receive ring holds, the command cut off is lost
+   char flood[1100];
+   memset(flood, ':', sizeof(flood));
+   exchange(flood, sizeof(flood));
+   exchange("\r", 1);
+   ok &= check("overflow", exchange("+BAUD?\r", 7), "+BAUD:921600,1~ OK~ ");
+
+   wifi_mode_t mode;
+   ok &= check("wifi mode", exchange("+CWMODE=3\r", 10), "OK~ ");
+   esp_wifi_get_mode(&mode);
+   ok &= check("wifi quiet", mode == WIFI_MODE_AP ? "ap" : "other", "ap");
+   sim_run_for(1500000);
+   esp_wifi_get_mode(&mode);
+   ok &= check("wifi apply", mode == WIFI_MODE_APSTA ? "apsta" : "other", "apsta");
+
+   return ok ? 0 : 1;
+}
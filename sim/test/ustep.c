@@ -0,0 +1,117 @@
+// runs fast gotos, tracking and cut off slews while a model of the driver
+// translator follows the STEP, DIR and MS pins, and checks the axis goes
+// coarse at speed, is back at 1/32 when it stops, the driver never steps
+// from a position its resolution has not got and the count follows it
+#include "sim.h"
+#include "stepper.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+
+// the pins of RA in stepper.c
+static const gpio_num_t RA_STEP = GPIO_NUM_14;
+static const gpio_num_t RA_DIR = GPIO_NUM_12;
+static const gpio_num_t RA_MS[3] = {GPIO_NUM_21, GPIO_NUM_22, GPIO_NUM_23};
+
+// 1/32 microsteps per pulse, by stepper_ustep_E
+static const uint32_t USTEP_SCALES[] = {32, 16, 2, 1, 32, 16, 8, 4};
+
+typedef struct {
+   uint32_t position;  // 1/32 microsteps from the home state
+   uint32_t off_grid;  // pulses from a position the resolution has not got
+   uint32_t max_scale;
+} translator_S;
+
+static translator_S driver;
+
+static uint32_t translator_scale(void) {
+   stepper_ustep_E ustep = gpio_get_level(RA_MS[0]) | gpio_get_level(RA_MS[1]) << 1 | gpio_get_level(RA_MS[2]) << 2;
+   return USTEP_SCALES[ustep];
+}
+
+static void translator_step(gpio_num_t gpio, void *ctx) {
+   uint32_t scale = translator_scale();
+   if(driver.position % scale)
+      driver.off_grid++;
+   if(scale > driver.max_scale)
+      driver.max_scale = scale;
+   driver.position += gpio_get_level(RA_DIR) ? -scale : scale;
+}
+
+typedef struct {
+   const char *name;
+   stepper_mode_E mode;
+   stepper_speed_E speed;
+   stepper_dir_E dir;
+   uint32_t period_fine; // T1 in 24.8 fixed point
+   uint32_t distance;    // steps for gotos
+   uint32_t seconds;     // run time for tracking, then stepper_stop_instant
+   uint32_t set_count;   // count to load first, 0 to keep it
+   uint32_t max_scale;   // coarsest resolution expected
+} ustep_case_S;
+
+static int ustep_run(const ustep_case_S *c) {
+   if(c->set_count)
+      stepper_set_count(STEPPER_RA, c->set_count);
+
+   // the count and the driver may differ by a constant only
+   uint32_t start = stepper_get_count(STEPPER_RA);
+   uint32_t offset = start - driver.position;
+   uint32_t target = start + (c->dir == STEPPER_CW ? c->distance : -c->distance);
+   driver.off_grid = 0;
+   driver.max_scale = 0;
+
+   stepper_set_mode(STEPPER_RA, c->mode, c->speed, c->dir);
+   stepper_set_period_fine(STEPPER_RA, c->period_fine);
+   stepper_set_target(STEPPER_RA, target);
+
+   uint64_t begin = sim_now();
+   stepper_start(STEPPER_RA);
+   if(c->mode == STEPPER_TRACKING) {
+      sim_run_for(c->seconds * 1000000ULL);
+      stepper_stop_instant(STEPPER_RA);
+   }
+   while(stepper_busy(STEPPER_RA))
+      sim_run_for(100);
+   double seconds = (sim_now() - begin) / 1e9;
+
+   uint32_t count = stepper_get_count(STEPPER_RA);
+   uint32_t steps = c->dir == STEPPER_CW ? count - start : start - count;
+   bool lost = count - offset != driver.position;
+
+   printf("%-20s %9u %8.2f %10.0f %6u %8u %6s\n", c->name, steps, seconds, steps / seconds,
+          driver.max_scale, driver.off_grid, lost ? "lost" : "ok");
+
+   bool fail = lost || driver.off_grid || driver.max_scale != c->max_scale;
+   if(c->mode == STEPPER_GOTO)
+      fail |= count != target || translator_scale() != 1;
+   if(fail)
+      printf("FAIL: %s\n", c->name);
+   return fail;
+}
+
+int main(void) {
+   static const ustep_case_S cases[] = {
+      {.name = "slew goto",          .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CW,  .period_fine = 10 << 8, .distance = 200000, .max_scale = 1},
+      {.name = "fastest goto",       .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CW,  .period_fine = 1 << 8,  .distance = 2000000, .max_scale = 8},
+      {.name = "goto back",          .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CCW, .period_fine = 3 << 8,  .distance = 1234567, .max_scale = 4},
+      {.name = "goto after set",     .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CW,  .period_fine = 2 << 8,  .distance = 654321, .set_count = 0x123457, .max_scale = 8},
+      {.name = "short fast goto",    .mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CCW, .period_fine = 1 << 8,  .distance = 45, .max_scale = 1},
+      {.name = "slew cut",           .mode = STEPPER_TRACKING, .speed = STEPPER_FAST, .dir = STEPPER_CW,  .period_fine = 1 << 8,  .seconds = 2, .max_scale = 4},
+      {.name = "short goto from cut",.mode = STEPPER_GOTO,     .speed = STEPPER_FAST, .dir = STEPPER_CCW, .period_fine = 1 << 8,  .distance = 13, .max_scale = 1},
+      {.name = "tracking",           .mode = STEPPER_TRACKING, .speed = STEPPER_SLOW, .dir = STEPPER_CW,  .period_fine = 71803,   .seconds = 60, .max_scale = 1},
+   };
+   int fail = 0;
+
+   sim_gpio_watch(RA_STEP, translator_step, NULL);
+   stepper_init();
+   xTaskCreate(stepper_task, "stepper", 4096, NULL, 12, NULL);
+   sim_run_for(1000);
+
+   printf("%-20s %9s %8s %10s %6s %8s %6s\n", "", "steps", "s", "steps/s", "scale", "off grid", "count");
+   for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      fail |= ustep_run(&cases[i]);
+
+   return fail;
+}
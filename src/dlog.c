@@ -0,0 +1,191 @@
+#include "dlog.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sdkconfig.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DLOG_COUNT 32 // entries, a power of two
+#define DLOG_PERIOD_MS 100
+#define DLOG_LINE 160
+#define DLOG_LAP(pos) ((pos) & ~(uint32_t) (DLOG_COUNT - 1))
+
+// turn is the lap start, pos rounded down to DLOG_COUNT, while the slot is free for the writer at pos
+// and one more once written, so a zeroed ring is ready without an init and wraps with pos
+typedef struct {
+   uint32_t turn;
+   uint32_t time; // ms since boot
+   const char *fmt;
+   uint8_t module;
+   uint8_t level;
+   uint8_t nargs;
+   uint8_t len;
+   uintptr_t args[DLOG_ARGS];
+   uint8_t data[DLOG_BYTES];
+} dlog_entry_S;
+
+static const char *const TAGS[DLOG_MODULE_COUNT] = {
+   [DLOG_SERVER] = "server",
+   [DLOG_UART]   = "uart",
+};
+
+esp_log_level_t dlog_levels[DLOG_MODULE_COUNT] = {
+   [0 ... DLOG_MODULE_COUNT-1] = CONFIG_LOG_DEFAULT_LEVEL,
+};
+
+static dlog_entry_S entries[DLOG_COUNT];
+static uint32_t head; // next position to write, claimed by the writers
+static uint32_t tail; // next position to read, dlog_render only
+static uint32_t dropped;
+
+static size_t dlog_format(const dlog_entry_S*, char*, size_t);
+
+// never blocks, an entry that finds the ring full is counted and dropped
+void dlog_write(dlog_module_E module, esp_log_level_t level, const char *fmt, const void *data, size_t len, const uintptr_t *args, size_t nargs) {
+   uint32_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+   dlog_entry_S *entry;
+   for(;;) {
+      entry = &entries[pos % DLOG_COUNT];
+      uint32_t turn = __atomic_load_n(&entry->turn, __ATOMIC_ACQUIRE);
+      int32_t diff = turn - DLOG_LAP(pos);
+      if(diff == 0) {
+         if(__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else if(diff < 0) {
+         __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+         return;
+      } else {
+         pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+      }
+   }
+
+   entry->time = esp_timer_get_time() / 1000;
+   entry->fmt = fmt;
+   entry->module = module;
+   entry->level = level;
+   entry->nargs = nargs < DLOG_ARGS ? nargs : DLOG_ARGS;
+   entry->len = len < DLOG_BYTES ? len : DLOG_BYTES;
+   memcpy(entry->args, args, entry->nargs * sizeof(args[0]));
+   if(data) memcpy(entry->data, data, entry->len);
+   __atomic_store_n(&entry->turn, DLOG_LAP(pos) + 1, __ATOMIC_RELEASE);
+}
+
+// formats the oldest entry and frees its slot, false when there is none
+bool dlog_render(char *out, size_t size, esp_log_level_t *level, const char **tag) {
+   dlog_entry_S *entry = &entries[tail % DLOG_COUNT];
+   if(__atomic_load_n(&entry->turn, __ATOMIC_ACQUIRE) != DLOG_LAP(tail) + 1)
+      return false;
+
+   int len = snprintf(out, size, "[%lu] ", (unsigned long) entry->time);
+   if(len > 0 && (size_t) len < size) dlog_format(entry, out + len, size - len);
+   *level = entry->level;
+   *tag = TAGS[entry->module];
+
+   __atomic_store_n(&entry->turn, DLOG_LAP(tail) + DLOG_COUNT, __ATOMIC_RELEASE);
+   tail++;
+   return true;
+}
+
+// "*" sets every module, the level also goes to esp_log so the rendered lines pass
+bool dlog_level_set(const char *tag, esp_log_level_t level) {
+   bool all = strcmp(tag, "*") == 0;
+   bool found = all;
+   for(dlog_module_E module = 0; module < DLOG_MODULE_COUNT; module++) {
+      if(!all && strcmp(tag, TAGS[module]) != 0)
+         continue;
+      dlog_levels[module] = level;
+      if(!all) esp_log_level_set(TAGS[module], level);
+      found = true;
+   }
+   if(all) esp_log_level_set("*", level);
+   return found;
+}
+
+uint32_t dlog_dropped(void) {
+   return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+// prints what the other tasks logged, well away from their time critical paths
+void dlog_task(void *args) {
+   static char line[DLOG_LINE];
+   uint32_t reported = 0;
+   for(;;) {
+      esp_log_level_t level;
+      const char *tag;
+      while(dlog_render(line, sizeof(line), &level, &tag))
+         ESP_LOG_LEVEL(level, tag, "%s", line);
+
+      uint32_t lost = dlog_dropped();
+      if(lost != reported) {
+         ESP_LOGW("dlog", "%lu entries dropped", (unsigned long) (lost - reported));
+         reported = lost;
+      }
+      vTaskDelay(pdMS_TO_TICKS(DLOG_PERIOD_MS));
+   }
+}
+
+// printf for the stored arguments: %d %i %u %x %X %c %s %p with flags, width and precision,
+// and %.*s for the stored bytes
+static size_t dlog_format(const dlog_entry_S *entry, char *out, size_t size) {
+   size_t len = 0;
+   size_t arg = 0;
+   const char *f = entry->fmt;
+   while(*f && len + 1 < size) {
+      if(*f != '%') {
+         out[len++] = *f++;
+         continue;
+      }
+      if(f[1] == '%') {
+         out[len++] = '%';
+         f += 2;
+         continue;
+      }
+
+      // the conversion without its length modifier, printed with long arguments
+      char spec[16] = "%";
+      size_t spec_len = 1;
+      for(f++; *f && !strchr("diuxXcsp", *f); f++) {
+         if(*f != 'l' && *f != 'h' && *f != 'z' && *f != 'j' && *f != 't' && spec_len < sizeof(spec) - 3)
+            spec[spec_len++] = *f;
+      }
+      if(!*f)
+         break;
+      char type = *f++;
+
+      int n;
+      if(type == 's' && strcmp(spec, "%.*") == 0) {
+         n = snprintf(out + len, size - len, "%.*s", entry->len, entry->data);
+      } else {
+         uintptr_t value = arg < entry->nargs ? entry->args[arg] : 0;
+         arg++;
+         switch(type) {
+            case 'd': case 'i':
+               spec[spec_len++] = 'l'; spec[spec_len++] = type; spec[spec_len] = '\0';
+               n = snprintf(out + len, size - len, spec, (long) (intptr_t) value);
+               break;
+            case 'u': case 'x': case 'X':
+               spec[spec_len++] = 'l'; spec[spec_len++] = type; spec[spec_len] = '\0';
+               n = snprintf(out + len, size - len, spec, (unsigned long) value);
+               break;
+            case 'c':
+               spec[spec_len++] = type; spec[spec_len] = '\0';
+               n = snprintf(out + len, size - len, spec, (int) value);
+               break;
+            case 's':
+               spec[spec_len++] = type; spec[spec_len] = '\0';
+               n = snprintf(out + len, size - len, spec, value ? (const char*) value : "(null)");
+               break;
+            default:
+               spec[spec_len++] = type; spec[spec_len] = '\0';
+               n = snprintf(out + len, size - len, spec, (void*) value);
+               break;
+         }
+      }
+      if(n > 0) len += n;
+      if(len >= size) len = size - 1;
+   }
+   out[len] = '\0';
+   return len;
+}
@@ -0,0 +1,50 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+// deferred log: the caller stores the format by address and the raw arguments in a
+// lock-free ring, dlog_task formats and prints them later at low priority
+#include <esp_log.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a file defines this before the include to compile out the levels above it, as with LOG_LOCAL_LEVEL
+#ifndef DLOG_LOCAL_LEVEL
+#define DLOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+#endif
+
+#define DLOG_ARGS 6   // integer or static string arguments per entry
+#define DLOG_BYTES 48 // bytes kept for the %.*s of DLOG_DATA
+
+typedef enum {
+   DLOG_SERVER,
+   DLOG_UART,
+   DLOG_MODULE_COUNT,
+} dlog_module_E;
+
+// run time level of each module, see dlog_level_set
+extern esp_log_level_t dlog_levels[DLOG_MODULE_COUNT];
+
+// fmt has to be a literal, arguments are integers or strings that outlive the entry
+#define DLOG(module, level, fmt, ...) do { \
+   if((level) <= DLOG_LOCAL_LEVEL && (level) <= dlog_levels[module]) { \
+      const uintptr_t dlog_args[] = {0, ##__VA_ARGS__}; \
+      dlog_write(module, level, fmt, NULL, 0, dlog_args + 1, sizeof(dlog_args) / sizeof(dlog_args[0]) - 1); \
+   } \
+} while(0)
+
+// the one %.*s in fmt prints data, copied up to DLOG_BYTES, and takes no argument
+#define DLOG_DATA(module, level, fmt, data, len, ...) do { \
+   if((level) <= DLOG_LOCAL_LEVEL && (level) <= dlog_levels[module]) { \
+      const uintptr_t dlog_args[] = {0, ##__VA_ARGS__}; \
+      dlog_write(module, level, fmt, data, len, dlog_args + 1, sizeof(dlog_args) / sizeof(dlog_args[0]) - 1); \
+   } \
+} while(0)
+
+void dlog_write(dlog_module_E, esp_log_level_t, const char *fmt, const void *data, size_t len, const uintptr_t *args, size_t nargs);
+bool dlog_render(char *out, size_t size, esp_log_level_t*, const char **tag);
+bool dlog_level_set(const char *tag, esp_log_level_t);
+uint32_t dlog_dropped(void);
+void dlog_task(void *args);
+
+#endif
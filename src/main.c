@@ -3,20 +3,30 @@
 #include "server.h"
 #include "uart.h"
 #include "sense.h"
+#include "dlog.h"
+#include "trace.h"
 
 #include <esp_timer.h>
 #include <esp_event.h>
 #include <nvs_flash.h>
 #include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
-static esp_timer_handle_t task_timer;
+// WiFi, lwIP and the protocol front ends share core 0, the stepper task has core 1 and its
+// interrupts to itself and takes the commands through lock-free queues, see stepper_call
+#define FRONT_CORE 0
+#define MOTION_CORE 1
+#define STEPPER_TASK_PRIO 12
+#define UART_TASK_PRIO 11
+#define SERVER_TASK_PRIO 10
+#define WIFI_TASK_PRIO 2
+#define DLOG_TASK_PRIO 1
+#define TASK_STACK 4096
 
-void app_task(void *args) {
-   uart_task();
-   wifi_task();
-   server_task();
-   stepper_task();
+static esp_timer_handle_t led_timer;
 
+static void led_task(void *args) {
    // LED when motor fault
    gpio_set_level(GPIO_NUM_2, stepper_get_fault(STEPPER_RA) || stepper_get_fault(STEPPER_DE));
 }
@@ -38,13 +48,20 @@ void app_main(void) {
    uart_init();
    wifi_init();
    server_init();
-   stepper_init();
+   trace_init();
+
+   // stepper_task initializes the steppers itself
+   xTaskCreatePinnedToCore(stepper_task, "stepper", TASK_STACK, NULL, STEPPER_TASK_PRIO, NULL, MOTION_CORE);
+   xTaskCreatePinnedToCore(uart_task, "uart", TASK_STACK, NULL, UART_TASK_PRIO, NULL, FRONT_CORE);
+   xTaskCreatePinnedToCore(server_task, "server", TASK_STACK, NULL, SERVER_TASK_PRIO, NULL, FRONT_CORE);
+   xTaskCreatePinnedToCore(wifi_task, "wifi", TASK_STACK, NULL, WIFI_TASK_PRIO, NULL, FRONT_CORE);
+   xTaskCreatePinnedToCore(dlog_task, "dlog", TASK_STACK, NULL, DLOG_TASK_PRIO, NULL, FRONT_CORE);
 
    esp_timer_create_args_t args = {
-      .name = "app_task",
-      .callback = app_task,
+      .name = "led",
+      .callback = led_task,
    };
 
-   esp_timer_create(&args, &task_timer);
-   esp_timer_start_periodic(task_timer, 10000); // us
+   esp_timer_create(&args, &led_timer);
+   esp_timer_start_periodic(led_timer, 100000); // us
 }
@@ -1,56 +1,364 @@
 #include "server.h"
 #include "synscan.h"
+#include "dlog.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <lwip/sockets.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
 
-static ss_parser_S server_parser = {0};
+#define RX_MAX 512
+#define TX_MAX 512
+#define SESSION_COUNT 4
+#define SESSION_IDLE_US 60000000
+#define CONN_COUNT 3
+#define PORT 11880
 
-static int sock;
+// one per client address and port, so interleaved commands of several clients never mix
+typedef struct {
+   bool used;
+   struct sockaddr_in addr;
+   int64_t last_seen; // us
+   ss_parser_S parser;
+   uint32_t datagrams;
+   uint32_t commands;
+   uint32_t dropped;
+} server_session_S;
+
+// a TCP client, the stream carries the same commands as the datagrams
+typedef struct {
+   int fd; // -1 when free
+   ss_parser_S parser;
+   uint32_t commands;
+} server_conn_S;
+
+static int sock = -1;
+static int listen_sock = -1;
+static server_session_S sessions[SESSION_COUNT];
+static server_conn_S conns[CONN_COUNT];
+static uint8_t tx[TX_MAX];
+static size_t tx_len;
+static uint32_t dropped;  // datagrams larger than RX_MAX
+static uint32_t evicted;  // sessions replaced while still active
+static uint32_t accepted; // TCP connections
+static uint32_t rejected; // TCP connections over CONN_COUNT
+
+static bool server_receive(void);
+static server_session_S *server_session(struct sockaddr_in*);
+static void server_accept(void);
+static void server_stream(server_conn_S*);
+static void server_close(server_conn_S*);
+static bool server_feed(ss_parser_S*, const uint8_t*, size_t, uint32_t*, int, struct sockaddr_in*);
+static bool server_flush(int, struct sockaddr_in*);
+static int server_socket(int type);
 
 void server_init(void) {
-   struct sockaddr_in addr;
-   addr.sin_addr.s_addr = htonl(INADDR_ANY);
-   addr.sin_family = AF_INET;
-   addr.sin_port = htons(11880);
+   for(int i = 0; i < CONN_COUNT; i++) conns[i].fd = -1;
 
-   sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-   assert(sock >= 0);
+   // either socket failing leaves the other one serving, server_socket has logged why
+   sock = server_socket(SOCK_DGRAM);
 
-   int err = fcntl(sock, F_SETFL, O_NONBLOCK);
-   if(err < 0) {
-      ESP_LOGE("server", "fcntl: %s", strerror(errno));
-      return;
+   listen_sock = server_socket(SOCK_STREAM);
+   if(listen_sock >= 0 && listen(listen_sock, CONN_COUNT) < 0) {
+      ESP_LOGE("server", "listen: %s", strerror(errno));
+      close(listen_sock);
+      listen_sock = -1;
    }
+}
 
-   err = bind(sock, (struct sockaddr*) &addr, sizeof(addr));
-   if(err < 0) {
-      ESP_LOGE("server", "bind: %s", strerror(errno));
-      return;
+// sleeps in select until a datagram, a connection or stream data arrives, then drains each socket
+void server_task(void *args) {
+   for(;;) {
+      fd_set rfds;
+      FD_ZERO(&rfds);
+      int nfds = 0;
+      if(sock >= 0) {
+         FD_SET(sock, &rfds);
+         nfds = sock + 1;
+      }
+      if(listen_sock >= 0) {
+         FD_SET(listen_sock, &rfds);
+         if(listen_sock >= nfds) nfds = listen_sock + 1;
+      }
+      for(int i = 0; i < CONN_COUNT; i++) {
+         if(conns[i].fd < 0) continue;
+         FD_SET(conns[i].fd, &rfds);
+         if(conns[i].fd >= nfds) nfds = conns[i].fd + 1;
+      }
+
+      if(select(nfds, &rfds, NULL, NULL, NULL) < 0) {
+         DLOG(DLOG_SERVER, ESP_LOG_WARN, "select: %s", (uintptr_t) strerror(errno));
+         vTaskDelay(1);
+         continue;
+      }
+
+      if(sock >= 0 && FD_ISSET(sock, &rfds))
+         while(server_receive());
+      for(int i = 0; i < CONN_COUNT; i++) {
+         if(conns[i].fd >= 0 && FD_ISSET(conns[i].fd, &rfds))
+            server_stream(&conns[i]);
+      }
+      if(listen_sock >= 0 && FD_ISSET(listen_sock, &rfds))
+         server_accept();
+   }
+}
+
+void server_get_stats(uint32_t *dropped_count, uint32_t *session_count, uint32_t *evicted_count) {
+   int64_t now = esp_timer_get_time();
+   uint32_t count = 0;
+   for(int i = 0; i < SESSION_COUNT; i++) {
+      if(sessions[i].used && now - sessions[i].last_seen < SESSION_IDLE_US) count++;
    }
+
+   *dropped_count = dropped;
+   *session_count = count;
+   *evicted_count = evicted;
+}
+
+void server_get_tcp_stats(uint32_t *conn_count, uint32_t *accepted_count, uint32_t *rejected_count) {
+   uint32_t count = 0;
+   for(int i = 0; i < CONN_COUNT; i++) {
+      if(conns[i].fd >= 0) count++;
+   }
+
+   *conn_count = count;
+   *accepted_count = accepted;
+   *rejected_count = rejected;
 }
 
-void server_task(void) {
-   uint8_t buff[64] = {0};
+// false for a free or expired slot
+bool server_get_session(size_t index, server_session_stats_S *stats) {
+   if(index >= SESSION_COUNT)
+      return false;
+
+   server_session_S *session = &sessions[index];
+   int64_t idle = esp_timer_get_time() - session->last_seen;
+   if(!session->used || idle >= SESSION_IDLE_US)
+      return false;
+
+   *stats = (server_session_stats_S) {
+      .addr      = session->addr.sin_addr.s_addr,
+      .port      = ntohs(session->addr.sin_port),
+      .idle_ms   = idle / 1000,
+      .datagrams = session->datagrams,
+      .commands  = session->commands,
+      .dropped   = session->dropped,
+   };
+   return true;
+}
+
+// handles one datagram, false once the socket is empty
+static bool server_receive(void) {
+   // one spare byte tells a datagram that did not fit from one that just fit
+   static uint8_t rx[RX_MAX + 1];
    struct sockaddr_in addr;
    socklen_t socklen = sizeof(addr);
-   ssize_t len = recvfrom(sock, buff, sizeof(buff), 0, (struct sockaddr*) &addr, &socklen);
+   ssize_t len = recvfrom(sock, rx, sizeof(rx), 0, (struct sockaddr*) &addr, &socklen);
+
+   if(len < 0) {
+      if(errno != EWOULDBLOCK && errno != EAGAIN)
+         DLOG(DLOG_SERVER, ESP_LOG_WARN, "recvfrom: %s", (uintptr_t) strerror(errno));
+      return false;
+   }
 
-   if(len > 0) {
-      ESP_LOGD("server", "rx: %s", buff);
+   server_session_S *session = server_session(&addr);
+   session->datagrams++;
+
+   if(len > RX_MAX) {
+      dropped++;
+      session->dropped++;
+      DLOG(DLOG_SERVER, ESP_LOG_WARN, "dropped datagram over %d bytes", RX_MAX);
+      return true;
    }
 
-   for(int i = 0; i < len; i++) {
-      size_t resp_len = ss_handle_byte(&server_parser, buff[i]);
+   DLOG_DATA(DLOG_SERVER, ESP_LOG_DEBUG, "rx: %.*s", rx, len);
+
+   // the responses to the commands of one datagram go back in one datagram, in order
+   server_feed(&session->parser, rx, len, &session->commands, sock, &addr);
+   return true;
+}
+
+// finds the session of a client or sets one up in a free, expired or else the least recently used slot
+static server_session_S *server_session(struct sockaddr_in *addr) {
+   int64_t now = esp_timer_get_time();
+   server_session_S *slot = NULL;
+
+   for(int i = 0; i < SESSION_COUNT && !slot; i++) {
+      server_session_S *session = &sessions[i];
+      if(!session->used || session->addr.sin_addr.s_addr != addr->sin_addr.s_addr || session->addr.sin_port != addr->sin_port)
+         continue;
 
-      if(resp_len) {
-         ESP_LOGD("server", "tx: %.*s", resp_len, server_parser.data);
-         int err = sendto(sock, server_parser.data, resp_len, 0, (struct sockaddr*) &addr, sizeof(addr));
-         if(err < 0) {
-            ESP_LOGW("server", "sendto: %s", strerror(errno));
+      if(now - session->last_seen < SESSION_IDLE_US) {
+         session->last_seen = now;
+         return session;
+      }
+      // back after expiry, a half parsed command has long been abandoned
+      slot = session;
+   }
+
+   server_session_S *oldest = NULL;
+   for(int i = 0; i < SESSION_COUNT && !slot; i++) {
+      server_session_S *session = &sessions[i];
+      if(!session->used || now - session->last_seen >= SESSION_IDLE_US)
+         slot = session;
+      else if(!oldest || session->last_seen < oldest->last_seen)
+         oldest = session;
+   }
+
+   if(!slot) {
+      slot = oldest;
+      evicted++;
+      uint8_t *ip = (uint8_t*) &slot->addr.sin_addr.s_addr;
+      DLOG(DLOG_SERVER, ESP_LOG_WARN, "session table full, evicting %u.%u.%u.%u:%u", ip[0], ip[1], ip[2], ip[3], ntohs(slot->addr.sin_port));
+   }
+
+   *slot = (server_session_S) {
+      .used = true,
+      .addr = *addr,
+      .last_seen = now,
+      .parser = {.transport = SS_TRANSPORT_UDP, .peer_addr = addr->sin_addr.s_addr, .peer_port = ntohs(addr->sin_port)},
+   };
+   return slot;
+}
+
+static void server_accept(void) {
+   for(;;) {
+      struct sockaddr_in addr;
+      socklen_t socklen = sizeof(addr);
+      int fd = accept(listen_sock, (struct sockaddr*) &addr, &socklen);
+      if(fd < 0) {
+         if(errno != EWOULDBLOCK && errno != EAGAIN)
+            DLOG(DLOG_SERVER, ESP_LOG_WARN, "accept: %s", (uintptr_t) strerror(errno));
+         return;
+      }
+
+      server_conn_S *conn = NULL;
+      for(int i = 0; i < CONN_COUNT && !conn; i++) {
+         if(conns[i].fd < 0) conn = &conns[i];
+      }
+      if(!conn) {
+         rejected++;
+         DLOG(DLOG_SERVER, ESP_LOG_WARN, "too many connections");
+         close(fd);
+         continue;
+      }
+
+      // replies are a few bytes each, Nagle would hold them back for the previous ACK
+      int one = 1;
+      if(fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+         DLOG(DLOG_SERVER, ESP_LOG_WARN, "accept setup: %s", (uintptr_t) strerror(errno));
+         close(fd);
+         continue;
+      }
+
+      *conn = (server_conn_S) {
+         .fd = fd,
+         .parser = {.transport = SS_TRANSPORT_TCP, .peer_addr = addr.sin_addr.s_addr, .peer_port = ntohs(addr.sin_port)},
+      };
+      accepted++;
+   }
+}
+
+// commands may span reads, the parser of the connection carries the rest over
+static void server_stream(server_conn_S *conn) {
+   static uint8_t rx[RX_MAX];
+   for(;;) {
+      ssize_t len = recv(conn->fd, rx, sizeof(rx), 0);
+      if(len == 0) {
+         server_close(conn);
+         return;
+      }
+      if(len < 0) {
+         if(errno != EWOULDBLOCK && errno != EAGAIN) {
+            DLOG(DLOG_SERVER, ESP_LOG_WARN, "recv: %s", (uintptr_t) strerror(errno));
+            server_close(conn);
          }
+         return;
       }
+
+      DLOG_DATA(DLOG_SERVER, ESP_LOG_DEBUG, "rx: %.*s", rx, len);
+      if(!server_feed(&conn->parser, rx, len, &conn->commands, conn->fd, NULL)) {
+         server_close(conn);
+         return;
+      }
+   }
+}
+
+static void server_close(server_conn_S *conn) {
+   close(conn->fd);
+   conn->fd = -1;
+}
+
+// runs the bytes through the parser and sends the responses together, on a stream without addr
+static bool server_feed(ss_parser_S *parser, const uint8_t *data, size_t len, uint32_t *commands, int fd, struct sockaddr_in *addr) {
+   bool ok = true;
+   parser->rx_time = esp_timer_get_time();
+   for(size_t i = 0; i < len; i++) {
+      size_t resp_len = ss_handle_byte(parser, data[i]);
+      if(!resp_len)
+         continue;
+
+      (*commands)++;
+      if(tx_len + resp_len > sizeof(tx)) {
+         ok &= server_flush(fd, addr);
+         ss_sent(parser);
+      }
+      memcpy(tx + tx_len, parser->data, resp_len);
+      tx_len += resp_len;
+   }
+   ok &= server_flush(fd, addr);
+   ss_sent(parser);
+   return ok;
+}
+
+// a stream that can not take a reply at once is too far behind to be of use, the caller drops it
+static bool server_flush(int fd, struct sockaddr_in *addr) {
+   if(!tx_len)
+      return true;
+
+   DLOG_DATA(DLOG_SERVER, ESP_LOG_DEBUG, "tx: %.*s", tx, tx_len);
+   ssize_t sent = addr ? sendto(fd, tx, tx_len, 0, (struct sockaddr*) addr, sizeof(*addr)) : send(fd, tx, tx_len, 0);
+   bool ok = sent == (ssize_t) tx_len;
+   if(sent < 0) {
+      DLOG(DLOG_SERVER, ESP_LOG_WARN, "%s: %s", (uintptr_t) (addr ? "sendto" : "send"), (uintptr_t) strerror(errno));
+   }
+   tx_len = 0;
+   return ok || addr != NULL;
+}
+
+static int server_socket(int type) {
+   struct sockaddr_in addr;
+   addr.sin_addr.s_addr = htonl(INADDR_ANY);
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(PORT);
+
+   int fd = socket(AF_INET, type, IPPROTO_IP);
+   if(fd < 0) {
+      ESP_LOGE("server", "socket: %s", strerror(errno));
+      return -1;
+   }
+
+   int err = fcntl(fd, F_SETFL, O_NONBLOCK);
+   if(err < 0) {
+      ESP_LOGE("server", "fcntl: %s", strerror(errno));
+      close(fd);
+      return -1;
+   }
+
+   // a listener restarted within TIME_WAIT would fail to bind otherwise
+   int one = 1;
+   if(type == SOCK_STREAM)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+   err = bind(fd, (struct sockaddr*) &addr, sizeof(addr));
+   if(err < 0) {
+      ESP_LOGE("server", "bind: %s", strerror(errno));
+      close(fd);
+      return -1;
    }
+   return fd;
 }
 
 void server_command(uint8_t *data, size_t len) {
@@ -1,7 +1,23 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+   uint32_t addr; // IPv4, network byte order
+   uint16_t port;
+   uint32_t idle_ms;
+   uint32_t datagrams;
+   uint32_t commands;
+   uint32_t dropped;
+} server_session_stats_S;
+
 void server_init(void);
-void server_task(void);
+void server_task(void *args);
+void server_get_stats(uint32_t *dropped, uint32_t *sessions, uint32_t *evicted);
+bool server_get_session(size_t index, server_session_stats_S*);
+void server_get_tcp_stats(uint32_t *connections, uint32_t *accepted, uint32_t *rejected);
 
 #endif
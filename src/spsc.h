@@ -0,0 +1,40 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SPSC_SIZE 8 // power of 2
+
+// lock-free ring of pointers between one producer and one consumer, which may run on different cores
+// only the producer writes head and only the consumer writes tail, a slot is published by the release on head
+typedef struct {
+   void *slots[SPSC_SIZE];
+   uint32_t head; // next slot to fill
+   uint32_t tail; // next slot to drain
+} spsc_S;
+
+// false when the ring is full
+static inline bool spsc_push(spsc_S *ring, void *item) {
+   uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+   if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == SPSC_SIZE)
+      return false;
+
+   ring->slots[head % SPSC_SIZE] = item;
+   __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+   return true;
+}
+
+// NULL when the ring is empty
+static inline void *spsc_pop(spsc_S *ring) {
+   uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+   if(tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+      return NULL;
+
+   void *item = ring->slots[tail % SPSC_SIZE];
+   __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+   return item;
+}
+
+#endif
@@ -1,8 +1,20 @@
 // driver for A5984 https://www.allegromicro.com/~/media/Files/Datasheets/A5984-Datasheet.ashx
 #include "stepper.h"
+#include "spsc.h"
 #include <driver/gpio.h>
 #include <driver/mcpwm_prelude.h>
+#include <driver/pulse_cnt.h>
+#include <driver/rmt_tx.h>
 #include <esp_attr.h>
+#include <esp_cpu.h>
+#include <esp_timer.h>
+#include <hal/mcpwm_ll.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sdkconfig.h>
+#include <assert.h>
+#include <limits.h>
+#include <stddef.h>
 
 // declarations
 typedef struct {
@@ -19,9 +31,20 @@ typedef enum {
    STEPPER_STOP,
    STEPPER_ACCEL,
    STEPPER_CRUISE,
+   STEPPER_SLOWDOWN, // deccelerating to a lower cruise speed
    STEPPER_DECCEL,
 } stepper_state_E;
 
+#define SEGMENT_SYMBOLS 512 // a symbol per step at slew rates, 32 ms at 62.5 us a step
+
+// a stretch of precomputed steps for an RMT axis, see stepper_rmt_fill
+typedef struct {
+   rmt_symbol_word_t symbols[SEGMENT_SYMBOLS];
+   uint32_t count;
+   bool last;           // the stream ends with this segment
+   volatile bool ready; // filled by the motion task, handed back by the encoder once sent
+} stepper_segment_S;
+
 typedef struct {
    const stepper_E id;
    const stepper_pins_S pins;
@@ -31,22 +54,114 @@ typedef struct {
    mcpwm_cmpr_handle_t comparator;
    mcpwm_gen_handle_t step_generator;
    mcpwm_gen_handle_t ena_generator;
+   mcpwm_sync_handle_t sync; // the start pulse shared by all groups, see stepper_start_coordinated
+   bool step_isr;  // per step comparator interrupt enabled
+   bool sync_wait; // started with the step pin held low until the sync event lines the axes up
 
+   // step stream of an RMT axis, see stepper_rmt_start
+   rmt_channel_handle_t rmt_channel;
+   rmt_encoder_t rmt_encoder;   // feeds the segments to the channel, see stepper_rmt_encode
+   rmt_encoder_handle_t rmt_copy;
+   stepper_segment_S *segments; // two of them, see rmt_segments
+   uint32_t rmt_playing;        // segment the encoder copies from
+   uint32_t rmt_filling;        // segment the motion task fills next
+   bool rmt_gap;                // the encoder is sending a gap for a segment that was late
+   bool rmt_streaming;          // a transmission is running or its end is not accounted yet
+   bool rmt_ending;             // the step generated last ends the stream
+   bool rmt_last;               // the last segment of the stream has been filled
+   uint32_t rmt_rest;           // RMT ticks of low left of the step generated last
+   uint32_t rmt_count;          // position after the steps generated so far
+   volatile uint32_t rmt_segments;
+   volatile uint32_t rmt_underruns;
+   uint32_t rmt_slips;
+
+   // position is kept by the pulse counter, see stepper_position
+   pcnt_unit_handle_t counter;
+   pcnt_channel_handle_t counter_channel;
+   volatile uint32_t count_base; // position at counter value 0, the counter counts pulses of ustep_scale each
+   uint32_t watch_base;          // position at the hardware counter's own 0, which it wraps back to at either limit
+   int target_watch;             // counter watch point armed for the goto target
+
+   // adaptive microstepping, see stepper_ustep_switch
    stepper_ustep_E ustep;
+   uint32_t ustep_scale;  // 1/32 microsteps per pulse at ustep, positions stay in 1/32 throughout
+   uint32_t phase_origin; // position at which the driver translator is at its home state
    stepper_mode_E mode;
    stepper_speed_E speed;
    stepper_dir_E dir;
-   uint32_t period;
+   uint32_t period;      // T1
+   uint32_t period_frac; // T1 fraction in 1/256
    uint32_t cpr;
 
-   uint32_t count;
    uint32_t target;
-   uint32_t target_period;
-   uint32_t accel_speed;
+   uint32_t target_delay; // cruise period, 24.8 fixed point ticks
+   uint32_t brake;
    stepper_state_E state;
+   bool coordinated; // planned along with the other axes, see stepper_start_coordinated
+
+   // ramp generator, see stepper_ramp
+   uint32_t accel;      // steps/s^2
+   uint32_t ramp_c0;    // first step period, 24.8 fixed point ticks
+   uint32_t ramp_delay; // current step period, 24.8 fixed point ticks
+   uint32_t ramp_rest;
+   uint32_t ramp_frac;  // fraction carried into the next period
+   uint32_t ramp_step;  // steps into the ramp, 0 at standstill
+
+   // pulse guiding, see stepper_pulse_guide
+   stepper_guide_E guide;
+   uint32_t sidereal_delay; // sidereal step period, 24.8 fixed point ticks
+   int32_t guide_offset;    // eighths of the sidereal rate along dir, 0 while not guiding
+   bool guide_alone;        // the axis was stopped and moves at the guide rate only
+   bool guide_hold;         // the offset cancels tracking, timer stopped but still busy
+   stepper_mode_E guide_mode;
+   stepper_speed_E guide_speed;
+   stepper_dir_E guide_dir;
+   esp_timer_handle_t guide_timer;
+
+   // motion script, see stepper_script_service
+   stepper_move_S script[STEPPER_SCRIPT_MOVES];
+   uint32_t script_head;  // move running or next to run, counts on and wraps into the ring
+   uint32_t script_tail;  // where the next move added goes
+   uint32_t script_done;
+   bool script_running;
+   bool script_active;    // the move at script_head has started
+   bool script_expired;   // its time is up
+   esp_timer_handle_t script_timer;
+
+   // seqlock over the fields in stepper_snapshot_S, odd while a writer is inside stepper_publish_begin/end
+   volatile uint32_t seq;
+   portMUX_TYPE publish_lock; // serializes writers across cores and the ISRs
+
+   // interrupt instrumentation, see stepper_get_isr_stats
+   volatile uint32_t isr_count;
+   volatile uint64_t isr_cycles;
+#if STEPPER_PROBE
+   uint32_t isr_min;        // cycles
+   uint32_t isr_max;        // cycles
+   uint32_t probe_last;     // cycle count at the previous step interrupt, 0 when there was none
+   uint32_t probe_active;   // period ticks of the timer cycle running
+   uint32_t probe_pending;  // period ticks the timer latches at its next empty event
+   stepper_probe_S probe;   // without the duration fields, see stepper_get_probe
+#endif
 } stepper_state_S;
 
+// a call shipped to the motion task, it lives on the stack of the waiting caller
+typedef struct {
+   stepper_call_t fn;
+   void *arg;
+} stepper_call_S;
+
+// one pair of rings per calling task, so each ring has a single producer and a single consumer
+typedef struct {
+   TaskHandle_t producer; // NULL until a task claims the queue
+   spsc_S commands;       // calls to run, producer to motion task
+   spsc_S events;         // calls done, motion task back to the producer
+} stepper_queue_S;
+
 // definitions
+#define QUEUE_COUNT 4 // the UART and server tasks, the esp_timer task for the guide timers
+#define NO_WATCH INT_MIN
+
 static stepper_state_S stepper_states[STEPPER_COUNT] = {
    [STEPPER_RA] = {
       .id     = STEPPER_RA,
@@ -54,10 +169,15 @@ static stepper_state_S stepper_states[STEPPER_COUNT] = {
       .mode   = STEPPER_TRACKING,
       .speed  = STEPPER_SLOW,
       .ustep  = STEPPER_USTEP_32,
+      .ustep_scale = 1,
       .dir    = STEPPER_CW,
       .period = 10,
       .cpr    = 32 * STEPPER_STEPS_PER_REV * 3 * 256,
+      .accel  = STEPPER_DEFAULT_ACCEL,
+      .guide  = STEPPER_GUIDE_0_5X,
       .state  = STEPPER_STOP,
+      .target_watch = NO_WATCH,
+      .publish_lock = portMUX_INITIALIZER_UNLOCKED,
    },
    [STEPPER_DE] = {
       .id     = STEPPER_DE,
@@ -65,33 +185,140 @@ static stepper_state_S stepper_states[STEPPER_COUNT] = {
       .mode   = STEPPER_TRACKING,
       .speed  = STEPPER_SLOW,
       .ustep  = STEPPER_USTEP_32,
+      .ustep_scale = 1,
       .dir    = STEPPER_CW,
       .period = 10,
       .cpr    = 32 * STEPPER_STEPS_PER_REV * 3 * 257,
+      .accel  = STEPPER_DEFAULT_ACCEL,
+      .guide  = STEPPER_GUIDE_0_5X,
       .state  = STEPPER_STOP,
+      .target_watch = NO_WATCH,
+      .publish_lock = portMUX_INITIALIZER_UNLOCKED,
    },
 };
 
 static const gpio_num_t nRST = 32;
+static const gpio_num_t SYNC = 18; // looped back into the sync input of every MCPWM group
+static const gpio_num_t AUX = 16; // GPO on the board, see stepper_set_aux
 static const uint32_t PULSE_WIDTH_FACTOR = 10;
+static const uint32_t MAX_PERIOD = 0x10000; // 16 bit timer
+static const int COUNTER_LIMIT = 0x7FFF; // 16 bit signed pulse counter
+static const uint64_t SIDEREAL_DAY_MS = 86164091;
+static const uint32_t RMT_TICKS_PER_TICK = 2; // the RMT divider can not reach the MCPWM resolution, it runs at twice that
+static const uint32_t RMT_SYMBOL_MAX = 100; // RMT ticks, so the channel memory never holds more than 20 ms
+static const size_t RMT_MEM_SYMBOLS = 64; // one block of channel memory
+static const uint32_t SEGMENT_TICKS = STEPPER_FREQ * PULSE_WIDTH_FACTOR * 4 / configTICK_RATE_HZ; // four task ticks
+static const uint32_t USTEP_FULL = 32; // 1/32 microsteps per full step
+static const uint32_t USTEP_SCALE_MAX = 8; // down to 1/4 steps
+#if STEPPER_PROBE
+static const uint32_t CYCLES_PER_TICK = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000 / (STEPPER_FREQ * PULSE_WIDTH_FACTOR);
+#endif
+static const uint32_t USTEP_MIN_PERIOD = PULSE_WIDTH_FACTOR << 8; // pulses faster than STEPPER_FREQ go coarser, 24.8 fixed point ticks
+static const DRAM_ATTR stepper_ustep_E USTEP_MODES[] = {[1] = STEPPER_USTEP_32, [2] = STEPPER_USTEP_16, [4] = STEPPER_USTEP_8, [8] = STEPPER_USTEP_4}; // by scale, in DRAM since the step ISR reads it
+static const uint8_t GUIDE_RATES[STEPPER_GUIDE_COUNT] = {8, 6, 4, 2, 1}; // eighths of sidereal
 
-static const uint32_t ACCEL_FACTOR = 512;
-static const uint32_t ACCEL_STOP   = 1;
-static const uint32_t ACCEL_STEP   = 1;
+static int64_t isr_stats_start;
+static TaskHandle_t task_handle;
+static stepper_queue_S queues[QUEUE_COUNT];
+static stepper_segment_S rmt_segments[STEPPER_RMT_AXES ? STEPPER_COUNT : 0][2]; // nothing unless the build streams an axis
+static uint32_t sync_pending; // axes of a coordinated start that have not reached their wait yet
 
+static void stepper_init_mcpwm(stepper_state_S*);
+static void stepper_init_rmt(stepper_state_S*);
 static bool stepper_timer_stop_callback(mcpwm_timer_handle_t, const mcpwm_timer_event_data_t*, void*);
 static bool stepper_pulse_callback(mcpwm_cmpr_handle_t, const mcpwm_compare_event_data_t*, void*);
+static bool stepper_counter_callback(pcnt_unit_handle_t, const pcnt_watch_event_data_t*, void*);
+static void stepper_sync_arm(stepper_state_S*);
+static void stepper_prepare(stepper_state_S*, uint32_t, uint32_t);
+static void stepper_wake(void);
+static stepper_queue_S *stepper_queue(TaskHandle_t);
+static void stepper_serve(void);
+static void stepper_publish_begin(stepper_state_S*);
+static void stepper_publish_end(stepper_state_S*);
+static void stepper_step_isr(stepper_state_S*, bool);
+static bool stepper_needs_step_isr(stepper_state_S*);
+static void stepper_watch_target(stepper_state_S*);
+static bool stepper_uses_rmt(stepper_state_S*);
+static uint32_t stepper_position(stepper_state_S*);
+static uint32_t stepper_remaining(stepper_state_S*);
+static bool stepper_dithering(stepper_state_S*);
+static void stepper_isr_account(stepper_state_S*, uint32_t);
+static esp_err_t stepper_timer_period(stepper_state_S*, uint32_t);
+static void stepper_timer_halt(stepper_state_S*);
+#if STEPPER_PROBE
+static void stepper_probe_step(stepper_state_S*, uint32_t);
+#endif
+static void stepper_rmt_start(stepper_state_S*);
+static void stepper_rmt_end(stepper_state_S*);
+static void stepper_rmt_service(stepper_state_S*);
+static void stepper_rmt_fill(stepper_state_S*, stepper_segment_S*);
+static stepper_state_S *stepper_rmt_state(rmt_encoder_t*);
+static size_t stepper_rmt_encode(rmt_encoder_t*, rmt_channel_handle_t, const void*, size_t, rmt_encode_state_t*);
+static esp_err_t stepper_rmt_reset(rmt_encoder_t*);
+static esp_err_t stepper_rmt_del(rmt_encoder_t*);
+static bool stepper_rmt_done(rmt_channel_handle_t, const rmt_tx_done_event_data_t*, void*);
+static void stepper_retarget(stepper_state_S*);
+static void stepper_guide_apply(stepper_state_S*);
+static void stepper_guide_end(void*);
+static void stepper_guide_finish(void*);
+static uint64_t stepper_guide_delay(stepper_state_S*, uint64_t);
+static void stepper_script_service(void);
+static bool stepper_script_finish(stepper_state_S*);
+static bool stepper_script_begin(void);
+static stepper_move_S *stepper_script_ready(stepper_state_S*);
+static void stepper_script_start(stepper_state_S*, bool);
+static void stepper_script_end(void*);
+static void stepper_script_expire(void*);
+static void stepper_brake(stepper_state_S*);
+static uint32_t stepper_ustep_target(stepper_state_S*);
+static bool stepper_ustep_switch(stepper_state_S*, bool);
+static void stepper_ustep_pins(stepper_state_S*);
+static void stepper_ramp(stepper_state_S*);
+static bool stepper_ramp_advance(stepper_state_S*);
+static void stepper_ramp_up(stepper_state_S*);
+static void stepper_ramp_down(stepper_state_S*);
+static uint32_t stepper_ramp_period(stepper_state_S*);
+static uint32_t stepper_cruise_delay(stepper_state_S*, stepper_speed_E);
+static uint32_t stepper_accel_c0(uint32_t);
+static uint32_t isqrt(uint64_t);
 
+// stepper_task calls this on the motion core so the interrupts are allocated there, the tests before that
 void stepper_init(void) {
+   static bool initialized;
+   if(initialized)
+      return;
+   initialized = true;
+
    // global GPIO config
    gpio_set_direction(nRST, GPIO_MODE_OUTPUT);
    gpio_set_level(nRST, 1);
+   gpio_set_direction(SYNC, GPIO_MODE_OUTPUT);
+   gpio_set_level(SYNC, 0);
+   gpio_set_direction(AUX, GPIO_MODE_INPUT_OUTPUT); // reads back for stepper_get_aux
+   gpio_set_level(AUX, 0);
 
    // config for each stepper
    for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
       const stepper_pins_S *pins = &stepper_states[stepper].pins;
       stepper_state_S *state = &stepper_states[stepper];
 
+      stepper_set_accel(stepper, state->accel);
+      state->sidereal_delay = (uint64_t) STEPPER_FREQ * PULSE_WIDTH_FACTOR * SIDEREAL_DAY_MS * 256 / ((uint64_t) state->cpr * 1000);
+
+      esp_timer_create_args_t guide_timer_args = {
+         .name     = "guide",
+         .callback = stepper_guide_end,
+         .arg      = (void*) state,
+      };
+      ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_create(&guide_timer_args, &state->guide_timer));
+
+      esp_timer_create_args_t script_timer_args = {
+         .name     = "script",
+         .callback = stepper_script_end,
+         .arg      = (void*) state,
+      };
+      ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_create(&script_timer_args, &state->script_timer));
+
       // GPIO config
       gpio_config_t config = {
          .pin_bit_mask =
@@ -110,83 +337,219 @@ void stepper_init(void) {
       //gpio_set_level(state->pins.nena, 1);
       gpio_set_level(state->pins.nena, 0);
 
-      // configure microstep
-      stepper_ustep_E ustep = stepper_states[stepper].ustep;
-      gpio_set_level(pins->ms1, (ustep >> 0) & 1);
-      gpio_set_level(pins->ms2, (ustep >> 1) & 1);
-      gpio_set_level(pins->ms3, (ustep >> 2) & 1);
-
-      // MCPWM config
-      mcpwm_timer_config_t timer_config = {
-         .group_id      = stepper,
-         .resolution_hz = STEPPER_FREQ * PULSE_WIDTH_FACTOR,
-         .count_mode    = MCPWM_TIMER_COUNT_MODE_UP,
-         .period_ticks  = state->period,
-         .flags.update_period_on_empty = 1,
-      };
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_timer(&timer_config, &state->timer));
+      // configure microstep, leaving reset put the translator at its home state
+      stepper_ustep_pins(state);
 
-      mcpwm_timer_event_callbacks_t timer_callback = {
-         .on_stop = stepper_timer_stop_callback,
+      // PCNT counts the step pulses, a high dir pin counts down
+      pcnt_unit_config_t counter_config = {
+         .low_limit  = -COUNTER_LIMIT,
+         .high_limit = COUNTER_LIMIT,
+         .flags.accum_count = 1,
       };
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_register_event_callbacks(state->timer, &timer_callback, (void*) state));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_new_unit(&counter_config, &state->counter));
 
-      mcpwm_operator_config_t oper_config = {
-         .group_id = stepper,
+      pcnt_chan_config_t counter_chan_config = {
+         .edge_gpio_num  = pins->step,
+         .level_gpio_num = pins->dir,
+         .flags.io_loop_back = 1,
       };
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_operator(&oper_config, &state->operator));
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_operator_connect_timer(state->operator, state->timer));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_new_channel(state->counter, &counter_chan_config, &state->counter_channel));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_channel_set_edge_action(state->counter_channel, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_channel_set_level_action(state->counter_channel, PCNT_CHANNEL_LEVEL_ACTION_INVERSE, PCNT_CHANNEL_LEVEL_ACTION_KEEP));
 
-      mcpwm_comparator_config_t cmpr_config = {0};
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_comparator(state->operator, &cmpr_config, &state->comparator));
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_comparator_set_compare_value(state->comparator, 1));
+      // the counter wraps to 0 at either limit, the driver adds each wrap to the count it reads back
+      // under its own lock, which extends it to 32 bits without a window where the wrap is not counted yet
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_add_watch_point(state->counter, COUNTER_LIMIT));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_add_watch_point(state->counter, -COUNTER_LIMIT));
 
-      mcpwm_comparator_event_callbacks_t cmpr_callback = {
-         .on_reach = stepper_pulse_callback,
+      pcnt_event_callbacks_t counter_callback = {
+         .on_reach = stepper_counter_callback,
       };
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_comparator_register_event_callbacks(state->comparator, &cmpr_callback, (void*) state));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_register_event_callbacks(state->counter, &counter_callback, (void*) state));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_enable(state->counter));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_clear_count(state->counter));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_start(state->counter));
 
-      // generator for step signal
-      mcpwm_generator_config_t step_gen_config = {
-         .gen_gpio_num = pins->step,
-      };
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_generator(state->operator, &step_gen_config, &state->step_generator));
+      if(stepper_uses_rmt(state))
+         stepper_init_rmt(state);
+      else
+         stepper_init_mcpwm(state);
+   }
+
+   stepper_reset_isr_stats();
+}
 
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_generator_set_action_on_timer_event(state->step_generator, (mcpwm_gen_timer_event_action_t) {
-         .event  = MCPWM_TIMER_EVENT_EMPTY,
-         .action = MCPWM_GEN_ACTION_HIGH,
-      }));
+static void stepper_init_mcpwm(stepper_state_S *state) {
+   // MCPWM config
+   mcpwm_timer_config_t timer_config = {
+      .group_id      = state->id,
+      .resolution_hz = STEPPER_FREQ * PULSE_WIDTH_FACTOR,
+      .count_mode    = MCPWM_TIMER_COUNT_MODE_UP,
+      .period_ticks  = state->period,
+      .flags.update_period_on_empty = 1,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_timer(&timer_config, &state->timer));
+#if STEPPER_PROBE
+   state->probe_pending = state->period;
+#endif
 
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_generator_set_action_on_compare_event(state->step_generator, (mcpwm_gen_compare_event_action_t) {
-         .comparator = state->comparator,
-         .action     = MCPWM_GEN_ACTION_LOW,
-      }));
+   mcpwm_timer_event_callbacks_t timer_callback = {
+      .on_stop = stepper_timer_stop_callback,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_register_event_callbacks(state->timer, &timer_callback, (void*) state));
 
-      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_enable(state->timer));
-   }
+   // every group reads the sync pin, a pulse on it puts all the waiting timers on their peak at once
+   mcpwm_gpio_sync_src_config_t sync_config = {
+      .group_id = state->id,
+      .gpio_num = SYNC,
+      .flags.io_loop_back = 1,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_gpio_sync_src(&sync_config, &state->sync));
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_set_phase_on_sync(state->timer, &(mcpwm_timer_sync_phase_config_t) {
+      .sync_src    = state->sync,
+      .count_value = MAX_PERIOD - 1,
+      .direction   = MCPWM_TIMER_DIRECTION_UP,
+   }));
+
+   mcpwm_operator_config_t oper_config = {
+      .group_id = state->id,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_operator(&oper_config, &state->operator));
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_operator_connect_timer(state->operator, state->timer));
+
+   mcpwm_comparator_config_t cmpr_config = {0};
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_comparator(state->operator, &cmpr_config, &state->comparator));
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_comparator_set_compare_value(state->comparator, 1));
+
+   // installs the interrupt, stepper_task switches it off whenever no ramp needs it
+   state->step_isr = false;
+   stepper_step_isr(state, true);
+
+   // generator for step signal, looped back into the counter
+   mcpwm_generator_config_t step_gen_config = {
+      .gen_gpio_num = state->pins.step,
+      .flags.io_loop_back = 1,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_new_generator(state->operator, &step_gen_config, &state->step_generator));
+
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_generator_set_action_on_timer_event(state->step_generator, (mcpwm_gen_timer_event_action_t) {
+      .event  = MCPWM_TIMER_EVENT_EMPTY,
+      .action = MCPWM_GEN_ACTION_HIGH,
+   }));
+
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_generator_set_action_on_compare_event(state->step_generator, (mcpwm_gen_compare_event_action_t) {
+      .comparator = state->comparator,
+      .action     = MCPWM_GEN_ACTION_LOW,
+   }));
+
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_enable(state->timer));
 }
 
-void stepper_task(void) {
-   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
-      stepper_state_S *state = &stepper_states[stepper];
+// the channel drives the step pin, which loops back into the pulse counter just like the MCPWM generator
+static void stepper_init_rmt(stepper_state_S *state) {
+   rmt_tx_channel_config_t channel_config = {
+      .gpio_num          = state->pins.step,
+      .clk_src           = RMT_CLK_SRC_DEFAULT,
+      .resolution_hz     = STEPPER_FREQ * PULSE_WIDTH_FACTOR * RMT_TICKS_PER_TICK,
+      .mem_block_symbols = RMT_MEM_SYMBOLS,
+      .trans_queue_depth = 1,
+      .flags.io_loop_back = 1,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(rmt_new_tx_channel(&channel_config, &state->rmt_channel));
+   state->segments = rmt_segments[state->id];
 
-      if(state->state == STEPPER_ACCEL) {
-         state->accel_speed += ACCEL_STEP;
-         if(ACCEL_FACTOR / state->accel_speed <= state->target_period) {
-            ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_set_period(state->timer, state->target_period));
-            state->state = STEPPER_CRUISE;
-         } else {
-            ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_set_period(state->timer, ACCEL_FACTOR / state->accel_speed));
-         }
+   rmt_tx_event_callbacks_t channel_callback = {
+      .on_trans_done = stepper_rmt_done,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(rmt_tx_register_event_callbacks(state->rmt_channel, &channel_callback, (void*) state));
+
+   rmt_copy_encoder_config_t copy_config = {};
+   ESP_ERROR_CHECK_WITHOUT_ABORT(rmt_new_copy_encoder(&copy_config, &state->rmt_copy));
+   state->rmt_encoder = (rmt_encoder_t) {
+      .encode = stepper_rmt_encode,
+      .reset  = stepper_rmt_reset,
+      .del    = stepper_rmt_del,
+   };
+
+   ESP_ERROR_CHECK_WITHOUT_ABORT(rmt_enable(state->rmt_channel));
+}
+
+// keeps the per step interrupt off while nothing needs it, so a steady slew costs no CPU at all
+// runs every tick while an axis moves and sleeps until the next start or call otherwise, which
+// is also when the segments of RMT axes are refilled and the scripts move on
+void stepper_task(void *args) {
+   __atomic_store_n(&task_handle, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+   stepper_init();
+
+   for(;;) {
+      stepper_serve();
+      stepper_script_service();
+
+      bool moving = false;
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+         stepper_state_S *state = &stepper_states[stepper];
+         if(stepper_uses_rmt(state))
+            stepper_rmt_service(state);
+         stepper_watch_target(state);
+         stepper_step_isr(state, stepper_needs_step_isr(state));
+         moving |= stepper_busy(stepper);
       }
 
-      if(state->state == STEPPER_DECCEL) {
-         if(state->accel_speed > ACCEL_STEP) {
-            state->accel_speed -= ACCEL_STEP;
-            ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_set_period(state->timer, ACCEL_FACTOR / state->accel_speed));
-         } else {
-            stepper_stop_instant(stepper);
-         }
+      ulTaskNotifyTake(pdTRUE, moving ? 1 : portMAX_DELAY);
+   }
+}
+
+// runs fn on the motion task and returns once it is done, this is how the command handlers of
+// each transport and the guide timers reach the stepper state without sharing a lock with it
+// outside of any task (the sim harness) and on the motion task itself fn runs right away
+void stepper_call(stepper_call_t fn, void *arg) {
+   TaskHandle_t self = xTaskGetCurrentTaskHandle();
+   if(!self || self == task_handle) {
+      fn(arg);
+      return;
+   }
+
+   // callers that come up before the motion task wait for it
+   while(!__atomic_load_n(&task_handle, __ATOMIC_ACQUIRE))
+      vTaskDelay(1);
+
+   stepper_queue_S *queue = stepper_queue(self);
+   assert(queue);
+
+   stepper_call_S call = {fn, arg};
+   while(!spsc_push(&queue->commands, &call))
+      vTaskDelay(1);
+   xTaskNotifyGive(task_handle);
+
+   while(!spsc_pop(&queue->events))
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+// the queue of the calling task, claimed on its first call and kept from then on
+static stepper_queue_S *stepper_queue(TaskHandle_t self) {
+   for(int i = 0; i < QUEUE_COUNT; i++) {
+      TaskHandle_t producer = __atomic_load_n(&queues[i].producer, __ATOMIC_ACQUIRE);
+      if(producer == self)
+         return &queues[i];
+      if(!producer && __atomic_compare_exchange_n(&queues[i].producer, &producer, self, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+         return &queues[i];
+   }
+   return NULL;
+}
+
+// runs the queued calls and hands each back to its caller, the caller's stack is gone after that
+static void stepper_serve(void) {
+   for(int i = 0; i < QUEUE_COUNT; i++) {
+      stepper_queue_S *queue = &queues[i];
+      TaskHandle_t producer = __atomic_load_n(&queue->producer, __ATOMIC_ACQUIRE);
+      if(!producer)
+         break;
+
+      stepper_call_S *call;
+      while((call = spsc_pop(&queue->commands))) {
+         call->fn(call->arg);
+         spsc_push(&queue->events, call);
+         xTaskNotifyGive(producer);
       }
    }
 }
@@ -194,29 +557,139 @@ void stepper_task(void) {
 void stepper_start(stepper_E stepper) {
    stepper_state_S *state = &stepper_states[stepper];
 
-   if(state->mode == STEPPER_GOTO && state->target == state->count)
+   if(state->mode == STEPPER_GOTO && state->target == stepper_position(state))
       return;
 
-   state->target_period = state->period * PULSE_WIDTH_FACTOR;
-   if(state->speed == STEPPER_FAST && state->target_period >= STEPPER_FAST_RATIO)
-      state->target_period /= STEPPER_FAST_RATIO;
+   state->coordinated = false;
+   stepper_prepare(state, state->ramp_c0, stepper_cruise_delay(state, state->speed));
+   if(stepper_uses_rmt(state)) {
+      stepper_rmt_start(state);
+   } else {
+      ESP_ERROR_CHECK_WITHOUT_ABORT(stepper_timer_period(state, stepper_ramp_period(state)));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_start_stop(state->timer, MCPWM_TIMER_START_NO_STOP));
+   }
+   stepper_wake();
+}
+
+// starts every axis at once, gotos on all of them are planned as one move along a straight line in count
+// space: the axis needing the longest at its cruise rate sets the pace, the one needing the longest to
+// get there sets the acceleration, and each axis runs both scaled to its share of the distance, so they
+// all accelerate, cruise, brake and arrive together
+// the MCPWM axes idle with the step pin held low until the sync pulse has them all take their first step
+// on the same timer edge, RMT axes stream from the start as usual
+// an axis whose share is so small its cruise period would not fit the timer cruises at MAX_PERIOD
+// and arrives early
+void stepper_start_coordinated(void) {
+   uint32_t distance[STEPPER_COUNT], delay[STEPPER_COUNT];
+   stepper_E pace = STEPPER_0, ramp = STEPPER_0;
+   bool together = true;
+
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      stepper_state_S *state = &stepper_states[stepper];
+      uint32_t position = stepper_position(state);
+      distance[stepper] = state->dir == STEPPER_CW ? state->target - position : position - state->target;
+      delay[stepper] = stepper_cruise_delay(state, state->speed);
+      together &= state->mode == STEPPER_GOTO && state->state == STEPPER_STOP && distance[stepper];
+
+      if((uint64_t) delay[stepper] * distance[stepper] > (uint64_t) delay[pace] * distance[pace])
+         pace = stepper;
+      if((uint64_t) state->accel * distance[ramp] < (uint64_t) stepper_states[ramp].accel * distance[stepper])
+         ramp = stepper;
+   }
+
+   // anything else is just each axis on its own
+   if(!together) {
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+         stepper_start(stepper);
+      return;
+   }
+
+   sync_pending = 0;
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      stepper_state_S *state = &stepper_states[stepper];
+      uint64_t cruise = (uint64_t) delay[pace] * distance[pace] / distance[stepper];
+      uint64_t accel = (uint64_t) stepper_states[ramp].accel * distance[stepper] / distance[ramp];
+      if(cruise > (uint64_t) MAX_PERIOD << 8) cruise = (uint64_t) MAX_PERIOD << 8;
+
+      state->coordinated = true;
+      stepper_prepare(state, stepper_accel_c0(accel), cruise);
+      if(!stepper_uses_rmt(state)) {
+         state->sync_wait = true;
+         sync_pending++;
+         ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_generator_set_force_level(state->step_generator, 0, true));
+         ESP_ERROR_CHECK_WITHOUT_ABORT(stepper_timer_period(state, MAX_PERIOD));
+      }
+   }
+
+   // back to back, the first compare events arm the sync, see stepper_sync_arm
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      stepper_state_S *state = &stepper_states[stepper];
+      if(stepper_uses_rmt(state))
+         stepper_rmt_start(state);
+      else
+         ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_start_stop(state->timer, MCPWM_TIMER_START_NO_STOP));
+   }
+   stepper_wake();
+}
+
+// everything up to the first step, the ramp starts from c0 and cruises at delay, both 24.8 fixed point ticks
+static void stepper_prepare(stepper_state_S *state, uint32_t c0, uint32_t delay) {
+   // a stream still running is cut off, the new one starts from where it got to
+   if(stepper_uses_rmt(state))
+      stepper_rmt_end(state);
+
+   // a cut off slew may have left a coarse resolution, at standstill it can go back at once
+   if(state->state == STEPPER_STOP)
+      stepper_ustep_switch(state, true);
+
+   state->guide_hold = false;
+   state->target_delay = delay;
 
-   state->accel_speed = ACCEL_STOP;
-   state->state = STEPPER_ACCEL;
+   // slow rates need no ramp at all
+   state->ramp_step = 0;
+   state->ramp_rest = 0;
+   state->ramp_frac = 0x80; // round to the nearest tick
+   state->ramp_delay = c0;
+   stepper_publish_begin(state);
+   if(state->ramp_delay <= state->target_delay) {
+      state->ramp_delay = state->target_delay;
+      state->state = STEPPER_CRUISE;
+   } else {
+      state->state = STEPPER_ACCEL;
+   }
+   stepper_publish_end(state);
+
+   stepper_watch_target(state);
+   stepper_step_isr(state, true);
 
    gpio_set_level(state->pins.nena, 0);
    gpio_set_level(state->pins.dir, state->dir == STEPPER_CCW);
-   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_set_period(state->timer, ACCEL_FACTOR / state->accel_speed));
-   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_start_stop(state->timer, MCPWM_TIMER_START_NO_STOP));
 }
 
 void stepper_stop(stepper_E stepper) {
-   stepper_states[stepper].state = STEPPER_DECCEL;
+   stepper_state_S *state = &stepper_states[stepper];
+   if(state->guide_hold) {
+      stepper_stop_instant(stepper);
+   } else if(state->state != STEPPER_STOP) {
+      state->state = STEPPER_DECCEL;
+      stepper_step_isr(state, true);
+   }
 }
 
 void stepper_stop_instant(stepper_E stepper) {
    stepper_state_S *state = &stepper_states[stepper];
-   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_start_stop(state->timer, MCPWM_TIMER_STOP_FULL));
+
+   // the stream stops in the middle of its memory, there is no end of transmission to wait for
+   if(stepper_uses_rmt(state)) {
+      stepper_rmt_end(state);
+      state->guide_hold = false;
+      stepper_publish_begin(state);
+      state->state = STEPPER_STOP;
+      stepper_publish_end(state);
+      return;
+   }
+
+   stepper_timer_halt(state);
 }
 
 bool stepper_busy(stepper_E stepper) {
@@ -227,37 +700,181 @@ uint32_t stepper_cpr(stepper_E stepper) {
    return stepper_states[stepper].cpr;
 }
 
+// the driver does not move, so its home state moves along with the count
 void stepper_set_count(stepper_E stepper, uint32_t count) {
-   stepper_states[stepper].count = count;
+   stepper_state_S *state = &stepper_states[stepper];
+   stepper_publish_begin(state);
+   state->phase_origin += count - stepper_position(state);
+   ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_clear_count(state->counter));
+   state->count_base = count;
+   state->watch_base = count;
+   stepper_publish_end(state);
 }
 
 uint32_t stepper_get_count(stepper_E stepper) {
-   return stepper_states[stepper].count;
+   return stepper_position(&stepper_states[stepper]);
 }
 
 void stepper_set_period(stepper_E stepper, uint32_t period) {
-   stepper_states[stepper].period = period;
+   stepper_set_period_fine(stepper, period << 8);
+}
+
+// T1 in 24.8 fixed point, the step timing dithers between whole ticks to keep the average exact
+// a tracking axis changes over to the new rate without stopping
+void stepper_set_period_fine(stepper_E stepper, uint32_t period) {
+   stepper_state_S *state = &stepper_states[stepper];
+   stepper_publish_begin(state);
+   state->period = period >> 8;
+   state->period_frac = period & 0xFF;
+   stepper_publish_end(state);
+
+   if(state->mode == STEPPER_TRACKING)
+      stepper_retarget(state);
 }
 
 void stepper_set_target(stepper_E stepper, uint32_t target) {
-   stepper_states[stepper].target = target;
+   stepper_state_S *state = &stepper_states[stepper];
+   stepper_publish_begin(state);
+   state->target = target;
+   stepper_publish_end(state);
+}
+
+void stepper_set_brake(stepper_E stepper, uint32_t brake) {
+   stepper_states[stepper].brake = brake;
 }
 
 void stepper_set_mode(stepper_E stepper, stepper_mode_E mode, stepper_speed_E speed, stepper_dir_E dir) {
    stepper_state_S *state = &stepper_states[stepper];
+   stepper_publish_begin(state);
    state->mode = mode;
    state->speed = speed;
    state->dir = dir;
+   stepper_publish_end(state);
+}
+
+// precomputes the first step period, see stepper_accel_c0
+void stepper_set_accel(stepper_E stepper, uint32_t accel) {
+   stepper_state_S *state = &stepper_states[stepper];
+   if(accel == 0) accel = 1;
+
+   state->accel = accel;
+   state->ramp_c0 = stepper_accel_c0(accel);
+}
+
+void stepper_set_guide(stepper_E stepper, stepper_guide_E guide) {
+   if(guide < STEPPER_GUIDE_COUNT)
+      stepper_states[stepper].guide = guide;
+}
+
+// moves the axis at the guide rate faster or slower than tracking for ms, timed here rather than by the client
+// a stopped axis moves at the guide rate alone, gotos and fast slews can not be guided
+bool stepper_pulse_guide(stepper_E stepper, stepper_dir_E dir, uint32_t ms) {
+   stepper_state_S *state = &stepper_states[stepper];
+   bool busy = stepper_busy(stepper);
+   int32_t rate = GUIDE_RATES[state->guide];
+
+   if(state->guide_alone) {
+      if(dir != state->dir)
+         return false;
+   } else if(busy && (state->mode != STEPPER_TRACKING || state->speed != STEPPER_SLOW)) {
+      return false;
+   }
+
+   // a new pulse replaces the one still running, stopping an idle timer fails harmlessly
+   esp_timer_stop(state->guide_timer);
+
+   if(!busy) {
+      state->guide_mode = state->mode;
+      state->guide_speed = state->speed;
+      state->guide_dir = state->dir;
+      stepper_publish_begin(state);
+      state->mode = STEPPER_TRACKING;
+      state->speed = STEPPER_SLOW;
+      state->dir = dir;
+      stepper_publish_end(state);
+      state->guide_alone = true;
+      state->guide_offset = rate;
+      stepper_start(stepper);
+   } else if(!state->guide_alone) {
+      state->guide_offset = dir == state->dir ? rate : -rate;
+      stepper_guide_apply(state);
+   }
+
+   ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(state->guide_timer, (uint64_t) ms * 1000));
+   return true;
+}
+
+// queues a move at the end of the script of an axis, false while the script is full
+// a joint move goes to every axis, at the same place in their scripts
+bool stepper_script_add(stepper_E stepper, const stepper_move_S *move) {
+   stepper_state_S *state = &stepper_states[stepper];
+   if(move->type >= STEPPER_MOVE_COUNT || state->script_tail - state->script_head >= STEPPER_SCRIPT_MOVES)
+      return false;
+
+   state->script[state->script_tail++ % STEPPER_SCRIPT_MOVES] = *move;
+   stepper_wake();
+   return true;
+}
+
+// runs the moves queued back to back, then the ones added later as they come, until the script is cleared
+// false while the axis is busy with a move of its own
+bool stepper_script_run(stepper_E stepper) {
+   stepper_state_S *state = &stepper_states[stepper];
+   if(!state->script_running && stepper_busy(stepper))
+      return false;
+
+   state->script_running = true;
+   stepper_wake();
+   return true;
+}
+
+// drops the moves left, a move running goes on for the caller to stop
+void stepper_script_clear(stepper_E stepper) {
+   stepper_state_S *state = &stepper_states[stepper];
+   esp_timer_stop(state->script_timer);
+   state->script_running = false;
+   state->script_active = false;
+   state->script_head = state->script_tail;
+   state->script_done = 0;
+}
+
+void stepper_get_script(stepper_E stepper, stepper_script_status_S *status) {
+   stepper_state_S *state = &stepper_states[stepper];
+   uint32_t queued = state->script_tail - state->script_head;
+   *status = (stepper_script_status_S) {
+      .queued  = queued,
+      .done    = state->script_done,
+      .running = state->script_running,
+      .waiting = state->script_running && !state->script_active && queued &&
+                 state->script[state->script_head % STEPPER_SCRIPT_MOVES].joint,
+   };
+}
+
+// the GPO pin, for a camera shutter or whatever else a script should trigger between its moves
+void stepper_set_aux(bool on) {
+   gpio_set_level(AUX, on);
+}
+
+bool stepper_get_aux(void) {
+   return gpio_get_level(AUX);
 }
 
 uint32_t stepper_get_period(stepper_E stepper) {
    return stepper_states[stepper].period;
 }
 
+uint32_t stepper_get_period_fine(stepper_E stepper) {
+   return stepper_states[stepper].period << 8 | stepper_states[stepper].period_frac;
+}
+
 uint32_t stepper_get_target(stepper_E stepper) {
    return stepper_states[stepper].target;
 }
 
+uint32_t stepper_get_brake(stepper_E stepper) {
+   return stepper_states[stepper].brake;
+}
+
 stepper_mode_E stepper_get_mode(stepper_E stepper) {
    return stepper_states[stepper].mode;
 }
@@ -270,29 +887,982 @@ stepper_dir_E stepper_get_dir(stepper_E stepper) {
    return stepper_states[stepper].dir;
 }
 
+uint32_t stepper_get_accel(stepper_E stepper) {
+   return stepper_states[stepper].accel;
+}
+
+stepper_guide_E stepper_get_guide(stepper_E stepper) {
+   return stepper_states[stepper].guide;
+}
+
+bool stepper_guiding(stepper_E stepper) {
+   return stepper_states[stepper].guide_offset != 0;
+}
+
 bool stepper_get_fault(stepper_E stepper) {
    return !gpio_get_level(stepper_states[stepper].pins.nfault);
 }
 
+// lock free, retries while a writer publishes so all fields belong to the same moment
+void IRAM_ATTR stepper_get_snapshot(stepper_E stepper, stepper_snapshot_S *snapshot) {
+   stepper_state_S *state = &stepper_states[stepper];
+   for(;;) {
+      uint32_t seq = __atomic_load_n(&state->seq, __ATOMIC_ACQUIRE);
+      if(seq & 1)
+         continue;
+
+      *snapshot = (stepper_snapshot_S) {
+         .count       = stepper_position(state),
+         .target      = state->target,
+         .period      = state->period,
+         .period_fine = state->period << 8 | state->period_frac,
+         .mode        = state->mode,
+         .speed       = state->speed,
+         .dir         = state->dir,
+         .busy        = state->state != STEPPER_STOP,
+      };
+
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if(__atomic_load_n(&state->seq, __ATOMIC_RELAXED) == seq)
+         break;
+   }
+   snapshot->fault = stepper_get_fault(stepper);
+}
+
+// interrupts taken since the last reset and the share of one core spent in them, in permille
+void stepper_get_isr_stats(stepper_E stepper, uint32_t *count, uint32_t *load) {
+   stepper_state_S *state = &stepper_states[stepper];
+   uint64_t elapsed = esp_timer_get_time() - isr_stats_start; // us
+
+   *count = state->isr_count;
+   *load = elapsed ? state->isr_cycles * 1000 / (elapsed * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ) : 0;
+}
+
+void stepper_reset_isr_stats(void) {
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      stepper_state_S *state = &stepper_states[stepper];
+      state->isr_count = 0;
+      state->isr_cycles = 0;
+      state->rmt_segments = 0;
+      state->rmt_underruns = 0;
+      state->rmt_slips = 0;
+#if STEPPER_PROBE
+      state->isr_min = UINT32_MAX;
+      state->isr_max = 0;
+      state->probe = (stepper_probe_S) {0};
+#endif
+   }
+   isr_stats_start = esp_timer_get_time();
+}
+
+// false when the build leaves the probe out
+bool stepper_get_probe(stepper_E stepper, stepper_probe_S *probe) {
+#if STEPPER_PROBE
+   stepper_state_S *state = &stepper_states[stepper];
+   *probe = state->probe;
+   probe->callbacks = state->isr_count;
+   if(state->isr_count) {
+      probe->min_ns = state->isr_min * 1000ULL / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+      probe->mean_ns = state->isr_cycles * 1000 / state->isr_count / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+      probe->max_ns = state->isr_max * 1000ULL / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+   }
+   return true;
+#else
+   return false;
+#endif
+}
+
+// false for axes driven by MCPWM
+bool stepper_get_rmt_stats(stepper_E stepper, stepper_rmt_stats_S *stats) {
+   stepper_state_S *state = &stepper_states[stepper];
+   if(!stepper_uses_rmt(state))
+      return false;
+
+   *stats = (stepper_rmt_stats_S) {
+      .segments  = state->rmt_segments,
+      .underruns = state->rmt_underruns,
+      .slips     = state->rmt_slips,
+   };
+   return true;
+}
+
 static bool IRAM_ATTR stepper_timer_stop_callback(mcpwm_timer_handle_t timer, const mcpwm_timer_event_data_t *edata, void *user_ctx) {
    stepper_state_S *state = user_ctx;
+   BaseType_t woken = pdFALSE;
+   state->sync_wait = false;
    //gpio_set_level(state->pins.nena, 1);
-   state->state = STEPPER_STOP;
-   return false;
+   if(!state->guide_hold) {
+      stepper_publish_begin(state);
+      state->state = STEPPER_STOP;
+      stepper_publish_end(state);
+   }
+
+   // lets stepper_task switch the interrupts off and go to sleep
+   if(task_handle)
+      vTaskNotifyGiveFromISR(task_handle, &woken);
+   return woken == pdTRUE;
 }
 
+// only enabled while the ramp needs updating, the pulse counter already counted this step
 static bool IRAM_ATTR stepper_pulse_callback(mcpwm_cmpr_handle_t comparator, const mcpwm_compare_event_data_t *edata, void *user_ctx) {
    stepper_state_S *state = user_ctx;
+   uint32_t start = esp_cpu_get_cycle_count();
+
+   // no step went out, the timer idles until the sync
+   if(state->sync_wait) {
+      stepper_sync_arm(state);
+      stepper_isr_account(state, start);
+      return false;
+   }
+
+#if STEPPER_PROBE
+   stepper_probe_step(state, start);
+#endif
+
+   if(state->mode == STEPPER_GOTO && stepper_position(state) == state->target) {
+      stepper_timer_halt(state);
+   } else {
+      if(state->mode == STEPPER_GOTO)
+         stepper_brake(state);
+      stepper_ramp(state);
+   }
+
+   stepper_isr_account(state, start);
+   return false;
+}
+
+// fires on the counter limits and on the goto target watch point
+static bool IRAM_ATTR stepper_counter_callback(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *edata, void *user_ctx) {
+   stepper_state_S *state = user_ctx;
+   uint32_t start = esp_cpu_get_cycle_count();
+
+   // the driver has counted the wrap already, only the watch points follow the hardware counter
+   if(edata->watch_point_value == COUNTER_LIMIT || edata->watch_point_value == -COUNTER_LIMIT)
+      state->watch_base += edata->watch_point_value * (int32_t) state->ustep_scale;
+
+   // watch points match any window of the counter, so check the full position
+   if(!stepper_uses_rmt(state) && state->mode == STEPPER_GOTO && stepper_position(state) == state->target)
+      stepper_timer_halt(state);
+
+   stepper_isr_account(state, start);
+   return false;
+}
+
+// the first compare event of a coordinated start, the timer has latched its idle period by now and takes the
+// first step period on the next wrap, the last axis to get here pulses the sync pin, which loads every timer
+// with its peak so they all wrap on the next tick and step together from there
+// the driver keeps mcpwm_generator_set_force_level in flash, the force is released through the LL layer
+// on the one operator and generator of the group, gpio_set_level is in IRAM with GPIO_CTRL_FUNC_IN_IRAM
+static void IRAM_ATTR stepper_sync_arm(stepper_state_S *state) {
+   state->sync_wait = false;
+   stepper_timer_period(state, stepper_ramp_period(state));
+   mcpwm_ll_gen_disable_continue_force_action(MCPWM_LL_GET_HW(state->id), 0, 0);
+
+   if(__atomic_sub_fetch(&sync_pending, 1, __ATOMIC_ACQ_REL) == 0) {
+      gpio_set_level(SYNC, 1);
+      gpio_set_level(SYNC, 0);
+   }
+}
+
+// writers may be tasks on either core or the ISRs, the spinlock keeps them from interleaving
+static void IRAM_ATTR stepper_publish_begin(stepper_state_S *state) {
+   portENTER_CRITICAL_SAFE(&state->publish_lock);
+   __atomic_store_n(&state->seq, state->seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void IRAM_ATTR stepper_publish_end(stepper_state_S *state) {
+   __atomic_store_n(&state->seq, state->seq + 1, __ATOMIC_RELEASE);
+   portEXIT_CRITICAL_SAFE(&state->publish_lock);
+}
+
+static void stepper_wake(void) {
+   if(task_handle)
+      xTaskNotifyGive(task_handle);
+}
+
+// RMT axes have no per step interrupt, their ramp is computed ahead
+static void stepper_step_isr(stepper_state_S *state, bool enable) {
+   if(stepper_uses_rmt(state) || state->step_isr == enable)
+      return;
+
+   mcpwm_comparator_event_callbacks_t cmpr_callback = {
+      .on_reach = enable ? stepper_pulse_callback : NULL,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_comparator_register_event_callbacks(state->comparator, &cmpr_callback, (void*) state));
+   state->step_isr = enable;
+#if STEPPER_PROBE
+   state->probe_last = 0; // steps went by unseen
+#endif
+}
+
+static bool stepper_needs_step_isr(stepper_state_S *state) {
+   // the first compare event arms the sync
+   if(state->sync_wait)
+      return true;
+
+   switch(state->state) {
+      case STEPPER_STOP:
+         return false;
+      case STEPPER_CRUISE:
+         break;
+      default:
+         return true;
+   }
+
+   // the resolution changes on the next full step
+   if(stepper_ustep_target(state) != state->ustep_scale)
+      return true;
+
+   // the probe has to see every step
+   if(STEPPER_PROBE || stepper_dithering(state))
+      return true;
+
+   if(state->mode != STEPPER_GOTO)
+      return false;
+
+   // steps before stepper_brake has to act, unramped gotos just stop on the target watch point
+   uint32_t trigger = state->ramp_step;
+   if(state->speed == STEPPER_FAST && !state->coordinated && state->brake > trigger &&
+      state->target_delay < stepper_cruise_delay(state, STEPPER_SLOW))
+      trigger = state->brake;
+   if(trigger == 0)
+      return false;
+
+   // switch on two task periods ahead
+   uint32_t margin = 2 * (STEPPER_FREQ * PULSE_WIDTH_FACTOR / 100 << 8) / state->ramp_delay + 16;
+   return stepper_remaining(state) <= trigger + margin;
+}
+
+// a watch point only sees the 16 bit counter, arm the target once it is within this or the next window
+// coarse pulses could step over it, the axis is back at 1/32 before it gets there anyway
+static void stepper_watch_target(stepper_state_S *state) {
+   int watch = NO_WATCH;
+
+   if(!stepper_uses_rmt(state) && state->ustep_scale == 1 && state->mode == STEPPER_GOTO && state->state != STEPPER_STOP) {
+      int32_t offset = state->target - state->watch_base;
+      if(offset >= COUNTER_LIMIT) offset -= COUNTER_LIMIT;
+      else if(offset <= -COUNTER_LIMIT) offset += COUNTER_LIMIT;
+      if(offset > -COUNTER_LIMIT && offset < COUNTER_LIMIT) watch = offset;
+   }
+
+   if(watch == state->target_watch)
+      return;
+
+   if(state->target_watch != NO_WATCH)
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_remove_watch_point(state->counter, state->target_watch));
+   if(watch != NO_WATCH)
+      ESP_ERROR_CHECK_WITHOUT_ABORT(pcnt_unit_add_watch_point(state->counter, watch));
+   state->target_watch = watch;
+}
+
+static bool IRAM_ATTR stepper_uses_rmt(stepper_state_S *state) {
+   return STEPPER_RMT_AXES >> state->id & 1;
+}
+
+// retries when a counter wrap is handled in between
+static uint32_t IRAM_ATTR stepper_position(stepper_state_S *state) {
+   uint32_t base, scale;
+   int count;
+   do {
+      base = state->count_base;
+      pcnt_unit_get_count(state->counter, &count);
+      scale = state->ustep_scale;
+   } while(base != state->count_base);
+   return base + count * (int32_t) scale;
+}
+
+// RMT axes brake on the steps generated, which run ahead of the steps counted
+static uint32_t IRAM_ATTR stepper_remaining(stepper_state_S *state) {
+   uint32_t position = stepper_uses_rmt(state) ? state->rmt_count : stepper_position(state);
+   return state->dir == STEPPER_CW ? state->target - position : position - state->target;
+}
+
+// fractional slow cruise periods alternate between whole ticks every step, fast ones just round
+// unless the axis follows the line of a coordinated move
+static bool IRAM_ATTR stepper_dithering(stepper_state_S *state) {
+   return state->state == STEPPER_CRUISE && (state->speed == STEPPER_SLOW || state->coordinated) && (state->ramp_delay & 0xFF);
+}
+
+static void IRAM_ATTR stepper_isr_account(stepper_state_S *state, uint32_t start) {
+   uint32_t cycles = esp_cpu_get_cycle_count() - start;
+   state->isr_count++;
+   state->isr_cycles += cycles;
+#if STEPPER_PROBE
+   if(cycles < state->isr_min) state->isr_min = cycles;
+   if(cycles > state->isr_max) state->isr_max = cycles;
+#endif
+}
+
+// the period goes through here so the probe knows what each timer cycle should last
+static esp_err_t IRAM_ATTR stepper_timer_period(stepper_state_S *state, uint32_t ticks) {
+#if STEPPER_PROBE
+   state->probe_pending = ticks;
+#endif
+   return mcpwm_timer_set_period(state->timer, ticks);
+}
+
+// stops an MCPWM axis once the pulse in flight is out, also from the ISRs while the cache is off, so
+// through the LL layer since the driver keeps mcpwm_timer_start_stop in flash, each group has one timer
+static void IRAM_ATTR stepper_timer_halt(stepper_state_S *state) {
+   // a held timer has already stopped, there is no stop event to wait for
+   if(state->guide_hold) {
+      state->guide_hold = false;
+      stepper_publish_begin(state);
+      state->state = STEPPER_STOP;
+      stepper_publish_end(state);
+   }
+   mcpwm_ll_timer_set_start_stop_command(MCPWM_LL_GET_HW(state->id), 0, MCPWM_TIMER_STOP_FULL);
+}
+
+#if STEPPER_PROBE
+// the compare event fires at the same point of every timer cycle, so the time since the
+// previous one is the length of the cycle that just ended, anything else is interrupt latency
+static void IRAM_ATTR stepper_probe_step(stepper_state_S *state, uint32_t now) {
+   stepper_probe_S *probe = &state->probe;
+   if(state->probe_last) {
+      int32_t deviation = (int32_t) (now - state->probe_last - state->probe_active * CYCLES_PER_TICK);
+      int32_t ns = (int64_t) deviation * 1000 / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+      if(ns < probe->early_ns) probe->early_ns = ns;
+      if(ns > probe->late_ns) probe->late_ns = ns;
+
+      uint32_t scaled = (ns < 0 ? -(uint32_t) ns : (uint32_t) ns) / 125;
+      size_t bucket = scaled ? 32 - __builtin_clz(scaled) : 0;
+      if(bucket >= STEPPER_PROBE_BUCKETS) bucket = STEPPER_PROBE_BUCKETS - 1;
+      probe->hist[bucket]++;
+      probe->intervals++;
+   }
+   state->probe_last = now ? now : 1;
+   state->probe_active = state->probe_pending;
+}
+#endif
+
+// starts streaming an RMT axis from the current position, both segments are filled before the
+// first symbol goes out and the encoder moves from one to the other from then on
+static void stepper_rmt_start(stepper_state_S *state) {
+   state->rmt_count = stepper_position(state);
+   state->rmt_playing = 0;
+   state->rmt_filling = 0;
+   state->rmt_ending = false;
+   state->rmt_last = false;
+   state->rmt_rest = 0;
+   state->rmt_streaming = true;
+   stepper_rmt_service(state);
+
+   // the encoder reads the segments, not the payload
+   rmt_transmit_config_t transmit_config = {
+      .loop_count = 0,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(rmt_transmit(state->rmt_channel, &state->rmt_encoder, state, 1, &transmit_config));
+}
+
+// accounts a stream that has run out or cuts off one still running, the next stream starts from the counted position
+static void stepper_rmt_end(stepper_state_S *state) {
+   if(!state->rmt_streaming)
+      return;
+
+   if(state->state == STEPPER_STOP) {
+      // every step generated should have reached the counter by now
+      if(stepper_position(state) != state->rmt_count)
+         state->rmt_slips++;
+   } else {
+      ESP_ERROR_CHECK_WITHOUT_ABORT(rmt_disable(state->rmt_channel));
+      ESP_ERROR_CHECK_WITHOUT_ABORT(rmt_enable(state->rmt_channel));
+   }
+
+   stepper_rmt_reset(&state->rmt_encoder);
+   for(int i = 0; i < 2; i++)
+      __atomic_store_n(&state->segments[i].ready, false, __ATOMIC_RELAXED);
+   state->rmt_streaming = false;
+   state->rmt_count = stepper_position(state);
+}
+
+// refills the segments the encoder has handed back in the order they play, rate changes and stops
+// made in between reach the pins after the segments already queued and the channel memory
+static void stepper_rmt_service(stepper_state_S *state) {
+   if(!state->rmt_streaming)
+      return;
+
+   if(state->state == STEPPER_STOP) {
+      stepper_rmt_end(state);
+      return;
+   }
+
+   while(!state->rmt_last) {
+      stepper_segment_S *segment = &state->segments[state->rmt_filling];
+      if(__atomic_load_n(&segment->ready, __ATOMIC_ACQUIRE))
+         break;
+      stepper_rmt_fill(state, segment);
+      state->rmt_filling ^= 1;
+   }
+}
+
+// generates steps until the segment lasts four task ticks or is out of symbols, running the same ramp
+// and brake as the step interrupt of an MCPWM axis, only ahead of the pins
+// the driver refills the channel memory every half of it sent, symbols are kept short so that stays
+// close to the pins in time, the low part of a slow step runs on over as many symbols as it takes
+static void stepper_rmt_fill(stepper_state_S *state, stepper_segment_S *segment) {
+   uint32_t ticks = 0;
+   segment->count = 0;
+
+   while(ticks < SEGMENT_TICKS * RMT_TICKS_PER_TICK && segment->count < SEGMENT_SYMBOLS) {
+      // the guide offset cancels tracking, hold a symbol at a time
+      if(!state->rmt_rest && state->guide_hold)
+         state->rmt_rest = RMT_SYMBOL_MAX;
+
+      rmt_symbol_word_t *symbol = &segment->symbols[segment->count++];
+      if(state->rmt_rest) {
+         // both halves need a duration, so never leave a single tick for the next symbol
+         uint32_t low = state->rmt_rest < RMT_SYMBOL_MAX ? state->rmt_rest : RMT_SYMBOL_MAX;
+         low -= state->rmt_rest - low == 1;
+         *symbol = (rmt_symbol_word_t) {
+            .level0 = 0, .duration0 = low / 2,
+            .level1 = 0, .duration1 = low - low / 2,
+         };
+         state->rmt_rest -= low;
+         ticks += low;
+      } else {
+         // the pulse is high for one MCPWM tick like the compare event makes it, low for the rest of the period
+         uint32_t period = stepper_ramp_period(state);
+         uint32_t low = ((period > 2 ? period : 2) - 1) * RMT_TICKS_PER_TICK;
+         uint32_t first = RMT_SYMBOL_MAX - RMT_TICKS_PER_TICK;
+         if(low <= first) first = low;
+         else first -= low - first == 1;
+         *symbol = (rmt_symbol_word_t) {
+            .level0 = 1, .duration0 = RMT_TICKS_PER_TICK,
+            .level1 = 0, .duration1 = first,
+         };
+         state->rmt_rest = low - first;
+         ticks += RMT_TICKS_PER_TICK + first;
+         state->rmt_count += state->dir == STEPPER_CW ? 1 : -1;
+
+         if(state->mode == STEPPER_GOTO && state->rmt_count == state->target) {
+            state->rmt_ending = true;
+         } else {
+            if(state->mode == STEPPER_GOTO)
+               stepper_brake(state);
+            state->rmt_ending = !stepper_ramp_advance(state);
+         }
+      }
+
+      // the stream ends with the period of its last step
+      if(state->rmt_ending && !state->rmt_rest) {
+         state->rmt_last = true;
+         break;
+      }
+   }
+
+   segment->last = state->rmt_last;
+   __atomic_store_n(&segment->ready, true, __ATOMIC_RELEASE);
+}
+
+static stepper_state_S *IRAM_ATTR stepper_rmt_state(rmt_encoder_t *encoder) {
+   return (stepper_state_S*) ((char*) encoder - offsetof(stepper_state_S, rmt_encoder));
+}
+
+// the driver calls this whenever the channel memory has room, it copies on from the segment playing and
+// hands it back once sent, a segment not ready in time is covered by a gap so the stream keeps going
+static size_t IRAM_ATTR stepper_rmt_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *data, size_t size, rmt_encode_state_t *ret_state) {
+   static const DRAM_ATTR rmt_symbol_word_t UNDERRUN_GAP = {.duration0 = 50, .duration1 = 50}; // RMT_SYMBOL_MAX
+   stepper_state_S *state = stepper_rmt_state(encoder);
+   rmt_encoder_handle_t copy = state->rmt_copy;
+   uint32_t start = esp_cpu_get_cycle_count();
+   size_t encoded = 0;
+
+   for(;;) {
+      stepper_segment_S *segment = &state->segments[state->rmt_playing];
+      if(!state->rmt_gap && !__atomic_load_n(&segment->ready, __ATOMIC_ACQUIRE)) {
+         state->rmt_gap = true;
+         state->rmt_underruns++;
+      }
+
+      rmt_encode_state_t copy_state = RMT_ENCODING_RESET;
+      if(state->rmt_gap)
+         encoded += copy->encode(copy, channel, &UNDERRUN_GAP, sizeof(UNDERRUN_GAP), &copy_state);
+      else
+         encoded += copy->encode(copy, channel, segment->symbols, segment->count * sizeof(rmt_symbol_word_t), &copy_state);
+
+      if(copy_state & RMT_ENCODING_COMPLETE) {
+         copy->reset(copy);
+         if(state->rmt_gap) {
+            state->rmt_gap = false;
+         } else {
+            bool last = segment->last;
+            __atomic_store_n(&segment->ready, false, __ATOMIC_RELEASE);
+            state->rmt_playing ^= 1;
+            state->rmt_segments++;
+            if(last) {
+               *ret_state = RMT_ENCODING_COMPLETE;
+               break;
+            }
+         }
+      }
+
+      if(copy_state & RMT_ENCODING_MEM_FULL) {
+         *ret_state = RMT_ENCODING_MEM_FULL;
+         break;
+      }
+   }
+
+   stepper_isr_account(state, start);
+   return encoded;
+}
+
+static esp_err_t IRAM_ATTR stepper_rmt_reset(rmt_encoder_t *encoder) {
+   stepper_state_S *state = stepper_rmt_state(encoder);
+   state->rmt_gap = false;
+   return rmt_encoder_reset(state->rmt_copy);
+}
+
+// the encoder lives in the stepper state
+static esp_err_t stepper_rmt_del(rmt_encoder_t *encoder) {
+   return ESP_OK;
+}
+
+// the last segment has gone out, stepper_task accounts the stream
+static bool IRAM_ATTR stepper_rmt_done(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_ctx) {
+   stepper_state_S *state = user_ctx;
+   BaseType_t woken = pdFALSE;
+   stepper_publish_begin(state);
+   state->state = STEPPER_STOP;
+   stepper_publish_end(state);
+
+   if(task_handle)
+      vTaskNotifyGiveFromISR(task_handle, &woken);
+   return woken == pdTRUE;
+}
+
+// moves a running axis to the current T1, ramping along the same profile as stepper_start would
+// the timer latches new periods on its empty event, so the pulse in flight keeps its length
+static void stepper_retarget(stepper_state_S *state) {
+   if(state->state == STEPPER_STOP || state->state == STEPPER_DECCEL)
+      return;
+
+   uint32_t delay = stepper_cruise_delay(state, state->speed);
+   uint32_t ramp_delay = state->ramp_delay;
+   stepper_state_E next;
 
-   if(state->dir == STEPPER_CW) {
-      state->count++;
+   if(state->ramp_step == 0) {
+      // at or below the first ramp step rates change at once, like stepper_start
+      if(delay >= state->ramp_c0) {
+         ramp_delay = delay;
+         next = STEPPER_CRUISE;
+      } else {
+         ramp_delay = state->ramp_c0;
+         next = STEPPER_ACCEL;
+      }
+   } else if(delay < ramp_delay) {
+      next = STEPPER_ACCEL;
+   } else if(delay > ramp_delay) {
+      next = STEPPER_SLOWDOWN;
    } else {
-      state->count--;
+      next = STEPPER_CRUISE;
    }
 
-   if(state->mode == STEPPER_GOTO && state->count == state->target) {
+   // the step interrupt and the snapshot readers see the new ramp as a whole
+   stepper_publish_begin(state);
+   state->target_delay = delay;
+   state->ramp_delay = ramp_delay;
+   state->ramp_frac = 0x80;
+   state->state = next;
+   stepper_publish_end(state);
+
+   // the ramp loads its periods step by step, a plain rate change is loaded here
+   // RMT axes pick the new rate up with the next segment
+   if(stepper_uses_rmt(state))
+      return;
+   if(next == STEPPER_CRUISE || state->ramp_step == 0)
+      ESP_ERROR_CHECK_WITHOUT_ABORT(stepper_timer_period(state, stepper_ramp_period(state)));
+   stepper_step_isr(state, true);
+}
+
+// applies the guide offset to a tracking axis, an offset (nearly) cancelling the tracking rate
+// holds the timer after the step in flight, the axis still counts as running
+static void stepper_guide_apply(stepper_state_S *state) {
+   if(state->state == STEPPER_STOP)
+      return;
+
+   // below the slowest period the timer could not pick up tracking again for a long time
+   uint64_t tracking = (uint64_t) (state->period << 8 | state->period_frac) * PULSE_WIDTH_FACTOR;
+   bool hold = stepper_guide_delay(state, tracking) > (uint64_t) MAX_PERIOD << 8;
+
+   // RMT axes fill gaps instead of steps while held
+   if(hold) {
+      state->guide_hold = true;
+      if(!stepper_uses_rmt(state))
+         ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_start_stop(state->timer, MCPWM_TIMER_STOP_FULL));
+      return;
+   }
+
+   stepper_retarget(state);
+   if(state->guide_hold) {
+      state->guide_hold = false;
+      if(!stepper_uses_rmt(state))
+         ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_start_stop(state->timer, MCPWM_TIMER_START_NO_STOP));
+   }
+}
+
+// guide timer callback, the pulse ends on the motion task
+static void stepper_guide_end(void *arg) {
+   stepper_call(stepper_guide_finish, arg);
+}
+
+static void stepper_guide_finish(void *arg) {
+   stepper_state_S *state = arg;
+   state->guide_offset = 0;
+
+   if(state->guide_alone) {
+      state->guide_alone = false;
+      stepper_publish_begin(state);
+      state->mode = state->guide_mode;
+      state->speed = state->guide_speed;
+      state->dir = state->guide_dir;
+      stepper_publish_end(state);
       stepper_stop_instant(state->id);
+   } else {
+      stepper_guide_apply(state);
    }
+}
 
-   return false;
+// moves the scripts on as soon as a move is done, a client would lose a round trip and its polling
+// interval to every move, runs after every call and every wake of the motion task
+static void stepper_script_service(void) {
+   bool progress;
+   do {
+      progress = false;
+      for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+         progress |= stepper_script_finish(&stepper_states[stepper]);
+      progress |= stepper_script_begin();
+   } while(progress);
+}
+
+// ends the move running once the axis has got to its target or its time is up and it has stopped
+static bool stepper_script_finish(stepper_state_S *state) {
+   if(!state->script_active)
+      return false;
+
+   const stepper_move_S *move = &state->script[state->script_head % STEPPER_SCRIPT_MOVES];
+   bool stopped = state->state == STEPPER_STOP;
+   if(move->type == STEPPER_MOVE_GOTO ? !stopped :
+      move->type == STEPPER_MOVE_RATE ? !stopped || !state->script_expired : !state->script_expired)
+      return false;
+
+   state->script_active = false;
+   state->script_head++;
+   state->script_done++;
+   return true;
+}
+
+// starts the next move of every axis ready for one, joint moves once every axis is at one,
+// all of them gotos start as one coordinated move
+static bool stepper_script_begin(void) {
+   bool started = false, joint = true, gotos = true;
+
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++) {
+      stepper_state_S *state = &stepper_states[stepper];
+      stepper_move_S *move = stepper_script_ready(state);
+      if(!move || move->joint) {
+         joint &= move != NULL;
+         gotos &= move && move->type == STEPPER_MOVE_GOTO;
+         continue;
+      }
+      stepper_script_start(state, true);
+      started = true;
+      joint = false;
+   }
+   if(!joint)
+      return started;
+
+   for(stepper_E stepper = STEPPER_0; stepper != STEPPER_COUNT; stepper++)
+      stepper_script_start(&stepper_states[stepper], !gotos);
+   if(gotos)
+      stepper_start_coordinated();
+   return true;
+}
+
+// the move next in the script when the axis is free to start it
+static stepper_move_S *stepper_script_ready(stepper_state_S *state) {
+   if(!state->script_running || state->script_active || state->script_head == state->script_tail ||
+      state->state != STEPPER_STOP)
+      return NULL;
+   return &state->script[state->script_head % STEPPER_SCRIPT_MOVES];
+}
+
+// sets the axis up for the move at the head of its script as the SynScan commands would, a goto is left
+// for stepper_start_coordinated unless start, a rate move already running just changes to the new T1
+static void stepper_script_start(stepper_state_S *state, bool start) {
+   const stepper_move_S *move = &state->script[state->script_head % STEPPER_SCRIPT_MOVES];
+   state->script_active = true;
+   state->script_expired = false;
+
+   if(move->aux != STEPPER_AUX_KEEP)
+      stepper_set_aux(move->aux == STEPPER_AUX_ON);
+
+   switch(move->type) {
+      case STEPPER_MOVE_GOTO:
+         stepper_set_mode(state->id, STEPPER_GOTO, move->speed,
+                          (int32_t) (move->target - stepper_position(state)) < 0 ? STEPPER_CCW : STEPPER_CW);
+         if(move->period_fine)
+            stepper_set_period_fine(state->id, move->period_fine);
+         stepper_set_target(state->id, move->target);
+         if(start)
+            stepper_start(state->id);
+         return;
+
+      case STEPPER_MOVE_RATE:
+         stepper_set_mode(state->id, STEPPER_TRACKING, move->speed, move->dir);
+         if(move->period_fine)
+            stepper_set_period_fine(state->id, move->period_fine);
+         if(state->state == STEPPER_STOP)
+            stepper_start(state->id);
+         break;
+
+      default:
+         break;
+   }
+   ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(state->script_timer, (uint64_t) move->ms * 1000));
+}
+
+// script timer callback, the time of the move ends on the motion task
+static void stepper_script_end(void *arg) {
+   stepper_call(stepper_script_expire, arg);
+}
+
+// a rate move carries straight on into a next rate move the same way, otherwise it stops
+// the next move starts as stepper_task comes round
+static void stepper_script_expire(void *arg) {
+   stepper_state_S *state = arg;
+   if(!state->script_active || state->script_expired)
+      return;
+
+   state->script_expired = true;
+   stepper_wake();
+   const stepper_move_S *move = &state->script[state->script_head % STEPPER_SCRIPT_MOVES];
+   if(move->type != STEPPER_MOVE_RATE)
+      return;
+
+   const stepper_move_S *next = &state->script[(state->script_head + 1) % STEPPER_SCRIPT_MOVES];
+   if(state->script_tail - state->script_head > 1 && next->type == STEPPER_MOVE_RATE && !next->joint &&
+      next->dir == move->dir && next->speed == move->speed &&
+      state->state != STEPPER_STOP && state->state != STEPPER_DECCEL) {
+      state->script_head++;
+      state->script_done++;
+      stepper_script_start(state, true);
+   } else {
+      stepper_stop(state->id);
+   }
+}
+
+// adds the guide offset to the rate of a cruise delay, 1 / d' = 1 / d + g / (8 d_sidereal)
+static uint64_t IRAM_ATTR stepper_guide_delay(stepper_state_S *state, uint64_t delay) {
+   int64_t sidereal = 8 * (int64_t) state->sidereal_delay;
+   if(state->guide_alone)
+      return sidereal / state->guide_offset;
+
+   int64_t den = sidereal + state->guide_offset * (int64_t) delay;
+   return den > 0 ? sidereal * delay / den : UINT64_MAX;
+}
+
+// start deccelerating early enough to stop right on the target
+static void IRAM_ATTR stepper_brake(stepper_state_S *state) {
+   if(state->state == STEPPER_DECCEL)
+      return;
+
+   uint32_t remaining = stepper_remaining(state);
+
+   // running the ramp back down takes exactly ramp_step steps, coarse pulses may have gone past
+   // that point by a few microsteps, so drop those from the ramp to end right on the target
+   if(remaining <= state->ramp_step) {
+      state->state = STEPPER_DECCEL;
+      while(state->ramp_step > remaining)
+         stepper_ramp_down(state);
+      return;
+   }
+
+   // high speed goto drops to low speed at the brake point, like the skywatcher boards do,
+   // a coordinated move would leave its line, it ramps straight down to the target instead
+   if(state->speed == STEPPER_FAST && !state->coordinated && remaining <= state->brake) {
+      uint32_t slow_delay = stepper_cruise_delay(state, STEPPER_SLOW);
+      if(state->target_delay < slow_delay) {
+         state->target_delay = slow_delay;
+         if(state->ramp_delay < slow_delay)
+            state->state = STEPPER_SLOWDOWN;
+      }
+   }
+}
+
+// the resolution the axis should pulse at, a level coarser while pulses would come faster than the step
+// clock and a level finer once they would be twice as slow, 1/32 for tracking and the last two full steps
+// of a goto, RMT axes stay at 1/32 as their segments are generated ahead of the pins
+static uint32_t IRAM_ATTR stepper_ustep_target(stepper_state_S *state) {
+   uint32_t scale = state->ustep_scale;
+   if(stepper_uses_rmt(state) || (state->mode == STEPPER_TRACKING && state->speed == STEPPER_SLOW) ||
+      (state->mode == STEPPER_GOTO && stepper_remaining(state) < 2 * USTEP_FULL))
+      return 1;
+
+   uint64_t pulse = (uint64_t) state->ramp_delay * scale;
+   if(scale < USTEP_SCALE_MAX && pulse < USTEP_MIN_PERIOD)
+      return scale * 2;
+   if(scale > 1 && pulse >= 4 * USTEP_MIN_PERIOD)
+      return scale / 2;
+   return scale;
+}
+
+// changes the resolution on a full step, where every resolution of the driver has a position, so the
+// translator never rounds one away, or at standstill back to 1/32, which has a position for each of them
+// runs right after a pulse, the pulse counter restarts at the new scale well before the next one
+static bool IRAM_ATTR stepper_ustep_switch(stepper_state_S *state, bool standstill) {
+   uint32_t scale = standstill ? 1 : stepper_ustep_target(state);
+   if(scale == state->ustep_scale)
+      return false;
+   if(!standstill && (stepper_position(state) - state->phase_origin) % USTEP_FULL)
+      return false;
+
+   int count;
+   stepper_publish_begin(state);
+   pcnt_unit_get_count(state->counter, &count);
+   state->count_base += count * (int32_t) state->ustep_scale;
+   state->watch_base = state->count_base;
+   pcnt_unit_clear_count(state->counter);
+   state->ustep_scale = scale;
+   state->ustep = USTEP_MODES[scale];
+   stepper_publish_end(state);
+
+   stepper_ustep_pins(state);
+   return true;
+}
+
+static void IRAM_ATTR stepper_ustep_pins(stepper_state_S *state) {
+   gpio_set_level(state->pins.ms1, (state->ustep >> 0) & 1);
+   gpio_set_level(state->pins.ms2, (state->ustep >> 1) & 1);
+   gpio_set_level(state->pins.ms3, (state->ustep >> 2) & 1);
+}
+
+// the new period is latched by the timer on the next empty event, so the current pulse is never cut short
+static void IRAM_ATTR stepper_ramp(stepper_state_S *state) {
+   if(state->state == STEPPER_STOP)
+      return;
+
+   // a new resolution changes the period of the next pulse
+   bool load = stepper_ustep_switch(state, false);
+
+   // the cruise period is already loaded unless it dithers
+   if(state->state != STEPPER_CRUISE || stepper_dithering(state)) {
+      // the next pulse covers ustep_scale microsteps of the ramp
+      for(uint32_t n = state->ustep_scale; n; n--) {
+         if(!stepper_ramp_advance(state)) {
+            stepper_timer_halt(state);
+            return;
+         }
+      }
+      load = true;
+   }
+
+   if(load)
+      stepper_timer_period(state, stepper_ramp_period(state));
+}
+
+// constant acceleration ramp, advanced once per step (D. Austin, "Generate stepper-motor speed profiles in real time")
+// c_n = c_n-1 - 2 * c_n-1 / (4n + 1) speeds up, running n back down retraces the same profile
+// false once the decceleration has run the ramp down to standstill
+static bool IRAM_ATTR stepper_ramp_advance(stepper_state_S *state) {
+   switch(state->state) {
+      case STEPPER_ACCEL:
+         stepper_ramp_up(state);
+         if(state->ramp_delay <= state->target_delay) {
+            state->ramp_delay = state->target_delay;
+            state->state = STEPPER_CRUISE;
+         }
+         break;
+
+      case STEPPER_SLOWDOWN:
+         stepper_ramp_down(state);
+         if(state->ramp_delay >= state->target_delay || state->ramp_step == 0) {
+            state->ramp_delay = state->target_delay;
+            state->state = STEPPER_CRUISE;
+         }
+         break;
+
+      case STEPPER_CRUISE:
+         break;
+
+      case STEPPER_DECCEL:
+         if(state->ramp_step == 0)
+            return false;
+         stepper_ramp_down(state);
+         break;
+
+      default:
+         return false;
+   }
+
+   // ramps round to the nearest tick, dithering only pays off at a steady rate
+   if(!stepper_dithering(state))
+      state->ramp_frac = 0x80;
+   return true;
+}
+
+static void IRAM_ATTR stepper_ramp_up(stepper_state_S *state) {
+   state->ramp_step++;
+   uint32_t num = 2 * state->ramp_delay + state->ramp_rest;
+   uint32_t den = 4 * state->ramp_step + 1;
+   state->ramp_delay -= num / den;
+   state->ramp_rest = num % den;
+}
+
+static void IRAM_ATTR stepper_ramp_down(stepper_state_S *state) {
+   if(state->ramp_step == 0)
+      return;
+
+   uint32_t num = 2 * state->ramp_delay + state->ramp_rest;
+   uint32_t den = 4 * state->ramp_step - 1;
+   state->ramp_delay += num / den;
+   state->ramp_rest = num % den;
+   state->ramp_step--;
+
+   if(state->ramp_delay > MAX_PERIOD << 8)
+      state->ramp_delay = MAX_PERIOD << 8;
+}
+
+// Bresenham style, carries the fraction dropped from this period into the next so the
+// average period is exact to 1/256 tick, a pulse lasts as long as the microsteps it covers
+static uint32_t IRAM_ATTR stepper_ramp_period(stepper_state_S *state) {
+   uint32_t delay = state->ramp_delay * state->ustep_scale + state->ramp_frac;
+   state->ramp_frac = delay & 0xFF;
+
+   uint32_t period = delay >> 8;
+   return period ? period : 1;
+}
+
+// cruise period of the current T1 for the given speed in 24.8 fixed point ticks
+static uint32_t IRAM_ATTR stepper_cruise_delay(stepper_state_S *state, stepper_speed_E speed) {
+   uint64_t delay = ((uint64_t) state->period << 8 | state->period_frac) * PULSE_WIDTH_FACTOR;
+   if(speed == STEPPER_FAST && delay >= STEPPER_FAST_RATIO << 8)
+      delay /= STEPPER_FAST_RATIO;
+   if(state->mode == STEPPER_TRACKING && state->guide_offset)
+      delay = stepper_guide_delay(state, delay);
+   if(delay > MAX_PERIOD << 8)
+      delay = MAX_PERIOD << 8;
+   return delay;
+}
+
+// first step period of a ramp at accel steps/s^2, c0 = 0.676 * f * sqrt(2 / a) in 24.8 fixed point ticks
+static uint32_t stepper_accel_c0(uint32_t accel) {
+   if(accel == 0) accel = 1;
+   uint64_t c0 = (uint64_t) STEPPER_FREQ * PULSE_WIDTH_FACTOR * 173 * isqrt((2ULL << 32) / accel) >> 16; // 0.676 * 256 = 173
+   if(c0 > (uint64_t) MAX_PERIOD << 8) c0 = (uint64_t) MAX_PERIOD << 8;
+   return c0;
+}
+
+static uint32_t isqrt(uint64_t num) {
+   uint64_t root = 0;
+   for(uint64_t bit = 1ULL << 62; bit; bit >>= 2) {
+      if(num >= root + bit) {
+         num -= root + bit;
+         root = (root >> 1) + bit;
+      } else {
+         root >>= 1;
+      }
+   }
+   return root;
 }
@@ -7,6 +7,21 @@
 #define STEPPER_FREQ 16000
 #define STEPPER_STEPS_PER_REV 200
 #define STEPPER_FAST_RATIO 10
+#define STEPPER_DEFAULT_ACCEL 32000 // steps/s^2
+
+// step jitter probe in the interrupts, off unless the build sets -DSTEPPER_PROBE=1, see stepper_get_probe
+#ifndef STEPPER_PROBE
+#define STEPPER_PROBE 0
+#endif
+#define STEPPER_PROBE_BUCKETS 12
+
+#define STEPPER_SCRIPT_MOVES 32 // per axis, see stepper_script_add
+
+// axes whose steps are streamed by the RMT from precomputed segments instead of timed by MCPWM,
+// a bit per stepper_E, none unless the build sets e.g. -DSTEPPER_RMT_AXES=3, see stepper_get_rmt_stats
+#ifndef STEPPER_RMT_AXES
+#define STEPPER_RMT_AXES 0
+#endif
 
 typedef enum {
    STEPPER_0  = 0,
@@ -41,10 +56,71 @@ typedef enum {
    STEPPER_CCW,
 } stepper_dir_E;
 
+// in the order of the SynScan 'P' command
+typedef enum {
+   STEPPER_GUIDE_1X = 0,
+   STEPPER_GUIDE_0_75X,
+   STEPPER_GUIDE_0_5X,
+   STEPPER_GUIDE_0_25X,
+   STEPPER_GUIDE_0_125X,
+   STEPPER_GUIDE_COUNT,
+} stepper_guide_E;
+
+// a move of a motion script, see stepper_script_add
+typedef enum {
+   STEPPER_MOVE_GOTO,  // to target at T1 and speed as 'G', 'I', 'S' and 'J' would
+   STEPPER_MOVE_RATE,  // along dir at T1 and speed for ms, then stop
+   STEPPER_MOVE_DWELL, // stand still for ms
+   STEPPER_MOVE_COUNT,
+} stepper_move_E;
+
+typedef enum {
+   STEPPER_AUX_KEEP,
+   STEPPER_AUX_OFF,
+   STEPPER_AUX_ON,
+} stepper_aux_E;
+
+typedef struct {
+   stepper_move_E type;
+   stepper_speed_E speed;
+   stepper_dir_E dir;    // rate moves, gotos head for the target
+   uint32_t target;      // goto moves
+   uint32_t period_fine; // T1 in 24.8 fixed point, 0 keeps the one set
+   uint32_t ms;          // rate and dwell moves
+   stepper_aux_E aux;    // set as the move starts
+   bool joint;           // waits for every axis to get to its joint move, they start together
+} stepper_move_S;
+
+// how far the script of an axis has got
+typedef struct {
+   uint32_t queued;  // moves not done yet, the one running included
+   uint32_t done;    // moves done since the script was last cleared
+   bool running;
+   bool waiting;     // a joint move waits for the other axes
+} stepper_script_status_S;
+
+// everything a client polls for as of one moment, see stepper_get_snapshot
+typedef struct {
+   uint32_t count;
+   uint32_t target;
+   uint32_t period;
+   uint32_t period_fine; // T1 in 24.8 fixed point
+   stepper_mode_E mode;
+   stepper_speed_E speed;
+   stepper_dir_E dir;
+   bool busy;
+   bool fault;
+} stepper_snapshot_S;
+
+// the motion task owns all stepper state, other tasks hand it work through stepper_call
+typedef void (*stepper_call_t)(void *arg);
+
 void stepper_init(void);
-void stepper_task(void);
+void stepper_task(void *args);
+void stepper_call(stepper_call_t, void *arg);
 
 void stepper_start(stepper_E);
+void stepper_start_coordinated(void);
 void stepper_stop(stepper_E);
 void stepper_stop_instant(stepper_E);
 
@@ -55,14 +131,58 @@ void stepper_set_count(stepper_E, uint32_t);
 uint32_t stepper_get_count(stepper_E);
 
 void stepper_set_period(stepper_E, uint32_t);
+void stepper_set_period_fine(stepper_E, uint32_t);
 void stepper_set_target(stepper_E, uint32_t);
+void stepper_set_brake(stepper_E, uint32_t);
 void stepper_set_mode(stepper_E, stepper_mode_E, stepper_speed_E, stepper_dir_E);
+void stepper_set_accel(stepper_E, uint32_t);
+void stepper_set_guide(stepper_E, stepper_guide_E);
+bool stepper_pulse_guide(stepper_E, stepper_dir_E, uint32_t ms);
 
 uint32_t stepper_get_period(stepper_E);
+uint32_t stepper_get_period_fine(stepper_E);
 uint32_t stepper_get_target(stepper_E);
+uint32_t stepper_get_brake(stepper_E);
 stepper_mode_E stepper_get_mode(stepper_E);
 stepper_speed_E stepper_get_speed(stepper_E);
 stepper_dir_E stepper_get_dir(stepper_E);
+uint32_t stepper_get_accel(stepper_E);
+stepper_guide_E stepper_get_guide(stepper_E);
+bool stepper_guiding(stepper_E);
 bool stepper_get_fault(stepper_E);
+void stepper_get_snapshot(stepper_E, stepper_snapshot_S*);
+
+bool stepper_script_add(stepper_E, const stepper_move_S*);
+bool stepper_script_run(stepper_E);
+void stepper_script_clear(stepper_E);
+void stepper_get_script(stepper_E, stepper_script_status_S*);
+
+void stepper_set_aux(bool);
+bool stepper_get_aux(void);
+
+// callback durations and how far each step came from the period programmed for it
+typedef struct {
+   uint32_t callbacks;
+   uint32_t min_ns;
+   uint32_t mean_ns;
+   uint32_t max_ns;
+   uint32_t intervals; // step to step intervals measured
+   int32_t early_ns;   // most negative deviation
+   int32_t late_ns;    // most positive deviation
+   uint32_t hist[STEPPER_PROBE_BUCKETS]; // absolute deviation, below 125 ns then doubling, the last 128 us and over
+} stepper_probe_S;
+
+void stepper_get_isr_stats(stepper_E, uint32_t *count, uint32_t *load);
+void stepper_reset_isr_stats(void);
+bool stepper_get_probe(stepper_E, stepper_probe_S*);
+
+// how the segment stream of an RMT axis kept up
+typedef struct {
+   uint32_t segments;  // segments played
+   uint32_t underruns; // times the next segment was not ready in time and a gap went out instead
+   uint32_t slips;     // streams that ended with the pulse counter off the steps generated
+} stepper_rmt_stats_S;
+
+bool stepper_get_rmt_stats(stepper_E, stepper_rmt_stats_S*);
 
 #endif
@@ -1,11 +1,18 @@
 // implements https://inter-static.skywatcher.com/downloads/skywatcher_motor_controller_command_set.pdf
 #include "synscan.h"
+#include "dlog.h"
 #include "stepper.h"
+#include "server.h"
+#include "trace.h"
+#include "uart.h"
 #include "wifi.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <freertos/queue.h>
+#include <ctype.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 typedef enum {
@@ -18,244 +25,513 @@ typedef enum {
    SS_OK,
 } ss_error_E;
 
+// a SynScan command, the dispatcher checks channel and length before calling handler once per addressed axis
+typedef ss_error_E (*ss_handler_t)(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply);
+
+typedef struct {
+   ss_handler_t handler;
+   uint8_t max_chan;  // 2 addresses a single axis, 3 also both
+   uint8_t plen;      // payload hex digits
+   uint8_t alt_plen;  // another accepted payload length, 0 for none
+   uint8_t reply_len; // hex digits in the reply
+   bool stopped;      // refused unless every addressed axis is stopped
+   bool appends;      // the handler appends its own reply per axis with ss_append_hex
+} ss_command_S;
+
+// the intervals between the timestamps a command collects on its way through
+typedef enum {
+   SS_STAGE_PARSE,  // read by the transport to parsed
+   SS_STAGE_HANDLE, // parsed to reply ready
+   SS_STAGE_TX,     // reply ready to written to the socket or UART driver
+   SS_STAGE_COUNT,
+} ss_stage_E;
+
+// bucket 0 is below 8 us, each next one doubles, the last is 8 ms and over
+#define SS_BUCKETS 12
+
+// plain counters updated by the task of the transport, cheap enough to stay on
+typedef struct {
+   uint32_t commands[128]; // by header, '+' for AT commands
+   uint32_t errors[SS_OK]; // by error code
+   uint32_t overflows;     // commands longer than the payload buffer, dropped
+   uint32_t resyncs;       // commands cut short by the start of the next one
+   uint32_t latency[SS_STAGE_COUNT][SS_BUCKETS];
+} ss_stats_S;
+
+static ss_stats_S ss_stats[SS_TRANSPORT_COUNT];
+
 static void ss_parse(ss_parser_S *parser, uint8_t byte);
+static void ss_command(void *arg);
+static void ss_at_command(ss_parser_S *parser);
 static uint32_t ss_get_payload(ss_parser_S *parser);
+static uint32_t ss_get_field(ss_parser_S *parser, int first, int digits);
 static void ss_construct_resp(ss_parser_S *parser, ss_error_E error, uint32_t payload, size_t plen);
+static void ss_append_hex(ss_parser_S *parser, uint32_t value, size_t digits);
+static uint32_t ss_status_word(stepper_mode_E mode, stepper_speed_E speed, stepper_dir_E dir, bool busy);
 static stepper_E ss_get_stepper(ss_parser_S *parser, bool start);
-static uint8_t hexify(uint8_t num);
-static uint8_t unhexify(uint8_t hex);
+static size_t ss_stats_command(ss_parser_S *parser);
+static size_t ss_print_list(char *out, size_t len, size_t size, const uint32_t *values, size_t count);
+static size_t ss_trace_command(ss_parser_S *parser);
+static void ss_trace_save(trace_record_S *record, ss_parser_S *parser);
+static size_t ss_escape(char *out, size_t size, const uint8_t *data, size_t len);
+static void ss_stats_latency(ss_stats_S *stats, ss_stage_E stage, int64_t us);
+
+static ss_error_E ss_init_done(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_version(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_cpr(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_status(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_timer_freq(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_set_position(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_set_mode(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_set_target(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_set_increment(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_set_period(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_start(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_stop(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_stop_instant(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_get_target(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_get_period(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_get_position(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_fast_ratio(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_set_brake(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_set_guide(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_pulse_guide(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_aux_switch(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_poll(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_script_add(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_script_run(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+static ss_error_E ss_script_status(ss_parser_S*, stepper_E, uint32_t, uint32_t*);
+
+// indexed by the command header
+static const ss_command_S SS_COMMANDS[128] = {
+   ['F'] = {ss_init_done,     .max_chan = 3},                                 // initialization done
+   ['e'] = {ss_version,       .max_chan = 3, .reply_len = 6},                 // inquire motor board version
+   ['a'] = {ss_cpr,           .max_chan = 2, .reply_len = 6},                 // inquire counts per revolution
+   ['f'] = {ss_status,        .max_chan = 2, .reply_len = 4},                 // inquire status
+   ['b'] = {ss_timer_freq,    .max_chan = 3, .reply_len = 4},                 // inquire timer frequency
+   ['E'] = {ss_set_position,  .max_chan = 2, .plen = 6, .stopped = true},     // set position
+   ['G'] = {ss_set_mode,      .max_chan = 3, .plen = 2, .stopped = true},     // set motion mode
+   ['S'] = {ss_set_target,    .max_chan = 2, .plen = 6, .stopped = true},     // set goto target
+   ['H'] = {ss_set_increment, .max_chan = 3, .plen = 6, .stopped = true},     // set goto target increment
+   ['I'] = {ss_set_period,    .max_chan = 3, .plen = 6, .alt_plen = 8},       // set step period (T1)
+   ['J'] = {ss_start,         .max_chan = 3},                                 // start motion
+   ['K'] = {ss_stop,          .max_chan = 3},                                 // stop motion, applies brake steps
+   ['L'] = {ss_stop_instant,  .max_chan = 3},                                 // instant stop
+   ['h'] = {ss_get_target,    .max_chan = 2, .reply_len = 6},                 // inquire goto target
+   ['i'] = {ss_get_period,    .max_chan = 2, .reply_len = 6},                 // inquire step period
+   ['j'] = {ss_get_position,  .max_chan = 2, .reply_len = 6},                 // inquire position
+   ['D'] = {ss_get_position,  .max_chan = 2, .reply_len = 6},                 // inquire axis position, not sure what the difference is
+   ['g'] = {ss_fast_ratio,    .max_chan = 2, .reply_len = 2},                 // inquire high speed ratio
+   ['M'] = {ss_set_brake,     .max_chan = 3, .plen = 6},                      // set brake point increment
+   ['P'] = {ss_set_guide,     .max_chan = 3, .plen = 1},                      // set autoguide speed
+   ['U'] = {ss_pulse_guide,   .max_chan = 3, .plen = 6},                      // pulse guide, extension
+   ['O'] = {ss_aux_switch,    .max_chan = 3, .plen = 1},                      // aux switch, drives GPO
+   ['Z'] = {ss_poll,          .max_chan = 3, .appends = true},                // everything 'j', 'h', 'i' and 'f' return, extension
+   ['Q'] = {ss_script_add,    .max_chan = 3, .plen = 16, .alt_plen = 8},      // queue a move of the motion script, extension
+   ['Y'] = {ss_script_run,    .max_chan = 3, .plen = 1},                      // run or clear the motion script, extension
+   ['y'] = {ss_script_status, .max_chan = 3, .appends = true},                // inquire motion script, extension
+};
+
+static const uint8_t HEX[16] = "0123456789ABCDEF";
+
+// anything not a hex digit decodes as 0
+static const uint8_t UNHEX[256] = {
+   ['1'] = 1,  ['2'] = 2,  ['3'] = 3,  ['4'] = 4,  ['5'] = 5,  ['6'] = 6,  ['7'] = 7,  ['8'] = 8,  ['9'] = 9,
+   ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+   ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
 
 size_t ss_handle_byte(ss_parser_S *parser, uint8_t byte) {
    if(parser->status != SS_PARSED) ss_parse(parser, byte);
    if(parser->status != SS_PARSED) return 0;
 
-   // handle command
-   #define SS_CHECK(MAX_CHAN, EXPECTED_LEN) \
-   if(parser->channel <= 0 || parser->channel > (MAX_CHAN) || parser->plen != (EXPECTED_LEN)) { \
-      ss_construct_resp(parser, SS_ERR_COMMAND_LENGTH, 0, 0); \
-      break; \
-   };
+   ss_stats_S *stats = &ss_stats[parser->transport];
+   uint8_t header = parser->header;
+   int64_t parsed = esp_timer_get_time();
+
+   // the motion commands run on the motion task while the AT commands stay on this side, the
+   // record goes into the trace the transports share only once the reply is ready
+   trace_record_S trace;
+   ss_trace_save(&trace, parser);
+   if(header == '+')
+      ss_at_command(parser);
+   else
+      stepper_call(ss_command, parser);
+
+   int64_t ready = esp_timer_get_time();
+   trace.latency = ready - parser->start_time;
+   trace.resp_len = parser->plen + 1;
+   memcpy(trace.resp, parser->data, trace.resp_len < TRACE_RESP_MAX ? trace.resp_len : TRACE_RESP_MAX);
+   trace_add(&trace);
+
+   if(header < sizeof(stats->commands) / sizeof(stats->commands[0])) stats->commands[header]++;
+   if(parser->header == '!' && parser->payload[0] - '0' < SS_OK) stats->errors[parser->payload[0] - '0']++;
+   ss_stats_latency(stats, SS_STAGE_PARSE, parsed - parser->start_time);
+   ss_stats_latency(stats, SS_STAGE_HANDLE, ready - parsed);
+   if(!parser->reply_time) parser->reply_time = ready;
 
-   switch(parser->header) {
-      case '+': { // AT command
-         size_t resp_len = 0;
-
-         if(memcmp(parser->payload, "LOG=", 4) == 0) {
-            esp_log_level_t log_level = *(parser->payload+4) - '0';
-            if(log_level > ESP_LOG_VERBOSE) {
-               log_level = ESP_LOG_VERBOSE;
-            }
-            esp_log_level_set("*", log_level);
-            memcpy(parser->data, "OK\r\n", 4);
-            resp_len = 4;
-         } else {
-            resp_len = wifi_command(parser->data, parser->plen+1, sizeof(parser->data));
-         }
+   parser->status = SS_IDLE;
+   parser->channel = 0;
 
-         if(resp_len) {
-            parser->plen = resp_len-1;
-         } else {
-            memcpy(parser->data, "FAIL\r", 5);
-            parser->plen = 4;
+   return parser->plen + 1;
+}
+
+// the transport calls this once it has written the replies handed out so far
+void ss_sent(ss_parser_S *parser) {
+   if(!parser->reply_time)
+      return;
+   ss_stats_latency(&ss_stats[parser->transport], SS_STAGE_TX, esp_timer_get_time() - parser->reply_time);
+   parser->reply_time = 0;
+}
+
+static void ss_command(void *arg) {
+   ss_parser_S *parser = arg;
+   if(parser->header >= sizeof(SS_COMMANDS) / sizeof(SS_COMMANDS[0]) || !SS_COMMANDS[parser->header].handler) {
+      ss_construct_resp(parser, SS_ERR_UNKNOWN_COMMAND, 0, 0);
+      return;
+   }
+   const ss_command_S *cmd = &SS_COMMANDS[parser->header];
+
+   if(parser->channel <= 0 || parser->channel > cmd->max_chan ||
+      (parser->plen != cmd->plen && (!cmd->alt_plen || parser->plen != cmd->alt_plen))) {
+      ss_construct_resp(parser, SS_ERR_COMMAND_LENGTH, 0, 0);
+      return;
+   }
+
+   stepper_E first = ss_get_stepper(parser, true);
+   stepper_E end = ss_get_stepper(parser, false);
+
+   if(cmd->stopped) {
+      for(stepper_E stepper = first; stepper != end; stepper++) {
+         if(stepper_busy(stepper)) {
+            ss_construct_resp(parser, SS_ERR_NOT_STOPPED, 0, 0);
+            return;
          }
-         break;
       }
+   }
 
-      case 'F': // initialization done
-         SS_CHECK(3, 0);
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
+   // the last failing axis decides the reply, the others are still carried out
+   uint32_t payload = ss_get_payload(parser);
+   uint32_t reply = 0;
+   ss_error_E error = SS_OK;
+   if(cmd->appends) {
+      parser->header = '=';
+      parser->plen = 0;
+   }
+   for(stepper_E stepper = first; stepper != end; stepper++) {
+      ss_error_E axis_error = cmd->handler(parser, stepper, payload, &reply);
+      if(axis_error != SS_OK) error = axis_error;
+   }
 
-      case 'e': // inquire motor board version
-         SS_CHECK(3, 0);
-         ss_construct_resp(parser, SS_OK, 0x000003, 6); // 3.0
-         break;
+   if(cmd->appends && error == SS_OK)
+      parser->payload[parser->plen++] = '\r';
+   else
+      ss_construct_resp(parser, error, reply, cmd->reply_len);
+}
 
-      case 'a': { // inquire counts per revolution
-         SS_CHECK(2, 0);
-         uint32_t cpr = stepper_cpr(ss_get_stepper(parser, true));
-         ss_construct_resp(parser, SS_OK, cpr, 6);
-         break;
+static void ss_at_command(ss_parser_S *parser) {
+   size_t resp_len = 0;
+
+   if(memcmp(parser->payload, "LOG=", 4) == 0) {
+      // +LOG=n for everything, +LOG=n,tag for one module of the deferred log
+      esp_log_level_t log_level = *(parser->payload+4) - '0';
+      if(log_level > ESP_LOG_VERBOSE) {
+         log_level = ESP_LOG_VERBOSE;
+      }
+      const char *tag = "*";
+      if(parser->plen > 6 && parser->plen < sizeof(parser->payload) && parser->payload[5] == ',') {
+         parser->payload[parser->plen] = '\0';
+         tag = (const char*) parser->payload + 6;
       }
+      if(dlog_level_set(tag, log_level)) {
+         memcpy(parser->data, "OK\r\n", 4);
+         resp_len = 4;
+      }
+   } else if(memcmp(parser->payload, "TRACE?", 6) == 0) {
+      resp_len = ss_trace_command(parser);
+   } else if(memcmp(parser->payload, "STATS?", 6) == 0) {
+      resp_len = ss_stats_command(parser);
+   } else if(memcmp(parser->payload, "STATS=0", 7) == 0) {
+      memset(ss_stats, 0, sizeof(ss_stats));
+      memcpy(parser->data, "OK\r\n", 4);
+      resp_len = 4;
+   } else if(memcmp(parser->payload, "ISR?", 4) == 0 && parser->plen >= 5 && isdigit(parser->payload[4])) {
+      // step jitter probe of one axis: callbacks, their min, mean and max ns, intervals, most early and late ns,
+      // with H the deviation buckets instead, only in builds with STEPPER_PROBE
+      stepper_probe_S probe;
+      stepper_E stepper = parser->payload[4] - '0';
+      if(stepper < STEPPER_COUNT && stepper_get_probe(stepper, &probe)) {
+         if(parser->plen == 6 && parser->payload[5] == 'H') {
+            resp_len = snprintf((char*) parser->data, sizeof(parser->data), "+ISR%cH:", parser->payload[4]);
+            resp_len = ss_print_list((char*) parser->data, resp_len, sizeof(parser->data), probe.hist, STEPPER_PROBE_BUCKETS);
+         } else if(parser->plen == 5) {
+            resp_len = snprintf((char*) parser->data, sizeof(parser->data),
+                                "+ISR%c:%lu,%lu,%lu,%lu,%lu,%ld,%ld\r\nOK\r\n", parser->payload[4],
+                                (unsigned long) probe.callbacks, (unsigned long) probe.min_ns,
+                                (unsigned long) probe.mean_ns, (unsigned long) probe.max_ns,
+                                (unsigned long) probe.intervals, (long) probe.early_ns, (long) probe.late_ns);
+         }
+      }
+   } else if(memcmp(parser->payload, "ISR?", 4) == 0) {
+      // interrupts and load in permille per axis since the last +ISR=0
+      uint32_t ra_count, ra_load, de_count, de_load;
+      stepper_get_isr_stats(STEPPER_RA, &ra_count, &ra_load);
+      stepper_get_isr_stats(STEPPER_DE, &de_count, &de_load);
+      resp_len = snprintf((char*) parser->data, sizeof(parser->data),
+                          "+ISR:%lu,%lu,%lu,%lu\r\nOK\r\n",
+                          (unsigned long) ra_count, (unsigned long) ra_load,
+                          (unsigned long) de_count, (unsigned long) de_load);
+   } else if(memcmp(parser->payload, "UDP?", 4) == 0 && parser->plen == 5 && isdigit(parser->payload[4])) {
+      // one session: address, ms since its last datagram, datagrams, commands, oversized datagrams
+      server_session_stats_S stats;
+      if(server_get_session(parser->payload[4] - '0', &stats)) {
+         uint8_t *ip = (uint8_t*) &stats.addr;
+         resp_len = snprintf((char*) parser->data, sizeof(parser->data),
+                             "+UDP%c:%u.%u.%u.%u:%u,%lu,%lu,%lu,%lu\r\nOK\r\n", parser->payload[4],
+                             ip[0], ip[1], ip[2], ip[3], stats.port,
+                             (unsigned long) stats.idle_ms, (unsigned long) stats.datagrams,
+                             (unsigned long) stats.commands, (unsigned long) stats.dropped);
+      }
+   } else if(memcmp(parser->payload, "UDP?", 4) == 0) {
+      // oversized datagrams dropped, active sessions, sessions evicted for a new client
+      uint32_t dropped, sessions, evicted;
+      server_get_stats(&dropped, &sessions, &evicted);
+      resp_len = snprintf((char*) parser->data, sizeof(parser->data),
+                          "+UDP:%lu,%lu,%lu\r\nOK\r\n",
+                          (unsigned long) dropped, (unsigned long) sessions, (unsigned long) evicted);
+   } else if(memcmp(parser->payload, "TCP?", 4) == 0) {
+      // open connections, connections accepted and turned away since boot
+      uint32_t connections, accepted, rejected;
+      server_get_tcp_stats(&connections, &accepted, &rejected);
+      resp_len = snprintf((char*) parser->data, sizeof(parser->data),
+                          "+TCP:%lu,%lu,%lu\r\nOK\r\n",
+                          (unsigned long) connections, (unsigned long) accepted, (unsigned long) rejected);
+   } else if(memcmp(parser->payload, "BAUD?", 5) == 0) {
+      // serial rate and receive overflows since boot
+      resp_len = snprintf((char*) parser->data, sizeof(parser->data),
+                          "+BAUD:%lu,%lu\r\nOK\r\n",
+                          (unsigned long) uart_get_baud(), (unsigned long) uart_get_overflows());
+   } else if(memcmp(parser->payload, "BAUD=", 5) == 0) {
+      // switches after this reply, over any transport
+      uint32_t rate = 0;
+      for(int i = 5; i < parser->plen && isdigit(parser->payload[i]) && rate < 100000000; i++)
+         rate = rate * 10 + parser->payload[i] - '0';
+      if(uart_set_baud(rate)) {
+         memcpy(parser->data, "OK\r\n", 4);
+         resp_len = 4;
+      }
+   } else if(memcmp(parser->payload, "ISR=0", 5) == 0) {
+      stepper_reset_isr_stats();
+      memcpy(parser->data, "OK\r\n", 4);
+      resp_len = 4;
+   } else {
+      // the AT parser reads numbers up to a terminator, not the length it is given
+      if(parser->plen + 1 < sizeof(parser->data)) parser->data[parser->plen + 1] = '\0';
+      resp_len = wifi_command(parser->data, parser->plen+1, sizeof(parser->data));
+   }
 
-      case 'f': { // inquire status
-         SS_CHECK(2, 0);
-         stepper_E stepper   = ss_get_stepper(parser, true);
+   if(resp_len >= sizeof(parser->data)) {
+      // cut off, at least end the line
+      resp_len = sizeof(parser->data);
+      memcpy(parser->data + resp_len - 2, "\r\n", 2);
+   }
+   if(resp_len) {
+      parser->plen = resp_len-1;
+   } else {
+      memcpy(parser->data, "FAIL\r", 5);
+      parser->plen = 4;
+   }
+}
 
-         stepper_mode_E mode   = stepper_get_mode(stepper);
-         stepper_speed_E speed = stepper_get_speed(stepper);
-         stepper_dir_E  dir    = stepper_get_dir(stepper);
-         bool busy             = stepper_busy(stepper);
+static ss_error_E ss_init_done(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   return SS_OK;
+}
 
-         uint16_t status = (busy  << 0)
-                         | (mode  << 4)
-                         | (dir   << 5)
-                         | (speed << 6)
-                         | (1     << 12); // init done
+static ss_error_E ss_version(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = 0x000003; // 3.0
+   return SS_OK;
+}
 
-         ss_construct_resp(parser, SS_OK, status, 4);
-         break;
-      }
+static ss_error_E ss_cpr(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = stepper_cpr(stepper);
+   return SS_OK;
+}
 
-      case 'b': // inquire timer frequency
-         SS_CHECK(3, 0);
-         ss_construct_resp(parser, SS_OK, STEPPER_FREQ, 4);
-         break;
+static ss_error_E ss_status(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = ss_status_word(stepper_get_mode(stepper), stepper_get_speed(stepper), stepper_get_dir(stepper), stepper_busy(stepper));
+   return SS_OK;
+}
 
-      case 'E': { // set position
-         SS_CHECK(2, 6);
-         ss_error_E error = SS_OK;
-         uint32_t count = ss_get_payload(parser);
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            if(stepper_busy(stepper)) {
-               error = SS_ERR_NOT_STOPPED;
-               break;
-            }
-            stepper_set_count(stepper, count - 0x800000);
-         }
-         ss_construct_resp(parser, error, 0, 0);
-         break;
-      }
+static ss_error_E ss_timer_freq(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = STEPPER_FREQ;
+   return SS_OK;
+}
 
-      case 'G': { // set motion mode
-         SS_CHECK(3, 2);
-         ss_error_E error = SS_OK;
-         uint32_t payload = ss_get_payload(parser);
-
-         stepper_dir_E dir     = payload >> 0 & 1;
-         stepper_mode_E mode   = payload >> 4 & 1;
-         stepper_speed_E speed = payload >> 5 & 1;
-         if(mode == STEPPER_GOTO) speed ^= 1;
-
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            if(stepper_busy(stepper)) {
-               error = SS_ERR_NOT_STOPPED;
-               break;
-            }
-            stepper_set_mode(stepper, mode, speed, dir);
-         }
-         ss_construct_resp(parser, error, 0, 0);
-         break;
-      }
+static ss_error_E ss_set_position(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_set_count(stepper, payload - 0x800000);
+   return SS_OK;
+}
 
-      case 'S': { // set goto target
-         SS_CHECK(2, 6);
-         ss_error_E error = SS_OK;
-         uint32_t target = ss_get_payload(parser);
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            if(stepper_busy(stepper)) {
-               error = SS_ERR_NOT_STOPPED;
-               break;
-            }
-            stepper_set_target(stepper, target - 0x800000);
-         }
-         ss_construct_resp(parser, error, 0, 0);
-         break;
-      }
+static ss_error_E ss_set_mode(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_dir_E dir     = payload >> 0 & 1;
+   stepper_mode_E mode   = payload >> 4 & 1;
+   stepper_speed_E speed = payload >> 5 & 1;
+   if(mode == STEPPER_GOTO) speed ^= 1;
 
-      case 'H': { // set goto target increment
-         SS_CHECK(3, 6);
-         ss_error_E error = SS_OK;
-         uint32_t increment = ss_get_payload(parser);
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            if(stepper_busy(stepper)) {
-               error = SS_ERR_NOT_STOPPED;
-               break;
-            }
-            uint32_t count = stepper_get_count(stepper);
-            stepper_set_target(stepper, count + increment);
-         }
-         ss_construct_resp(parser, error, 0, 0);
-         break;
-      }
+   stepper_set_mode(stepper, mode, speed, dir);
+   return SS_OK;
+}
 
-      case 'I': { // set step period (T1)
-         SS_CHECK(3, 6);
-         uint32_t period = ss_get_payload(parser);
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            stepper_set_period(stepper, period);
-         }
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
-      }
+static ss_error_E ss_set_target(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_set_target(stepper, payload - 0x800000);
+   return SS_OK;
+}
 
-      case 'J': // start motion
-         SS_CHECK(3, 0);
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            stepper_start(stepper);
-         }
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
+static ss_error_E ss_set_increment(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   uint32_t count = stepper_get_count(stepper);
+   if(stepper_get_dir(stepper) == STEPPER_CCW)
+      stepper_set_target(stepper, count - payload);
+   else
+      stepper_set_target(stepper, count + payload);
+   return SS_OK;
+}
 
-      case 'K': // stop motion, applies brake steps
-         SS_CHECK(3, 0);
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            stepper_stop(stepper);
-         }
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
+// extension: 8 digits is T1 in 24.8 fixed point, the fraction being the low byte
+static ss_error_E ss_set_period(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_set_period_fine(stepper, parser->plen == 6 ? payload << 8 : payload);
+   return SS_OK;
+}
 
-      case 'L': // instant stop
-         SS_CHECK(3, 0);
-         for(stepper_E stepper = ss_get_stepper(parser, true); stepper != ss_get_stepper(parser, false); stepper++) {
-            stepper_stop_instant(stepper);
-         }
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
+// both axes at once move as one, see stepper_start_coordinated
+static ss_error_E ss_start(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   if(parser->channel != 3)
+      stepper_start(stepper);
+   else if(stepper == STEPPER_0)
+      stepper_start_coordinated();
+   return SS_OK;
+}
 
-      case 'h': { // inquire goto target
-         SS_CHECK(2, 0);
-         uint32_t target = stepper_get_target(ss_get_stepper(parser, true));
-         ss_construct_resp(parser, SS_OK, target + 0x800000, 6);
-         break;
-      }
+// a stop ends the motion script as well
+static ss_error_E ss_stop(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_script_clear(stepper);
+   stepper_stop(stepper);
+   return SS_OK;
+}
 
-      case 'i': { // inquire step period
-         SS_CHECK(2, 0);
-         uint32_t target = stepper_get_period(ss_get_stepper(parser, true));
-         ss_construct_resp(parser, SS_OK, target, 6);
-         break;
-      }
+static ss_error_E ss_stop_instant(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_script_clear(stepper);
+   stepper_stop_instant(stepper);
+   return SS_OK;
+}
 
-      case 'j':    // inquire position
-      case 'D':  { // inquire axis position, not sure what the difference is
-         SS_CHECK(2, 0);
-         uint32_t count = stepper_get_count(ss_get_stepper(parser, true));
-         ss_construct_resp(parser, SS_OK, count + 0x800000, 6);
-         break;
-      }
+static ss_error_E ss_get_target(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = stepper_get_target(stepper) + 0x800000;
+   return SS_OK;
+}
 
-      case 'g': // inquire high speed ratio
-         SS_CHECK(2, 0);
-         ss_construct_resp(parser, SS_OK, STEPPER_FAST_RATIO, 2);
-         break;
+static ss_error_E ss_get_period(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = stepper_get_period(stepper);
+   return SS_OK;
+}
 
-      // not implemented
-      case 'M': // set brake point increment
-         SS_CHECK(3, 6);
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
+static ss_error_E ss_get_position(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = stepper_get_count(stepper) + 0x800000;
+   return SS_OK;
+}
 
-      case 'O': // aux switch
-         SS_CHECK(3, 1);
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
+static ss_error_E ss_fast_ratio(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   *reply = STEPPER_FAST_RATIO;
+   return SS_OK;
+}
 
-      case 'P': // set autoguide speed
-         SS_CHECK(3, 1);
-         ss_construct_resp(parser, SS_OK, 0, 0);
-         break;
+static ss_error_E ss_set_brake(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_set_brake(stepper, payload);
+   return SS_OK;
+}
 
-      default:
-         ss_construct_resp(parser, SS_ERR_UNKNOWN_COMMAND, 0, 0);
-         break;
+static ss_error_E ss_set_guide(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_guide_E guide = UNHEX[parser->payload[0]];
+   if(guide >= STEPPER_GUIDE_COUNT)
+      return SS_ERR_INVAID_CHAR;
+
+   stepper_set_guide(stepper, guide);
+   return SS_OK;
+}
+
+// extension: the low 16 bits are the duration in ms, bit 16 the direction as in 'G'
+static ss_error_E ss_pulse_guide(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_dir_E dir = payload >> 16 & 1;
+   if(!stepper_pulse_guide(stepper, dir, payload & 0xFFFF))
+      return SS_ERR_NOT_STOPPED;
+   return SS_OK;
+}
+
+// one output for both axes, 0 switches it off, anything else on
+static ss_error_E ss_aux_switch(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_set_aux(UNHEX[parser->payload[0]] != 0);
+   return SS_OK;
+}
+
+// per axis position, goto target and T1 as 6 digits and the 'f' status as 4 digits with the motor fault in bit 8,
+// all from one snapshot so a dashboard needs one round trip where it used to need eight
+static ss_error_E ss_poll(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_snapshot_S snapshot;
+   stepper_get_snapshot(stepper, &snapshot);
+
+   ss_append_hex(parser, snapshot.count + 0x800000, 6);
+   ss_append_hex(parser, snapshot.target + 0x800000, 6);
+   ss_append_hex(parser, snapshot.period, 6);
+   ss_append_hex(parser, ss_status_word(snapshot.mode, snapshot.speed, snapshot.dir, snapshot.busy) | snapshot.fault << 8, 4);
+   return SS_OK;
+}
+
+// extension: 2 digits of flags, 6 digits of goto target or ms and optionally 8 digits of T1 in 24.8 fixed point
+// flags bits 0-1 are the stepper_move_E, bit 2 the direction and bit 3 the speed of a rate move or goto, 1 for
+// CCW and fast, bits 4-5 the stepper_aux_E to set as the move starts and bit 6 makes it a joint move, which
+// waits for the other axis to get to its joint move too, joint gotos on both axes run as one move
+// refused as not stopped while the script is full
+static ss_error_E ss_script_add(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   uint32_t flags = ss_get_field(parser, 0, 2);
+   uint32_t value = ss_get_field(parser, 2, 6);
+   stepper_move_S move = {
+      .type        = flags & 3,
+      .dir         = flags >> 2 & 1,
+      .speed       = flags >> 3 & 1,
+      .aux         = flags >> 4 & 3,
+      .joint       = flags >> 6 & 1,
+      .target      = value - 0x800000,
+      .ms          = value,
+      .period_fine = parser->plen == 16 ? ss_get_field(parser, 8, 8) : 0,
+   };
+   if(move.type >= STEPPER_MOVE_COUNT || move.aux > STEPPER_AUX_ON)
+      return SS_ERR_INVAID_CHAR;
+   if(!stepper_script_add(stepper, &move))
+      return SS_ERR_NOT_STOPPED;
+   return SS_OK;
+}
+
+// extension: 1 runs the moves queued and those that follow, 0 drops them and stops the axis
+static ss_error_E ss_script_run(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   if(UNHEX[parser->payload[0]]) {
+      if(!stepper_script_run(stepper))
+         return SS_ERR_NOT_STOPPED;
+   } else {
+      stepper_script_clear(stepper);
+      stepper_stop(stepper);
    }
-   #undef SS_CHECK
+   return SS_OK;
+}
 
-   parser->status = SS_IDLE;
-   parser->channel = 0;
+// per axis the moves queued as 2 digits, the moves done as 6 digits and 2 digits of flags, bit 0 running,
+// bit 1 waiting at a joint move and bit 2 the aux output
+static ss_error_E ss_script_status(ss_parser_S *parser, stepper_E stepper, uint32_t payload, uint32_t *reply) {
+   stepper_script_status_S status;
+   stepper_get_script(stepper, &status);
 
-   return parser->plen + 1;
+   ss_append_hex(parser, status.queued, 2);
+   ss_append_hex(parser, status.done, 6);
+   ss_append_hex(parser, status.running | status.waiting << 1 | stepper_get_aux() << 2, 2);
+   return SS_OK;
 }
 
 static void ss_parse(ss_parser_S *parser, uint8_t byte) {
@@ -265,6 +541,7 @@ static void ss_parse(ss_parser_S *parser, uint8_t byte) {
 
       case SS_IDLE:
          if(byte == ':') { // start of command
+            parser->start_time = parser->rx_time;
             parser->plen = 0;
             parser->header = 0;
             parser->channel = 0;
@@ -273,6 +550,7 @@ static void ss_parse(ss_parser_S *parser, uint8_t byte) {
          }
 
          if(byte == '+') { // AT commands
+            parser->start_time = parser->rx_time;
             parser->plen = 0;
             parser->header = '+';
             parser->channel = 3; // arbitrary
@@ -288,13 +566,22 @@ static void ss_parse(ss_parser_S *parser, uint8_t byte) {
             break;
          }
 
+         if(byte == ':' && parser->header != '+') { // the previous command lost its end, start over
+            ss_stats[parser->transport].resyncs++;
+            parser->start_time = parser->rx_time;
+            parser->plen = 0;
+            parser->header = 0;
+            parser->channel = 0;
+            break;
+         }
+
          if(parser->header == 0) { // header
             parser->header = byte;
             break;
          }
 
          if(parser->channel == 0) { // channel
-            parser->channel = unhexify(byte);
+            parser->channel = UNHEX[byte];
             break;
          }
 
@@ -305,16 +592,22 @@ static void ss_parse(ss_parser_S *parser, uint8_t byte) {
 
    // better lose data than overflow buffer
    if(parser->plen > sizeof(parser->payload)) {
+      ss_stats[parser->transport].overflows++;
       parser->plen = 0;
    }
 }
 
 static uint32_t ss_get_payload(ss_parser_S *parser) {
+   return ss_get_field(parser, 0, parser->plen);
+}
+
+// digits of the payload from first on, least significant byte first
+static uint32_t ss_get_field(ss_parser_S *parser, int first, int digits) {
    uint32_t num = 0;
-   for(int i = parser->plen-1; i > 0; i-=2) {
+   for(int i = first + digits - 1; i > first; i-=2) {
       num = (num << 8)
-         | unhexify(parser->payload[i-1]) << 4
-         | unhexify(parser->payload[i]);
+         | UNHEX[parser->payload[i-1]] << 4
+         | UNHEX[parser->payload[i]];
    }
    return num;
 }
@@ -329,15 +622,28 @@ static void ss_construct_resp(ss_parser_S *parser, ss_error_E error, uint32_t pa
       if(plen > 6) plen = 6;
       parser->header = '=';
       parser->plen = 0;
-      while(parser->plen+1 < plen) {
-         parser->payload[parser->plen++] = hexify((payload >> 4) & 0xF);
-         parser->payload[parser->plen++] = hexify(payload & 0xF);
-         payload >>= 8;
-      }
+      ss_append_hex(parser, payload, plen);
       parser->payload[parser->plen++] = '\r';
    }
 }
 
+// least significant byte first, as the protocol sends all numbers
+static void ss_append_hex(ss_parser_S *parser, uint32_t value, size_t digits) {
+   for(size_t i = 0; i + 1 < digits; i += 2) {
+      parser->payload[parser->plen++] = HEX[(value >> 4) & 0xF];
+      parser->payload[parser->plen++] = HEX[value & 0xF];
+      value >>= 8;
+   }
+}
+
+static uint32_t ss_status_word(stepper_mode_E mode, stepper_speed_E speed, stepper_dir_E dir, bool busy) {
+   return (busy  << 0)
+        | (mode  << 4)
+        | (dir   << 5)
+        | (speed << 6)
+        | (1     << 12); // init done
+}
+
 static stepper_E ss_get_stepper(ss_parser_S *parser, bool start) {
    if(start) {
       if(parser->channel == 2)
@@ -350,23 +656,144 @@ static stepper_E ss_get_stepper(ss_parser_S *parser, bool start) {
    }
 }
 
-static uint8_t hexify(uint8_t num) {
-   num = num % 16;
-   if(num < 10) {
-      return num + '0';
+// +STATS? gives commands, errors, overflows and resyncs of each transport, +STATS?n followed by
+// E the errors of transport n by code, P, H or T the latency buckets of a stage, or Cx the commands with header x
+static size_t ss_stats_command(ss_parser_S *parser) {
+   char *out = (char*) parser->data;
+   size_t size = sizeof(parser->data);
+   size_t len = 0;
+
+   if(parser->plen == 6) {
+      len = snprintf(out, size, "+STATS:");
+      for(ss_transport_E transport = 0; transport < SS_TRANSPORT_COUNT && len < size; transport++) {
+         ss_stats_S *stats = &ss_stats[transport];
+         uint32_t commands = 0, errors = 0;
+         for(size_t i = 0; i < sizeof(stats->commands) / sizeof(stats->commands[0]); i++) commands += stats->commands[i];
+         for(size_t i = 0; i < SS_OK; i++) errors += stats->errors[i];
+         len += snprintf(out + len, size - len, "%s%lu,%lu,%lu,%lu", transport ? ";" : "",
+                         (unsigned long) commands, (unsigned long) errors,
+                         (unsigned long) stats->overflows, (unsigned long) stats->resyncs);
+         if(len > size) len = size;
+      }
+      return len + snprintf(out + len, size - len, "\r\nOK\r\n");
+   }
+
+   uint8_t digit = parser->payload[6] - '0';
+   if(parser->plen < 8 || digit >= SS_TRANSPORT_COUNT)
+      return 0;
+   ss_stats_S *stats = &ss_stats[digit];
+
+   const uint32_t *values;
+   size_t count;
+   switch(parser->payload[7]) {
+      case 'E': values = stats->errors; count = SS_OK; break;
+      case 'P': values = stats->latency[SS_STAGE_PARSE]; count = SS_BUCKETS; break;
+      case 'H': values = stats->latency[SS_STAGE_HANDLE]; count = SS_BUCKETS; break;
+      case 'T': values = stats->latency[SS_STAGE_TX]; count = SS_BUCKETS; break;
+      case 'C':
+         if(parser->plen != 9 || parser->payload[8] >= sizeof(stats->commands) / sizeof(stats->commands[0]))
+            return 0;
+         values = &stats->commands[parser->payload[8]]; count = 1; break;
+      default:
+         return 0;
+   }
+
+   len = snprintf(out, size, "+STATS%u%.*s:", digit, parser->plen - 7, parser->payload + 7);
+   return ss_print_list(out, len, size, values, count);
+}
+
+// appends the values comma separated and the final OK, cut off at size
+static size_t ss_print_list(char *out, size_t len, size_t size, const uint32_t *values, size_t count) {
+   for(size_t i = 0; i < count && len < size; i++)
+      len += snprintf(out + len, size - len, "%s%lu", i ? "," : "", (unsigned long) values[i]);
+   if(len > size) len = size;
+   return len + snprintf(out + len, size - len, "\r\nOK\r\n");
+}
+
+static void ss_stats_latency(ss_stats_S *stats, ss_stage_E stage, int64_t us) {
+   size_t bucket = 0;
+   if(us >= 8) {
+      bucket = 64 - __builtin_clzll(us) - 3;
+      if(bucket >= SS_BUCKETS) bucket = SS_BUCKETS - 1;
    }
-   return num - 10 + 'A';
+   stats->latency[stage][bucket]++;
 }
 
-static uint8_t unhexify(uint8_t hex) {
-   if('0' <= hex && hex <= '9') {
-      return hex - '0';
+// the command as it came over the wire, before the handler overwrites it with the reply, the
+// arguments of an AT command may be WiFi credentials so only its name up to the '=' is kept
+static void ss_trace_save(trace_record_S *record, ss_parser_S *parser) {
+   record->time = parser->start_time;
+   record->addr = parser->peer_addr;
+   record->port = parser->peer_port;
+   record->transport = parser->transport;
+
+   uint8_t *cmd = record->cmd;
+   size_t len = 0;
+   if(parser->header == '+') {
+      cmd[len++] = '+';
+   } else {
+      cmd[len++] = ':';
+      cmd[len++] = parser->header;
+      cmd[len++] = HEX[parser->channel & 0xF];
    }
-   if('a' <= hex && hex <= 'f') {
-      return hex - 'a' + 10;
+   uint8_t *equal = parser->header == '+' ? memchr(parser->payload, '=', parser->plen) : NULL;
+   if(equal) {
+      size_t plen = equal + 1 - parser->payload;
+      memcpy(cmd + len, parser->payload, plen < TRACE_CMD_MAX - len ? plen : TRACE_CMD_MAX - len);
+      record->cmd_len = len + plen;
+      return;
    }
-   if('A' <= hex && hex <= 'F') {
-      return hex - 'A' + 10;
+
+   size_t plen = parser->plen < TRACE_CMD_MAX - len - 1 ? parser->plen : TRACE_CMD_MAX - len - 1;
+   memcpy(cmd + len, parser->payload, plen);
+   cmd[len + plen] = '\r';
+   record->cmd_len = len + parser->plen + 1;
+}
+
+// +TRACE? gives the sequence numbers of the oldest record and the next one,
+// +TRACE?n the oldest record from n on as seq,time,latency,transport,addr:port,command,reply
+static size_t ss_trace_command(ss_parser_S *parser) {
+   char *out = (char*) parser->data;
+   size_t size = sizeof(parser->data);
+
+   if(parser->plen == 6) {
+      uint32_t oldest, next;
+      trace_range(&oldest, &next);
+      return snprintf(out, size, "+TRACE:%lu,%lu\r\nOK\r\n", (unsigned long) oldest, (unsigned long) next);
+   }
+
+   uint32_t seq = 0;
+   for(int i = 6; i < parser->plen && isdigit(parser->payload[i]); i++)
+      seq = seq * 10 + parser->payload[i] - '0';
+
+   trace_record_S record;
+   if(!trace_get(seq, &record))
+      return 0;
+
+   uint8_t *ip = (uint8_t*) &record.addr;
+   size_t len = snprintf(out, size, "+TRACE:%lu,%lld,%lu,%u,%u.%u.%u.%u:%u,",
+                         (unsigned long) record.seq, (long long) record.time, (unsigned long) record.latency,
+                         record.transport, ip[0], ip[1], ip[2], ip[3], record.port);
+   len += ss_escape(out + len, size - len, record.cmd, record.cmd_len < TRACE_CMD_MAX ? record.cmd_len : TRACE_CMD_MAX);
+   if(len < size) out[len++] = ',';
+   len += ss_escape(out + len, size - len, record.resp, record.resp_len < TRACE_RESP_MAX ? record.resp_len : TRACE_RESP_MAX);
+   return len + snprintf(out + len, size - len, "\r\nOK\r\n");
+}
+
+// printable bytes as they are, anything else and ',' and '%' as %XX
+static size_t ss_escape(char *out, size_t size, const uint8_t *data, size_t len) {
+   size_t n = 0;
+   for(size_t i = 0; i < len; i++) {
+      uint8_t c = data[i];
+      if(c >= 0x20 && c < 0x7F && c != ',' && c != '%') {
+         if(n + 1 > size) break;
+         out[n++] = c;
+      } else {
+         if(n + 3 > size) break;
+         out[n++] = '%';
+         out[n++] = HEX[c >> 4];
+         out[n++] = HEX[c & 0xF];
+      }
    }
-   return 0;
+   return n;
 }
@@ -10,10 +10,24 @@ typedef enum {
    SS_PARSED,
 } ss_parser_status_E;
 
+// where the bytes come from, each keeps its own +STATS counters
+typedef enum {
+   SS_TRANSPORT_UART,
+   SS_TRANSPORT_UDP,
+   SS_TRANSPORT_TCP,
+   SS_TRANSPORT_COUNT,
+} ss_transport_E;
+
 typedef struct {
    ss_parser_status_E status;
    uint8_t plen;
    uint8_t channel;
+   ss_transport_E transport;
+   uint32_t peer_addr; // IPv4, network byte order, set by the transport for the trace
+   uint16_t peer_port;
+   int64_t rx_time;    // us, set by the transport when it read the bytes it feeds
+   int64_t start_time; // rx_time of the first byte of the command
+   int64_t reply_time; // us, the oldest reply not yet passed to ss_sent
    union {
       struct {
          uint8_t header;
@@ -24,5 +38,6 @@ typedef struct {
 } ss_parser_S;
 
 size_t ss_handle_byte(ss_parser_S*, uint8_t);
+void ss_sent(ss_parser_S*);
 
 #endif
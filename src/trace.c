@@ -0,0 +1,47 @@
+#include "trace.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <assert.h>
+#include <stddef.h>
+
+// a static ring, the oldest record goes when a new one needs its slot
+// the mutex is only held to copy a record in or out, never across a command
+static trace_record_S records[TRACE_COUNT];
+static uint32_t next_seq;
+static SemaphoreHandle_t mutex;
+
+void trace_init(void) {
+   mutex = xSemaphoreCreateMutex();
+   assert(mutex);
+}
+
+static uint32_t trace_oldest(void) {
+   return next_seq > TRACE_COUNT ? next_seq - TRACE_COUNT : 0;
+}
+
+// numbers the record and copies it into the next slot
+void trace_add(trace_record_S *record) {
+   xSemaphoreTake(mutex, portMAX_DELAY);
+   record->seq = next_seq++;
+   records[record->seq % TRACE_COUNT] = *record;
+   xSemaphoreGive(mutex);
+}
+
+// the oldest record still held at or after seq, false when there is none
+bool trace_get(uint32_t seq, trace_record_S *record) {
+   xSemaphoreTake(mutex, portMAX_DELAY);
+   uint32_t oldest = trace_oldest();
+   if(seq < oldest) seq = oldest;
+   bool found = seq < next_seq;
+   if(found) *record = records[seq % TRACE_COUNT];
+   xSemaphoreGive(mutex);
+   return found;
+}
+
+void trace_range(uint32_t *oldest, uint32_t *next) {
+   xSemaphoreTake(mutex, portMAX_DELAY);
+   *oldest = trace_oldest();
+   if(next) *next = next_seq;
+   xSemaphoreGive(mutex);
+}
@@ -0,0 +1,30 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_COUNT 64
+#define TRACE_CMD_MAX 32
+#define TRACE_RESP_MAX 64
+
+// one command and its reply as a transport saw them, the bytes are kept up to the _MAX sizes
+typedef struct {
+   uint32_t seq;
+   int64_t time;      // us since boot, when the transport read the first byte of the command
+   uint32_t latency;  // us from then until the reply was ready
+   uint32_t addr;     // IPv4 of the peer, network byte order, 0 for the UART
+   uint16_t port;
+   uint8_t transport; // ss_transport_E
+   uint8_t cmd_len;   // full length on the wire, ':' or '+' to '\r', an AT command only up to its '='
+   uint8_t resp_len;  // full length
+   uint8_t cmd[TRACE_CMD_MAX];
+   uint8_t resp[TRACE_RESP_MAX];
+} trace_record_S;
+
+void trace_init(void);
+void trace_add(trace_record_S*);
+bool trace_get(uint32_t seq, trace_record_S*);
+void trace_range(uint32_t *oldest, uint32_t *next);
+
+#endif
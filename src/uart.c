@@ -1,33 +1,164 @@
+#include "uart.h"
 #include "synscan.h"
+#include "dlog.h"
 
 #include <driver/uart.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+#include <string.h>
+
+#define UART_PORT UART_NUM_0
+#define RX_RING 1024
+#define TX_RING 1024
+#define EVENT_COUNT 16
+#define CHUNK 128
+
+// posted by uart_set_baud to the driver queue, next to the driver's own events, with the rate in size
+#define UART_BAUD_EVENT UART_EVENT_MAX
+
+static const uint32_t DEFAULT_BAUD = 115200;
+static const uint32_t MIN_BAUD = 1200;
+static const uint32_t MAX_BAUD = 5000000;
 
 static QueueHandle_t uart_queue;
+static nvs_handle_t nvs;
+
+static ss_parser_S uart_parser = {.transport = SS_TRANSPORT_UART};
+static uint32_t baud;
+static uint32_t overflows; // events that lost received bytes
 
-static ss_parser_S uart_parser = {0};
+static void uart_receive(void);
+static void uart_flush_events(void);
 
 void uart_init(void) {
+   baud = DEFAULT_BAUD;
+   ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_open("uart", NVS_READWRITE, &nvs));
+   size_t len = sizeof(baud);
+   esp_err_t err = nvs_get_blob(nvs, "baud", &baud, &len);
+   if(err != ESP_ERR_NVS_NOT_FOUND) {
+      ESP_ERROR_CHECK_WITHOUT_ABORT(err);
+   }
+   if(baud < MIN_BAUD || baud > MAX_BAUD) baud = DEFAULT_BAUD;
+
    uart_config_t uart_config = {
-      .baud_rate = 115200,
+      .baud_rate = baud,
       .data_bits = UART_DATA_8_BITS,
       .parity    = UART_PARITY_DISABLE,
       .stop_bits = UART_STOP_BITS_1,
       .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
    };
-   ESP_ERROR_CHECK_WITHOUT_ABORT(uart_param_config(UART_NUM_0, &uart_config));
-   ESP_ERROR_CHECK_WITHOUT_ABORT(uart_driver_install(UART_NUM_0, 1024, 1024, 10, &uart_queue, 0));
+   ESP_ERROR_CHECK_WITHOUT_ABORT(uart_param_config(UART_PORT, &uart_config));
+   ESP_ERROR_CHECK_WITHOUT_ABORT(uart_driver_install(UART_PORT, RX_RING, TX_RING, EVENT_COUNT, &uart_queue, 0));
+
+   // every command ends in \r, wake up on it instead of waiting for the rx timeout
+   ESP_ERROR_CHECK_WITHOUT_ABORT(uart_enable_pattern_det_baud_intr(UART_PORT, '\r', 1, 9, 0, 0));
+   ESP_ERROR_CHECK_WITHOUT_ABORT(uart_pattern_queue_reset(UART_PORT, EVENT_COUNT));
 }
 
-void uart_task(void) {
-   size_t uart_len = 0;
-   uart_get_buffered_data_len(UART_NUM_0, &uart_len);
-   for(size_t i = 0; i < uart_len; i++) {
-      uint8_t byte = 0;
-      uart_read_bytes(UART_NUM_0, &byte, 1, portMAX_DELAY);
-      size_t resp_len = ss_handle_byte(&uart_parser, byte);
+// sleeps on the driver event queue, so a command is handled as soon as its bytes arrive
+void uart_task(void *args) {
+   for(;;) {
+      uart_event_t event;
+      if(!xQueueReceive(uart_queue, &event, portMAX_DELAY))
+         continue;
+
+      switch(event.type) {
+         case UART_DATA:
+         case UART_PATTERN_DET:
+            uart_receive();
+            break;
 
-      if(resp_len) {
-         uart_write_bytes(UART_NUM_0, uart_parser.data, resp_len);
+         case UART_BUFFER_FULL:
+            // what is buffered is intact, the rest of the command is lost
+            overflows++;
+            DLOG(DLOG_UART, ESP_LOG_WARN, "rx buffer full");
+            uart_receive();
+            break;
+
+         case UART_FIFO_OVF:
+            // bytes are missing somewhere in the ring, start over on a clean line
+            overflows++;
+            DLOG(DLOG_UART, ESP_LOG_WARN, "rx fifo overflow, input flushed");
+            uart_flush_input(UART_PORT);
+            uart_pattern_queue_reset(UART_PORT, EVENT_COUNT);
+            uart_flush_events();
+            uart_parser = (ss_parser_S) {.transport = SS_TRANSPORT_UART};
+            break;
+
+         case UART_BAUD_EVENT:
+            // the reply to the command that changed it still goes out at the old rate
+            uart_wait_tx_done(UART_PORT, pdMS_TO_TICKS(100));
+            baud = event.size;
+            ESP_ERROR_CHECK_WITHOUT_ABORT(uart_set_baudrate(UART_PORT, baud));
+            ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_blob(nvs, "baud", &baud, sizeof(baud)));
+            break;
+
+         default:
+            break;
       }
    }
 }
+
+// takes effect once the reply has been sent and is kept across reboots, the uart task commits it
+bool uart_set_baud(uint32_t rate) {
+   if(rate < MIN_BAUD || rate > MAX_BAUD)
+      return false;
+
+   uart_event_t event = {.type = UART_BAUD_EVENT, .size = rate};
+   return xQueueSend(uart_queue, &event, 0) == pdTRUE;
+}
+
+uint32_t uart_get_baud(void) {
+   return baud;
+}
+
+uint32_t uart_get_overflows(void) {
+   return overflows;
+}
+
+// drops the driver events queued before an overflow, a baud change still pending is posted again
+static void uart_flush_events(void) {
+   uart_event_t event;
+   uint32_t rate = 0;
+   while(xQueueReceive(uart_queue, &event, 0)) {
+      if(event.type == UART_BAUD_EVENT) rate = event.size;
+   }
+   if(rate) uart_set_baud(rate);
+}
+
+// reads the ring in chunks and sends the replies to each chunk in one write
+static void uart_receive(void) {
+   static uint8_t rx[CHUNK];
+   static uint8_t tx[TX_RING];
+   size_t tx_len = 0;
+
+   // pattern positions are only needed to wake up, everything buffered is read anyway
+   while(uart_pattern_pop_pos(UART_PORT) >= 0);
+
+   for(;;) {
+      int len = uart_read_bytes(UART_PORT, rx, sizeof(rx), 0);
+      if(len <= 0)
+         break;
+
+      uart_parser.rx_time = esp_timer_get_time();
+      for(int i = 0; i < len; i++) {
+         size_t resp_len = ss_handle_byte(&uart_parser, rx[i]);
+         if(!resp_len)
+            continue;
+
+         if(tx_len + resp_len > sizeof(tx)) {
+            uart_write_bytes(UART_PORT, tx, tx_len);
+            ss_sent(&uart_parser);
+            tx_len = 0;
+         }
+         memcpy(tx + tx_len, uart_parser.data, resp_len);
+         tx_len += resp_len;
+      }
+   }
+
+   if(tx_len) {
+      uart_write_bytes(UART_PORT, tx, tx_len);
+      ss_sent(&uart_parser);
+   }
+}
@@ -1,7 +1,13 @@
 #ifndef UART_H
 #define UART_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void uart_init(void);
-void uart_task(void);
+void uart_task(void *args);
+bool uart_set_baud(uint32_t);
+uint32_t uart_get_baud(void);
+uint32_t uart_get_overflows(void);
 
 #endif
@@ -2,8 +2,11 @@
 
 #include <esp_wifi.h>
 #include <esp_mac.h>
+#include <esp_timer.h>
 #include <nvs_flash.h>
 #include <lwip/ip4_addr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #include <ctype.h>
 #include <string.h>
@@ -35,9 +38,11 @@ static esp_netif_t *sta_netif, *ap_netif;
 
 static uint8_t bssid[6] = {0};
 
-static const uint8_t DELAY_COUNT = 100;
-static uint8_t save_count = 0;
-static uint8_t conn_count = 0;
+// config changes are applied after a quiet period so a burst of commands saves and reconnects once
+static const uint64_t APPLY_DELAY = 1000000; // us
+static esp_timer_handle_t save_timer, conn_timer;
+static bool save_pending, conn_pending; // set by the timers, done by wifi_task
+static TaskHandle_t task_handle;
 
 // dst length needs to be 2x of src + 3 (including surrounding quotes and terminating null)
 // synscan seems to escape them with forward slash /
@@ -84,9 +89,33 @@ static void event_handler(void *arg, esp_event_base_t event, int32_t event_id, v
    }
 }
 
+// only hands the work to wifi_task, a flash write or a reconnect here would hold up the guide
+// and script timers that share the esp_timer task
+static void wifi_timer(void *arg) {
+   __atomic_store_n((bool*) arg, true, __ATOMIC_RELEASE);
+   TaskHandle_t task = __atomic_load_n(&task_handle, __ATOMIC_ACQUIRE);
+   if(task) xTaskNotifyGive(task);
+}
+
+static void wifi_defer(esp_timer_handle_t timer) {
+   esp_timer_stop(timer);
+   ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(timer, APPLY_DELAY));
+}
+
 void wifi_init(void) {
-   save_count = 0;
-   conn_count = 0;
+   esp_timer_create_args_t save_args = {
+      .name = "wifi_save",
+      .callback = wifi_timer,
+      .arg = &save_pending,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_create(&save_args, &save_timer));
+
+   esp_timer_create_args_t conn_args = {
+      .name = "wifi_conn",
+      .callback = wifi_timer,
+      .arg = &conn_pending,
+   };
+   ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_create(&conn_args, &conn_timer));
 
    ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_open("wifi", NVS_READWRITE, &nvs));
    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_netif_init());
@@ -116,11 +145,18 @@ void wifi_init(void) {
    wifi_reconnect();
 }
 
-void wifi_task(void) {
-   if(save_count == 1) ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_blob(nvs, "config", &wifi_config, sizeof(wifi_config)));
-   if(save_count > 0)  save_count--;
-   if(conn_count == 1) wifi_reconnect();
-   if(conn_count > 0)  conn_count--;
+// saves and reconnects once the quiet period of the last change is over, at a low priority
+void wifi_task(void *args) {
+   __atomic_store_n(&task_handle, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+
+   for(;;) {
+      if(__atomic_exchange_n(&save_pending, false, __ATOMIC_ACQ_REL))
+         ESP_ERROR_CHECK_WITHOUT_ABORT(nvs_set_blob(nvs, "config", &wifi_config, sizeof(wifi_config)));
+      if(__atomic_exchange_n(&conn_pending, false, __ATOMIC_ACQ_REL))
+         wifi_reconnect();
+
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+   }
 }
 
 // reconnect with config
@@ -351,7 +387,7 @@ wifi_command_ok:
    goto wifi_command_end;
 
 wifi_command_end:
-   if(persist) save_count = DELAY_COUNT;
-   if(equal)   conn_count = DELAY_COUNT;
+   if(persist) wifi_defer(save_timer);
+   if(equal)   wifi_defer(conn_timer);
    return resp_len < max_len ? resp_len : max_len;
 }
@@ -5,7 +5,7 @@
 #include <stdint.h>
 
 void wifi_init(void);
-void wifi_task(void);
+void wifi_task(void *args);
 void wifi_reconnect(void);
 size_t wifi_command(uint8_t *data, size_t len, size_t max_len);
 
@@ -0,0 +1,249 @@
+# load generator: N virtual clients poll, goto and change rates the way planetarium apps do,
+# then reports throughput, latency percentiles and every '!' error reply
+#   python3 tools/load.py [-n clients] [-m movers] [-t seconds] [-i interval s] [--tcp] [host]
+#   python3 tools/load.py --serial /dev/ttyFT0 [--baud 115200] [-n clients] [-m movers] [-t seconds]
+# against the simulation: sim/build/telescope_sim -s 0 & python3 tools/load.py 127.0.0.1
+# the first 'movers' clients each own an axis and run gotos and rate changes on it, the rest only poll
+import argparse
+import collections
+import random
+import selectors
+import socket
+import sys
+import time
+
+PORT = 11880
+TIMEOUT = 1
+
+# numbers go least significant byte first
+def encode(value, digits=6):
+   return b"".join(b"%02X" % (value >> shift & 0xFF) for shift in range(0, digits * 4, 8))
+
+def decode(digits):
+   value = 0
+   for i in range(len(digits) - 2, -1, -2):
+      value = value << 8 | int(digits[i:i+2], 16)
+   return value
+
+def busy(reply):
+   return reply is None or not reply.startswith(b"=") or bool(decode(reply[1:5].decode()) & 1 << 0)
+
+# what a planetarium refreshes: position, status and goto target of both axes
+def poller(rng):
+   while True:
+      for axis in (1, 2):
+         yield b":j%d\r" % axis
+         yield b":f%d\r" % axis
+         yield b":h%d\r" % axis
+
+def stop(axis):
+   yield b":K%d\r" % axis
+   while busy((yield b":f%d\r" % axis)):
+      pass
+
+def mover(axis, rng):
+   while True:
+      # goto a random offset in either direction, polling until it arrives
+      yield from stop(axis)
+      yield b":G%d0%d\r" % (axis, rng.randrange(2))
+      yield b":H%d%s\r" % (axis, encode(rng.randrange(2000, 20000)))
+      yield b":J%d\r" % axis
+      while True:
+         yield b":j%d\r" % axis
+         if not busy((yield b":f%d\r" % axis)):
+            break
+
+      # track, then change the rate a few times without stopping like guiding corrections do
+      yield from stop(axis)
+      yield b":G%d10\r" % axis
+      yield b":I%d%s\r" % (axis, encode(rng.randrange(8, 64)))
+      yield b":J%d\r" % axis
+      for _ in range(4):
+         for _ in range(16):
+            yield b":j%d\r" % axis
+            yield b":f%d\r" % axis
+         yield b":I%d%s\r" % (axis, encode(rng.randrange(8, 64)))
+
+class Client:
+   def __init__(self, script, interval):
+      self.script = script
+      self.interval = interval
+      self.command = script.send(None)
+      self.due = 0
+      self.sent = 0
+      self.buffer = b""
+
+   # takes the reply to the outstanding command, None after a timeout
+   def done(self, reply, now):
+      self.due = now + self.interval
+      self.command = self.script.send(reply)
+
+class Stats:
+   def __init__(self):
+      self.latencies = collections.defaultdict(list)
+      self.errors = collections.Counter()
+      self.timeouts = collections.Counter()
+      self.mismatches = 0
+      self.closed = 0
+
+   def record(self, command, reply, rtt):
+      header = command[1:2].decode()
+      if reply is None:
+         self.timeouts[header] += 1
+         return
+      self.latencies[header].append(rtt)
+      if reply.startswith(b"!"):
+         self.errors[(command.decode().strip(), reply.decode().strip())] += 1
+      elif not reply.startswith(b"=") or not reply.endswith(b"\r"):
+         self.mismatches += 1
+
+def percentile(values, p):
+   return values[min(len(values) - 1, int(p * len(values)))]
+
+def summary(values):
+   values = sorted(values)
+   return "p50 %6.0f  p99 %6.0f  p999 %6.0f  max %6.0f" % (
+      percentile(values, 0.5), percentile(values, 0.99), percentile(values, 0.999), values[-1])
+
+# every client has its own socket so the server sees separate sessions, and at most one
+# command in flight like a real client
+def run_net(clients, stats, host, tcp, duration):
+   selector = selectors.DefaultSelector()
+   for client in clients:
+      if tcp:
+         client.sock = socket.create_connection((host, PORT))
+         client.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+      else:
+         client.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+         client.sock.connect((host, PORT))
+      client.sock.setblocking(False)
+      selector.register(client.sock, selectors.EVENT_READ, client)
+
+   end = time.monotonic() + duration
+   idle = list(clients)
+   waiting = []
+   while True:
+      now = time.monotonic()
+      if now >= end and not waiting:
+         break
+
+      for client in idle[:]:
+         if now < end and client.due <= now:
+            client.sock.send(client.command)
+            client.sent = now
+            idle.remove(client)
+            waiting.append(client)
+
+      timeout = TIMEOUT
+      if waiting:
+         timeout = min(timeout, min(c.sent for c in waiting) + TIMEOUT - now)
+      if idle and now < end:
+         timeout = min(timeout, min(c.due for c in idle) - now)
+      for key, _ in selector.select(max(timeout, 0)):
+         client = key.data
+         try:
+            data = client.sock.recv(512)
+         except (BlockingIOError, ConnectionRefusedError):
+            continue
+         except ConnectionResetError:
+            data = b""
+         if tcp and not data:
+            # the server keeps only a few connections and closes the rest
+            stats.closed += 1
+            selector.unregister(client.sock)
+            for queue in (idle, waiting):
+               if client in queue:
+                  queue.remove(client)
+            continue
+         if client not in waiting:
+            continue # a reply that came after its timeout
+         if tcp:
+            client.buffer += data
+            if b"\r" not in client.buffer:
+               continue
+            data, client.buffer = client.buffer.split(b"\r", 1)
+            data += b"\r"
+         now = time.monotonic()
+         stats.record(client.command, data, (now - client.sent) * 1e6)
+         waiting.remove(client)
+         idle.append(client)
+         client.done(data, now)
+
+      now = time.monotonic()
+      for client in waiting[:]:
+         if now - client.sent >= TIMEOUT:
+            stats.record(client.command, None, 0)
+            waiting.remove(client)
+            idle.append(client)
+            client.buffer = b""
+            client.done(None, now)
+
+   for client in clients:
+      client.sock.close()
+
+# a serial line carries one command at a time, the clients take turns in the order they are due
+def run_serial(clients, stats, port, baud, duration):
+   import serial
+   line = serial.Serial(port, baud, timeout=TIMEOUT)
+   line.reset_input_buffer()
+
+   end = time.monotonic() + duration
+   while time.monotonic() < end:
+      client = min(clients, key=lambda c: c.due)
+      delay = client.due - time.monotonic()
+      if delay > 0:
+         time.sleep(delay)
+      sent = time.monotonic()
+      line.write(client.command)
+      reply = line.read_until(b"\r") or None
+      if reply is not None and not reply.endswith(b"\r"):
+         reply = None
+      now = time.monotonic()
+      stats.record(client.command, reply, (now - sent) * 1e6)
+      client.done(reply, now)
+   line.close()
+
+def main():
+   parser = argparse.ArgumentParser(description="SynScan server load generator")
+   parser.add_argument("host", nargs="?", default="192.168.4.1")
+   parser.add_argument("-n", "--clients", type=int, default=4, help="virtual clients (default 4)")
+   parser.add_argument("-m", "--movers", type=int, default=2, help="clients running gotos, at most one per axis (default 2)")
+   parser.add_argument("-t", "--time", type=float, default=10, help="seconds to run (default 10)")
+   parser.add_argument("-i", "--interval", type=float, default=0, help="seconds between a reply and the next command (default 0)")
+   parser.add_argument("--tcp", action="store_true", help="connect over TCP instead of UDP")
+   parser.add_argument("--serial", metavar="PORT", help="send everything over this serial port instead")
+   parser.add_argument("--baud", type=int, default=115200)
+   parser.add_argument("--seed", type=int, default=1)
+   args = parser.parse_args()
+
+   # two clients moving the same axis would reject each other's commands with '!'
+   movers = min(args.movers, 2, args.clients)
+   rng = random.Random(args.seed)
+   clients = [Client(mover(n + 1, rng) if n < movers else poller(rng), args.interval) for n in range(args.clients)]
+
+   stats = Stats()
+   start = time.monotonic()
+   if args.serial:
+      target = "serial %s" % args.serial
+      run_serial(clients, stats, args.serial, args.baud, args.time)
+   else:
+      target = "%s %s" % ("tcp" if args.tcp else "udp", args.host)
+      run_net(clients, stats, args.host, args.tcp, args.time)
+   elapsed = time.monotonic() - start
+
+   latencies = [rtt for values in stats.latencies.values() for rtt in values]
+   timeouts = sum(stats.timeouts.values())
+   print("%s, %d clients (%d moving), %.1f s" % (target, len(clients), movers, elapsed))
+   print("%d replies, %.0f cmd/s, %d timeouts, %d malformed" % (len(latencies), len(latencies) / elapsed, timeouts, stats.mismatches))
+   if stats.closed:
+      print("%d connections closed by the server" % stats.closed)
+   if latencies:
+      print("latency us  all  %s" % summary(latencies))
+      for header in sorted(stats.latencies):
+         print("            :%s   %s  (%d)" % (header, summary(stats.latencies[header]), len(stats.latencies[header])))
+   for (command, reply), count in sorted(stats.errors.items()):
+      print("error %s on %s x%d" % (reply, command, count))
+   return 1 if stats.errors or timeouts or stats.mismatches or stats.closed else 0
+
+if __name__ == "__main__":
+   sys.exit(main())
@@ -0,0 +1,60 @@
+# polls both axes with the ':Z3' status extension, one round trip per refresh
+#   python3 tools/poll.py [host] [interval s]
+import socket
+import sys
+import time
+
+HOST = sys.argv[1] if len(sys.argv) > 1 else "192.168.4.1"
+PORT = 11880
+INTERVAL = float(sys.argv[2]) if len(sys.argv) > 2 else 0.5
+
+AXES = ("RA", "DE")
+
+# numbers go least significant byte first
+def decode(digits):
+   value = 0
+   for i in range(len(digits) - 2, -1, -2):
+      value = value << 8 | int(digits[i:i+2], 16)
+   return value
+
+def parse(reply):
+   if not reply.startswith("=") or not reply.endswith("\r"):
+      raise ValueError("error reply %r" % reply)
+   body = reply[1:-1]
+   axes = {}
+   for n, name in enumerate(AXES):
+      axis = body[n*22:(n+1)*22]
+      status = decode(axis[18:22])
+      axes[name] = {
+         "count":    decode(axis[0:6]) - 0x800000,
+         "target":   decode(axis[6:12]) - 0x800000,
+         "period":   decode(axis[12:18]),
+         "busy":     bool(status & 1 << 0),
+         "tracking": bool(status & 1 << 4),
+         "ccw":      bool(status & 1 << 5),
+         "fast":     bool(status & 1 << 6),
+         "fault":    bool(status & 1 << 8),
+      }
+   return axes
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+sock.settimeout(1)
+
+while True:
+   start = time.monotonic()
+   sock.sendto(b":Z3\r", (HOST, PORT))
+   try:
+      reply, _ = sock.recvfrom(128)
+   except socket.timeout:
+      print("timeout")
+      continue
+   rtt = (time.monotonic() - start) * 1000
+
+   axes = parse(reply.decode())
+   line = "  ".join("%s %9d -> %9d T1 %6d %s%s%s%s%s" % (
+      name, a["count"], a["target"], a["period"],
+      "B" if a["busy"] else "-", "T" if a["tracking"] else "G",
+      "<" if a["ccw"] else ">", "F" if a["fast"] else "S", "!" if a["fault"] else " ")
+      for name, a in axes.items())
+   print("%s  %5.1f ms" % (line, rtt))
+   time.sleep(INTERVAL)
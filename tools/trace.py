@@ -0,0 +1,120 @@
+# downloads the protocol trace of the mount and replays it against the simulation
+#   python3 tools/trace.py dump [host] > trace.jsonl
+#   python3 tools/trace.py replay trace.jsonl [host]
+# start the simulation for a replay with: sim/build/telescope_sim
+import json
+import socket
+import statistics
+import sys
+import time
+
+PORT = 11880
+TRANSPORTS = ("uart", "udp", "tcp")
+
+def unescape(text):
+   out = bytearray()
+   i = 0
+   while i < len(text):
+      if text[i] == "%":
+         out.append(int(text[i+1:i+3], 16))
+         i += 3
+      else:
+         out.append(ord(text[i]))
+         i += 1
+   return bytes(out)
+
+def query(sock, host, command):
+   sock.sendto(command, (host, PORT))
+   reply, _ = sock.recvfrom(512)
+   line = reply.decode("latin-1").split("\r\n")[0]
+   if not line.startswith("+TRACE:"):
+      raise ValueError("unexpected reply %r" % reply)
+   return line[len("+TRACE:"):]
+
+# one JSON line per record, leaving out the download's own queries
+def dump(host):
+   sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+   sock.settimeout(1)
+   oldest, end = (int(n) for n in query(sock, host, b"+TRACE?\r").split(","))
+   seq = oldest
+   while seq < end:
+      fields = query(sock, host, b"+TRACE?%d\r" % seq).split(",")
+      record = {
+         "seq": int(fields[0]), "time": int(fields[1]), "latency": int(fields[2]),
+         "transport": TRANSPORTS[int(fields[3])], "peer": fields[4],
+         "cmd": unescape(fields[5]).decode("latin-1"), "resp": unescape(fields[6]).decode("latin-1"),
+      }
+      seq = record["seq"] + 1
+      if record["seq"] < end and not record["cmd"].startswith("+TRACE"):
+         print(json.dumps(record))
+
+# sends the commands with their recorded spacing, each peer over its own socket so the sim
+# gives it its own session, and compares the replies and how long they took
+def replay(path, host):
+   records = [json.loads(line) for line in open(path) if line.strip()]
+   if not records:
+      return 0
+
+   socks = {}
+   latencies = []
+   mismatches = 0
+   start = time.monotonic()
+   first = records[0]["time"]
+   for record in records:
+      due = start + (record["time"] - first) / 1e6
+      delay = due - time.monotonic()
+      if delay > 0:
+         time.sleep(delay)
+
+      key = (record["transport"], record["peer"])
+      if key not in socks:
+         if record["transport"] == "tcp":
+            sock = socket.create_connection((host, PORT))
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+         else:
+            # the sim UART is stdin, its commands go over UDP instead
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.connect((host, PORT))
+         sock.settimeout(1)
+         socks[key] = sock
+      sock = socks[key]
+
+      # the trace keeps AT commands without their arguments, which cannot be sent again
+      if record["cmd"].startswith("+") and record["cmd"].endswith("="):
+         continue
+
+      cmd = record["cmd"].encode("latin-1")
+      sent = time.monotonic()
+      sock.send(cmd)
+      try:
+         reply = sock.recv(512).decode("latin-1")
+      except socket.timeout:
+         reply = None
+      rtt = (time.monotonic() - sent) * 1e6
+      latencies.append((record["latency"], rtt))
+
+      # the trace keeps only the start of long commands and replies
+      expected = record["resp"]
+      if reply is None or reply[:len(expected)] != expected:
+         mismatches += 1
+         print("#%d %s %s %r: expected %r got %r" % (record["seq"], record["transport"], record["peer"],
+                                                      record["cmd"], expected, reply))
+
+   for sock in socks.values():
+      sock.close()
+
+   recorded = [r for r, _ in latencies]
+   measured = [m for _, m in latencies]
+   print("%d commands, %d replies differ" % (len(records), mismatches))
+   print("latency us   recorded: median %.0f max %.0f   replayed round trip: median %.0f max %.0f" % (
+      statistics.median(recorded), max(recorded), statistics.median(measured), max(measured)))
+   return 1 if mismatches else 0
+
+if __name__ == "__main__":
+   if len(sys.argv) >= 2 and sys.argv[1] == "dump":
+      dump(sys.argv[2] if len(sys.argv) > 2 else "192.168.4.1")
+   elif len(sys.argv) >= 3 and sys.argv[1] == "replay":
+      sys.exit(replay(sys.argv[2], sys.argv[3] if len(sys.argv) > 3 else "127.0.0.1"))
+   else:
+      print("usage: trace.py dump [host] | trace.py replay file [host]", file=sys.stderr)
+      sys.exit(2)